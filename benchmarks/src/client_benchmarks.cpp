@@ -0,0 +1,201 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <wildcat/ws/client.hpp>
+#include <wildcat/ws/histogram.hpp>
+#include <wildcat/ws/loopback.hpp>
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    using wildcat::ws::LoopbackStream;
+    using wildcat::ws::MockServer;
+    using wildcat::ws::OpCode;
+    using client_t = wildcat::ws::Client<LoopbackStream>;
+
+    std::int64_t nanosSince(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time).count();
+    }
+
+    void setPercentiles(benchmark::State &state, const wildcat::ws::LatencyHistogram &histogram) {
+        const auto snapshot = histogram.snapshot();
+        state.counters["p50"] = static_cast<double>(snapshot.percentile(50));
+        state.counters["p99"] = static_cast<double>(snapshot.percentile(99));
+        state.counters["p999"] = static_cast<double>(snapshot.percentile(99.9));
+    }
+
+    /// Runs the client side of the handshake against a server thread, one handshake per iteration
+    void BM_Handshake(benchmark::State &state) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        LoopbackStream stream(clientFd);
+        MockServer server(serverFd);
+        std::thread serverThread([&server]() {
+            try {
+                for (;;)
+                    server.acceptHandshake();
+            } catch (const wildcat::ws::HandshakeError &) {
+                // the client closed its end
+            }
+        });
+
+        for (auto _: state) {
+            if (!wildcat::ws::Handshaker<LoopbackStream>::doHandshake("localhost", "/feed", &stream))
+                state.SkipWithError("Handshake failed");
+        }
+        stream.disconnect();
+        serverThread.join();
+    }
+
+    /// Sends text messages of `state.range(0)` bytes, with a new mask key for each frame when `state.range(1)` is 1 and
+    /// with the key of the connection when 0. A server thread discards what it receives. An iteration is a send.
+    void BM_Send(benchmark::State &state) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.perFrameMaskKeys = state.range(1) != 0;
+        client_t client(std::make_unique<LoopbackStream>(clientFd), config);
+        std::thread server([fd = serverFd]() {
+            char buffer[64 * 1024];
+            while (::recv(fd, buffer, sizeof(buffer), 0) > 0) {}
+        });
+
+        const std::string message(static_cast<std::size_t>(state.range(0)), 'x');
+        for (auto _: state)
+            benchmark::DoNotOptimize(client.send(message));
+        ::shutdown(clientFd, SHUT_RDWR);
+        server.join();
+        ::close(serverFd);
+
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * message.size()));
+    }
+
+    /// Streams messages of `state.range(0)` bytes from a server thread to the client as fast as the client reads them.
+    /// An iteration is a call to `poll` that received bytes, of at most 256KiB since the server never runs dry.
+    void BM_ClientThroughput(benchmark::State &state) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.receiveByteBudget = 256 * 1024;
+        client_t client(std::make_unique<LoopbackStream>(clientFd), config);
+
+        MockServer server(serverFd);
+        wildcat::ws::ReplayConfig replay;
+        replay.burstSize = 64;
+        replay.repeat = SIZE_MAX;
+        server.replay({{OpCode::BINARY, std::string(static_cast<std::size_t>(state.range(0)), 'x')}}, replay);
+
+        std::size_t messages = 0;
+        std::size_t bytes = 0;
+        auto handler = [&messages, &bytes](OpCode, const std::uint8_t *payload, std::size_t length) {
+            benchmark::DoNotOptimize(payload);
+            ++messages;
+            bytes += length;
+        };
+        for (auto _: state) {
+            while (client.poll(handler) == 0)
+                std::this_thread::yield();
+        }
+        // the replay stops at the first failed send
+        ::shutdown(clientFd, SHUT_RDWR);
+        server.stop();
+
+        state.SetItemsProcessed(static_cast<std::int64_t>(messages));
+        state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+    }
+
+    /// Ping-pong with a server thread: the client sends a message, the server answers with a message of
+    /// `state.range(0)` bytes stamped with its send time, and the client polls until it is dispatched
+    ///
+    /// An iteration is a round trip. The `p50`, `p99` and `p999` counters are the one-way latency in nanoseconds from
+    /// the server sending the answer to the handler of `poll` receiving it.
+    void BM_ClientLatency(benchmark::State &state) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        client_t client(std::make_unique<LoopbackStream>(clientFd), config);
+
+        const auto length = std::max<std::size_t>(static_cast<std::size_t>(state.range(0)), sizeof(std::int64_t));
+        MockServer server(serverFd);
+        std::thread serverThread([&server, length]() {
+            std::string payload(length, 'x');
+            try {
+                for (;;) {
+                    server.readFrame();
+                    const auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count();
+                    std::memcpy(payload.data(), &timestamp, sizeof(timestamp));
+                    server.sendMessage(OpCode::BINARY, payload);
+                }
+            } catch (const std::exception &) {
+                // the client closed its end
+            }
+        });
+
+        wildcat::ws::LatencyHistogram histogram;
+        bool isReceived = false;
+        auto handler = [&histogram, &isReceived](OpCode, const std::uint8_t *payload, std::size_t) {
+            histogram.record(nanosSince(MockServer::sendTimeOf(payload)));
+            isReceived = true;
+        };
+        const std::string ping = "ping";
+        for (auto _: state) {
+            client.send(ping);
+            isReceived = false;
+            while (!isReceived)
+                client.poll(handler);
+        }
+        ::shutdown(clientFd, SHUT_RDWR);
+        serverThread.join();
+
+        setPercentiles(state, histogram);
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    }
+
+    /// Replays bursts of messages at a fixed rate, as a market data feed sends them, and measures the latency of each
+    /// message from the server sending its burst to the handler of `poll` receiving it
+    ///
+    /// Arguments: messages per burst, largest payload of a frame (0 for unfragmented messages), bytes per send (0 for
+    /// a burst in one send). The messages are 512 bytes at 10000 bursts per second. An iteration is a call to `poll`
+    /// that received bytes. The `p50`, `p99` and `p999` counters are in nanoseconds.
+    void BM_ReplayBurst(benchmark::State &state) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        client_t client(std::make_unique<LoopbackStream>(clientFd), config);
+
+        MockServer server(serverFd);
+        wildcat::ws::ReplayConfig replay;
+        replay.burstSize = static_cast<std::size_t>(state.range(0));
+        replay.fragmentSize = static_cast<std::size_t>(state.range(1));
+        replay.chunkSize = static_cast<std::size_t>(state.range(2));
+        replay.messageRate = 10000.0 * static_cast<double>(replay.burstSize);
+        replay.repeat = SIZE_MAX;
+        replay.stampSendTime = true;
+        server.replay({{OpCode::BINARY, std::string(512, 'x')}}, replay);
+
+        wildcat::ws::LatencyHistogram histogram;
+        std::size_t messages = 0;
+        auto handler = [&histogram, &messages](OpCode, const std::uint8_t *payload, std::size_t) {
+            histogram.record(nanosSince(MockServer::sendTimeOf(payload)));
+            ++messages;
+        };
+        for (auto _: state) {
+            while (client.poll(handler) == 0) {}
+        }
+        ::shutdown(clientFd, SHUT_RDWR);
+        server.stop();
+
+        setPercentiles(state, histogram);
+        state.SetItemsProcessed(static_cast<std::int64_t>(messages));
+    }
+
+}
+
+BENCHMARK(BM_Handshake)->UseRealTime();
+BENCHMARK(BM_Send)->ArgNames({"length", "perFrameKey"})->ArgsProduct({{16, 128, 1024}, {0, 1}});
+BENCHMARK(BM_ClientThroughput)->Arg(64)->Arg(1024)->Arg(16 * 1024)->UseRealTime();
+BENCHMARK(BM_ClientLatency)->Arg(64)->Arg(1024)->Arg(16 * 1024)->UseRealTime();
+BENCHMARK(BM_ReplayBurst)->ArgNames({"burst", "fragment", "chunk"})
+        ->Args({1, 0, 0})->Args({32, 0, 0})->Args({32, 0, 1448})->Args({32, 128, 1448})->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,123 @@
+#include <string>
+#include <vector>
+#include <wildcat/ws/deflate.hpp>
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    /// Generates order book updates like those of a full depth feed, which share most of their bytes
+    std::vector<std::string> genUpdates(std::size_t n) {
+        std::vector<std::string> updates;
+        updates.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            std::string update = R"({"type":"l2update","product_id":"BTC-USD","changes":[)";
+            for (std::size_t j = 0; j < 1 + i % 5; ++j) {
+                if (j > 0)
+                    update += ',';
+                update += R"([")" + std::string((i + j) % 2 ? "buy" : "sell") + R"(",")" +
+                          std::to_string(29000 + (i * 7 + j * 13) % 2000) + "." + std::to_string((i + j) % 100) +
+                          R"(",")" + std::to_string((i * 31 + j) % 50) + "." + std::to_string(i % 1000) + R"("])";
+            }
+            update += R"(],"time":"2022-05-01T12:00:)" + std::to_string(10 + i % 50) + "." +
+                      std::to_string(100000 + i) + R"(Z"})";
+            updates.push_back(std::move(update));
+        }
+        return updates;
+    }
+
+    const std::vector<std::string> &updates() {
+        static const auto updates = genUpdates(1024);
+        return updates;
+    }
+
+    wildcat::ws::DeflateParameters makeParameters(benchmark::State &state) {
+        wildcat::ws::DeflateParameters params;
+        params.serverMaxWindowBits = params.clientMaxWindowBits = static_cast<int>(state.range(0));
+        params.serverNoContextTakeover = params.clientNoContextTakeover = state.range(2) == 0;
+        return params;
+    }
+
+    /// Reports the wire bytes per message next to the time per message
+    void setCounters(benchmark::State &state, std::size_t messageBytes, std::size_t wireBytes, std::size_t messages) {
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+        state.counters["wire_bytes"] = benchmark::Counter(static_cast<double>(wireBytes) / messages);
+        state.counters["ratio"] = benchmark::Counter(static_cast<double>(messageBytes) / wireBytes);
+    }
+
+    /// Compresses one message per iteration
+    ///
+    /// Arguments: window bits, compression level, context takeover
+    void BM_Compress(benchmark::State &state) {
+        wildcat::ws::DeflateConfig config;
+        config.compressionLevel = static_cast<int>(state.range(1));
+        wildcat::ws::PerMessageDeflate deflate(makeParameters(state), config);
+
+        const auto &messages = updates();
+        std::size_t i = 0;
+        std::size_t messageBytes = 0;
+        std::size_t wireBytes = 0;
+        for (auto _: state) {
+            const auto &message = messages[i++ & (messages.size() - 1)];
+            const auto compressed = deflate.compress(reinterpret_cast<const std::uint8_t *>(message.data()),
+                                                     message.size());
+            benchmark::DoNotOptimize(compressed.data());
+            messageBytes += message.size();
+            wireBytes += compressed.size();
+        }
+        setCounters(state, messageBytes, wireBytes, i);
+    }
+
+    /// Decompresses one message per iteration, as the client does for a compressed feed
+    ///
+    /// Arguments: window bits, compression level of the server, context takeover
+    void BM_Decompress(benchmark::State &state) {
+        wildcat::ws::DeflateConfig config;
+        config.compressionLevel = static_cast<int>(state.range(1));
+        const auto params = makeParameters(state);
+
+        // the server compresses the feed once, the client decompresses it in a loop, restarting its stream at the
+        // beginning of the feed each time so the context matches
+        const auto &messages = updates();
+        std::vector<std::string> compressed;
+        std::size_t messageBytes = 0;
+        std::size_t wireBytes = 0;
+        {
+            wildcat::ws::PerMessageDeflate server(params, config, false);
+            for (const auto &message: messages) {
+                const auto out = server.compress(reinterpret_cast<const std::uint8_t *>(message.data()),
+                                                 message.size());
+                compressed.emplace_back(reinterpret_cast<const char *>(out.data()), out.size());
+                messageBytes += message.size();
+                wireBytes += out.size();
+            }
+        }
+
+        std::size_t n = 0;
+        while (state.KeepRunningBatch(static_cast<benchmark::IterationCount>(compressed.size()))) {
+            state.PauseTiming();
+            wildcat::ws::PerMessageDeflate client(params, config);
+            state.ResumeTiming();
+            for (const auto &message: compressed) {
+                const auto out = client.decompress(reinterpret_cast<const std::uint8_t *>(message.data()),
+                                                   message.size());
+                benchmark::DoNotOptimize(out.data());
+            }
+            ++n;
+        }
+        setCounters(state, messageBytes * n, wireBytes * n, compressed.size() * n);
+    }
+
+    void deflateArgs(benchmark::internal::Benchmark *b) {
+        b->ArgNames({"window_bits", "level", "context_takeover"});
+        for (int windowBits: {9, 12, 15})
+            for (int level: {1, 6, 9})
+                for (int contextTakeover: {0, 1})
+                    b->Args({windowBits, level, contextTakeover});
+    }
+
+}
+
+BENCHMARK(BM_Compress)->Apply(deflateArgs);
+BENCHMARK(BM_Decompress)->Apply(deflateArgs);
+
+BENCHMARK_MAIN();
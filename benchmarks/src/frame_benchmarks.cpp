@@ -0,0 +1,178 @@
+#include <array>
+#include <string>
+#include <vector>
+#include <wildcat/ws/client.hpp>
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    using wildcat::ws::FrameHeader;
+    using wildcat::ws::OpCode;
+
+    /*
+     * Arguments of the frame benchmarks: payload length, masked (0 or 1)
+     *
+     * The payload lengths cover the three encodings of the length in the header: 7 bits (< 126), 16 bits (< 65536)
+     * and 64 bits.
+     */
+
+    FrameHeader makeHeader(benchmark::State &state) {
+        FrameHeader header{};
+        header.opCode = OpCode::BINARY;
+        header.isFinal = true;
+        header.messageLength = static_cast<std::size_t>(state.range(0));
+        header.mask = state.range(1) != 0;
+        header.maskKeys = {0x12, 0x34, 0x56, 0x78};
+        return header;
+    }
+
+    /// Writes `count` frames back to back
+    std::vector<std::uint8_t> writeFrames(const FrameHeader &header, std::size_t count) {
+        const std::vector<std::uint8_t> payload(header.messageLength, 'x');
+        std::vector<std::uint8_t> buffer(count * (wildcat::ws::MAX_FRAME_HEADER_LENGTH + header.messageLength));
+        std::size_t length = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            wildcat::ws::FrameWriter writer(buffer.data() + length, buffer.size() - length);
+            writer.write(header, payload.data());
+            length += writer.frameLength();
+        }
+        buffer.resize(length);
+        return buffer;
+    }
+
+    /// Number of frames of the payload length that fill about 1MiB, so the batch benchmarks run from cache
+    std::size_t framesPerBatch(benchmark::State &state) {
+        return std::max<std::size_t>(1, (1 << 20) / (static_cast<std::size_t>(state.range(0)) + 14));
+    }
+
+    void BM_FrameWrite(benchmark::State &state) {
+        const auto header = makeHeader(state);
+        const std::vector<std::uint8_t> payload(header.messageLength, 'x');
+        std::vector<std::uint8_t> buffer(wildcat::ws::MAX_FRAME_HEADER_LENGTH + header.messageLength);
+        for (auto _: state) {
+            wildcat::ws::FrameWriter writer(buffer.data(), buffer.size());
+            writer.write(header, payload.data());
+            benchmark::DoNotOptimize(buffer.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * header.messageLength));
+    }
+
+    /// Decodes a frame, unmasking the payload in place when masked
+    void BM_FrameRead(benchmark::State &state) {
+        const auto header = makeHeader(state);
+        auto buffer = writeFrames(header, 1);
+        for (auto _: state) {
+            wildcat::ws::FrameReader reader(buffer.data(), buffer.size());
+            benchmark::DoNotOptimize(reader.messageBegin());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * header.messageLength));
+    }
+
+    /// Splits a buffer of frames with `assembleFrame`, the frames of a batch per iteration
+    void BM_AssembleFrame(benchmark::State &state) {
+        const auto header = makeHeader(state);
+        const auto count = framesPerBatch(state);
+        auto buffer = writeFrames(header, count);
+        for (auto _: state) {
+            const auto n = wildcat::ws::assembleFrame(
+                    buffer.data(), buffer.size(), [](OpCode, const std::uint8_t *payload, std::size_t) {
+                        benchmark::DoNotOptimize(payload);
+                    });
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * count));
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * buffer.size()));
+    }
+
+    /// Splits a buffer of frames with the FrameParser used by the Client, the frames of a batch per iteration
+    void BM_FrameParser(benchmark::State &state) {
+        const auto header = makeHeader(state);
+        const auto count = framesPerBatch(state);
+        auto buffer = writeFrames(header, count);
+        wildcat::ws::FrameParser parser;
+        for (auto _: state) {
+            const auto n = parser.parse(
+                    buffer.data(), buffer.size(),
+                    [](OpCode, std::uint8_t *payload, std::size_t) { benchmark::DoNotOptimize(payload); },
+                    [](const FrameHeader &, std::uint8_t *, std::size_t, std::uint64_t) {});
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * count));
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * buffer.size()));
+    }
+
+    void frameArgs(benchmark::internal::Benchmark *benchmark) {
+        benchmark->ArgNames({"length", "masked"});
+        for (std::int64_t length: {16, 125, 1024, 65535, 1 << 20})
+            for (std::int64_t masked: {0, 1})
+                benchmark->Args({length, masked});
+    }
+
+    /*
+     * Sending an order of a fixed layout where only the price and quantity change, as a masked text frame ready to be
+     * sent. The benchmarks take no arguments.
+     */
+
+    const std::string ORDER = R"({"op":"order","args":{"symbol":"BTC-USD","side":"buy","type":"limit",)"
+                              R"("price":"00000.00","qty":"0000.000","tif":"GTC","clientId":"a1b2c3d4"}})";
+    const std::array<std::string, 2> PRICES{"64123.50", "64123.75"};
+    const std::array<std::string, 2> QUANTITIES{"0001.250", "0000.500"};
+
+    /// Copies the order, writes the fields, and encodes the frame with a masked payload
+    void BM_OrderEncode(benchmark::State &state) {
+        const auto price = ORDER.find("00000.00");
+        const auto qty = ORDER.find("0000.000");
+        std::string order = ORDER;
+        std::vector<std::uint8_t> buffer(wildcat::ws::MAX_FRAME_HEADER_LENGTH + ORDER.size());
+        FrameHeader header{};
+        header.opCode = OpCode::TEXT;
+        header.isFinal = true;
+        header.messageLength = ORDER.size();
+        header.mask = true;
+        header.maskKeys = {0x12, 0x34, 0x56, 0x78};
+        std::size_t i = 0;
+        for (auto _: state) {
+            order.replace(price, PRICES[i & 1].size(), PRICES[i & 1]);
+            order.replace(qty, QUANTITIES[i & 1].size(), QUANTITIES[i & 1]);
+            wildcat::ws::FrameWriter writer(buffer.data(), buffer.size());
+            writer.write(header, reinterpret_cast<const std::uint8_t *>(order.data()));
+            benchmark::DoNotOptimize(buffer.data());
+            benchmark::ClobberMemory();
+            ++i;
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    }
+
+    /// Patches the fields of a prepared frame and masks it with new keys, as `Client::sendPrepared` does
+    void BM_OrderPatch(benchmark::State &state) {
+        const auto price = ORDER.find("00000.00");
+        const auto qty = ORDER.find("0000.000");
+        wildcat::ws::PreparedFrame frame(ORDER, {0x12, 0x34, 0x56, 0x78});
+        std::array<std::uint8_t, 4> keys{0x9a, 0xbc, 0xde, 0xf0};
+        std::size_t i = 0;
+        for (auto _: state) {
+            frame.patch(price, PRICES[i & 1]);
+            frame.patch(qty, QUANTITIES[i & 1]);
+            keys[0] = static_cast<std::uint8_t>(i);
+            frame.setMaskKeys(keys);
+            benchmark::DoNotOptimize(frame.data());
+            benchmark::ClobberMemory();
+            ++i;
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    }
+
+}
+
+BENCHMARK(BM_FrameWrite)->Apply(frameArgs);
+BENCHMARK(BM_FrameRead)->Apply(frameArgs);
+BENCHMARK(BM_AssembleFrame)->Apply(frameArgs);
+BENCHMARK(BM_FrameParser)->Apply(frameArgs);
+BENCHMARK(BM_OrderEncode);
+BENCHMARK(BM_OrderPatch);
+
+BENCHMARK_MAIN();
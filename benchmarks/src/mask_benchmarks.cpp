@@ -0,0 +1,103 @@
+
+#include <vector>
+#include <wildcat/ws/handshake.hpp>
+#include <wildcat/ws/mask.hpp>
+#include <wildcat/ws/mask_key.hpp>
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    const std::array<std::uint8_t, 4> MASK_KEYS{0x12, 0x34, 0x56, 0x78};
+
+    /// Byte at a time loop previously used by FrameWriter and FrameReader
+    void maskLoop(std::uint8_t *buffer, std::size_t length, const std::array<std::uint8_t, 4> &maskKeys) {
+        int i = 0;
+        for (auto *b = buffer; b != buffer + length; ++b) {
+            *b ^= maskKeys[i & 0x3];
+            ++i;
+        }
+    }
+
+    void setBytesProcessed(benchmark::State &state) {
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+    }
+
+    void BM_MaskScalarLoop(benchmark::State &state) {
+        std::vector<std::uint8_t> buffer(state.range(0), 0xab);
+        for (auto _: state) {
+            maskLoop(buffer.data(), buffer.size(), MASK_KEYS);
+            benchmark::DoNotOptimize(buffer.data());
+            benchmark::ClobberMemory();
+        }
+        setBytesProcessed(state);
+    }
+
+    void BM_MaskKernel(benchmark::State &state, wildcat::ws::detail::mask_fn_t impl, bool isSupported) {
+        if (!isSupported) {
+            state.SkipWithError("Instruction set not supported");
+            return;
+        }
+        const auto key = wildcat::ws::detail::loadMaskKey(MASK_KEYS);
+        std::vector<std::uint8_t> buffer(state.range(0), 0xab);
+        for (auto _: state) {
+            impl(buffer.data(), buffer.data(), buffer.size(), key);
+            benchmark::DoNotOptimize(buffer.data());
+            benchmark::ClobberMemory();
+        }
+        setBytesProcessed(state);
+    }
+
+    void BM_Mask(benchmark::State &state) {
+        std::vector<std::uint8_t> buffer(state.range(0), 0xab);
+        for (auto _: state) {
+            wildcat::ws::mask(buffer.data(), buffer.size(), MASK_KEYS);
+            benchmark::DoNotOptimize(buffer.data());
+            benchmark::ClobberMemory();
+        }
+        setBytesProcessed(state);
+    }
+
+    /// A mask key from the ChaCha20 keystream of the client
+    void BM_MaskKeyGenerator(benchmark::State &state) {
+        wildcat::ws::MaskKeyGenerator generator;
+        for (auto _: state)
+            benchmark::DoNotOptimize(generator.next());
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    }
+
+    /// A mask key from a KeyGenerator made for the frame, as the key of the handshake is generated
+    void BM_KeyGenerator(benchmark::State &state) {
+        std::array<std::uint8_t, 4> key{};
+        for (auto _: state) {
+            wildcat::ws::KeyGenerator generator;
+            generator.fill(key);
+            benchmark::DoNotOptimize(key.data());
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    }
+
+    // payload sizes from 16 B to 32 MiB
+    constexpr std::int64_t MIN_SIZE = 16;
+    constexpr std::int64_t MAX_SIZE = 1024 * 1024 * 32;
+
+}
+
+BENCHMARK(BM_MaskScalarLoop)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_CAPTURE(BM_MaskKernel, word, &wildcat::ws::detail::maskWord, true)
+        ->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+#ifdef WILDCAT_WS_MASK_X86
+BENCHMARK_CAPTURE(BM_MaskKernel, sse2, &wildcat::ws::detail::maskSse2,
+                  __builtin_cpu_supports("sse2"))
+        ->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_CAPTURE(BM_MaskKernel, avx2, &wildcat::ws::detail::maskAvx2,
+                  __builtin_cpu_supports("avx2"))
+        ->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_CAPTURE(BM_MaskKernel, avx512, &wildcat::ws::detail::maskAvx512,
+                  __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        ->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+#endif
+BENCHMARK(BM_Mask)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK(BM_MaskKeyGenerator);
+BENCHMARK(BM_KeyGenerator);
+
+BENCHMARK_MAIN();
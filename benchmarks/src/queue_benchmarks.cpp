@@ -0,0 +1,78 @@
+#include <thread>
+#include <wildcat/ws/queue.hpp>
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    using wildcat::ws::FutexWait;
+    using wildcat::ws::MpmcQueue;
+    using wildcat::ws::SpinWait;
+    using wildcat::ws::SpscQueue;
+    using wildcat::ws::YieldWait;
+
+    /// Ping-pong between the benchmark thread and an echo thread through a pair of queues
+    ///
+    /// An iteration is a round trip, two hand-offs, so the hand-off latency is half the time per iteration. It is
+    /// reported by the `latency` counter. The threads should be on separate cores, ideally of the same socket.
+    template<class Queue_T>
+    void BM_HandOffLatency(benchmark::State &state) {
+        Queue_T ping(1024);
+        Queue_T pong(1024);
+        std::thread echo([&ping, &pong]() {
+            bool isDone = false;
+            while (!isDone) {
+                ping.waitConsume([&](std::uint64_t &item) {
+                    isDone = item == 0;
+                    pong.push(item);
+                });
+            }
+        });
+
+        std::uint64_t i = 0;
+        for (auto _: state) {
+            ping.push(++i);
+            pong.waitConsume([](std::uint64_t &item) { benchmark::DoNotOptimize(item); });
+        }
+        ping.push(0);
+        echo.join();
+
+        state.counters["latency"] = benchmark::Counter(static_cast<double>(state.iterations()) * 2,
+                                                       benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    }
+
+    /// Streams items from the benchmark thread to a consumer thread in batches of `state.range(0)`
+    template<class Queue_T>
+    void BM_HandOffThroughput(benchmark::State &state) {
+        const auto batchSize = static_cast<std::size_t>(state.range(0));
+        Queue_T queue(1024);
+        std::thread consumer([&queue]() {
+            bool isDone = false;
+            while (!isDone) {
+                queue.waitConsume([&isDone](std::uint64_t &item) { isDone = item == 0; });
+            }
+        });
+
+        std::uint64_t i = 0;
+        for (auto _: state) {
+            queue.pushBatch(batchSize, [&i](std::uint64_t &slot, std::size_t) { slot = ++i; });
+        }
+        queue.push(0);
+        consumer.join();
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * batchSize));
+    }
+
+}
+
+BENCHMARK_TEMPLATE(BM_HandOffLatency, SpscQueue<std::uint64_t, SpinWait>)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffLatency, SpscQueue<std::uint64_t, YieldWait>)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffLatency, SpscQueue<std::uint64_t, FutexWait>)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffLatency, MpmcQueue<std::uint64_t, SpinWait>)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffLatency, MpmcQueue<std::uint64_t, YieldWait>)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffLatency, MpmcQueue<std::uint64_t, FutexWait>)->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_HandOffThroughput, SpscQueue<std::uint64_t, SpinWait>)->Arg(1)->Arg(16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffThroughput, SpscQueue<std::uint64_t, FutexWait>)->Arg(1)->Arg(16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffThroughput, MpmcQueue<std::uint64_t, SpinWait>)->Arg(1)->Arg(16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOffThroughput, MpmcQueue<std::uint64_t, FutexWait>)->Arg(1)->Arg(16)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,268 @@
+#ifndef WILDCAT_WS_BROADCAST_RING_HPP
+#define WILDCAT_WS_BROADCAST_RING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "queue.hpp"
+#include "wait_strategy.hpp"
+
+
+namespace wildcat::ws {
+
+    /// What the producer of a broadcast ring does when a consumer is a whole ring behind
+    enum class SlowConsumerPolicy : std::uint8_t {
+        /// Waits for the consumer, so every consumer gets every item and the slowest one sets the pace
+        BLOCK = 0,
+        /// Overwrites the items the consumer has not read. The consumer skips ahead to the newest item on its next
+        /// read and the skipped items are counted by `dropped()`.
+        DROP = 1,
+        /// Detaches the consumer for good. It reads nothing further and `isDisconnected()` is true.
+        DISCONNECT = 2
+    };
+
+    /// Ring broadcasting items from one producer thread to many consumer threads (disruptor style)
+    ///
+    /// Every consumer sees every item. Items are written once into preallocated slots and each consumer reads them in
+    /// place through its own cursor, so the number of consumers adds no copies. The producer only looks at the cursors
+    /// of the consumers when its cached copy of the slowest cursor says the ring may be full.
+    ///
+    /// A consumer marks itself as reading for the duration of a batch. The producer never overwrites a slot a consumer
+    /// may be reading: under the DROP and DISCONNECT policies a consumer that is a whole ring behind is detached only
+    /// between batches, while it is reading the producer waits for the batch to finish.
+    ///
+    /// \tparam T item type, e.g. MessageSlot
+    /// \tparam WaitStrategy_T how the producer waits for consumers and consumers wait for items
+    template<typename T, typename WaitStrategy_T = SpinWait>
+    class BroadcastRing {
+    public:
+        class Consumer;
+
+        /// Constructs a broadcast ring
+        ///
+        /// \param capacity number of slots, rounded up to a power of two
+        /// \param maxConsumers maximum number of consumers attached at the same time
+        /// \param policy how slow consumers are handled
+        BroadcastRing(std::size_t capacity, std::size_t maxConsumers,
+                      SlowConsumerPolicy policy = SlowConsumerPolicy::BLOCK)
+                : published_(0), notEmpty_(), notFull_(), policy_(policy), next_(0), cachedGate_(0),
+                  mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1), slots_(mask_ + 1),
+                  maxConsumers_(maxConsumers), cursors_(std::make_unique<Cursor[]>(maxConsumers)) {}
+
+        BroadcastRing(const BroadcastRing &) = delete;
+
+        BroadcastRing &operator=(const BroadcastRing &) = delete;
+
+        /// Gets the number of slots of the ring
+        [[nodiscard]] std::size_t capacity() const noexcept {
+            return mask_ + 1;
+        }
+
+        /// Gets the slow consumer policy
+        [[nodiscard]] SlowConsumerPolicy policy() const noexcept {
+            return policy_;
+        }
+
+        /// Attaches a consumer, which reads the items published from now on. Thread safe. Throws std::length_error if
+        /// the maximum number of consumers is attached.
+        Consumer subscribe() {
+            for (std::size_t i = 0; i < maxConsumers_; ++i) {
+                auto &cursor = cursors_[i];
+                auto state = FREE;
+                if (cursor.state.compare_exchange_strong(state, ATTACHING)) {
+                    // pairs with the fence of gate(): either the producer waits for this cursor, or the sequence
+                    // read here is at least the one the producer gated against
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    cursor.sequence.store(published_.load(std::memory_order_acquire), std::memory_order_relaxed);
+                    cursor.dropped = 0;
+                    cursor.state.store(IDLE, std::memory_order_release);
+                    notFull_.notifyAll();
+                    return Consumer(this, &cursor);
+                }
+            }
+            throw std::length_error("Maximum number of consumers reached");
+        }
+
+        /// Publishes an item. Producer only.
+        void push(const T &item) {
+            pushBatch(1, [&item](T &slot, std::size_t) { slot = item; });
+        }
+
+        /// Fills `n` slots in place with `fill(slot, i)` and publishes them, up to a ring at a time. Slow consumers are
+        /// handled by the policy of the ring. Producer only.
+        template<typename F>
+        void pushBatch(std::size_t n, F &&fill) {
+            for (std::size_t pushed = 0; pushed < n;) {
+                const auto k = std::min(n - pushed, capacity());
+                // the slot of sequence s was last used by sequence s - capacity, which all consumers must have read
+                const auto required = next_ + k > capacity() ? next_ + k - capacity() : 0;
+                if (required > cachedGate_)
+                    cachedGate_ = gate(required);
+
+                for (std::size_t i = 0; i < k; ++i)
+                    fill(slots_[(next_ + i) & mask_], pushed + i);
+                next_ += k;
+                pushed += k;
+                published_.store(next_, std::memory_order_release);
+                notEmpty_.notifyAll();
+            }
+        }
+
+        /// A consumer of the ring, which reads the items through its own cursor
+        ///
+        /// A consumer is used by one thread at a time. It is detached from the ring when destroyed.
+        class Consumer {
+        public:
+            Consumer(Consumer &&other) noexcept: ring_(other.ring_), cursor_(other.cursor_) {
+                other.cursor_ = nullptr;
+            }
+
+            Consumer &operator=(Consumer &&other) noexcept {
+                std::swap(ring_, other.ring_);
+                std::swap(cursor_, other.cursor_);
+                return *this;
+            }
+
+            ~Consumer() {
+                if (cursor_) {
+                    cursor_->state.store(FREE, std::memory_order_release);
+                    ring_->notFull_.notifyAll();
+                }
+            }
+
+            /// Calls `f(item)` on up to `maxItems` published items in place. Returns the number of items read.
+            template<typename F>
+            std::size_t consume(F &&f, std::size_t maxItems = SIZE_MAX) {
+                if (!beginRead())
+                    return 0;
+
+                auto sequence = cursor_->sequence.load(std::memory_order_relaxed);
+                const auto n = std::min(ring_->published_.load(std::memory_order_acquire) - sequence, maxItems);
+                for (std::size_t i = 0; i < n; ++i)
+                    f(static_cast<const T &>(ring_->slots_[(sequence + i) & ring_->mask_]));
+
+                cursor_->sequence.store(sequence + n, std::memory_order_release);
+                cursor_->state.store(IDLE, std::memory_order_release);
+                if (n > 0 || ring_->policy_ != SlowConsumerPolicy::BLOCK)
+                    ring_->notFull_.notifyAll();
+                return n;
+            }
+
+            /// Waits for at least one item, then reads up to `maxItems` items like `consume`. Also returns, possibly 0,
+            /// when the consumer is lapped or disconnected.
+            template<typename F>
+            std::size_t waitConsume(F &&f, std::size_t maxItems = SIZE_MAX) {
+                const auto dropped = cursor_->dropped;
+                std::size_t n = 0;
+                ring_->notEmpty_.waitUntil([&]() {
+                    n = consume(f, maxItems);
+                    return n > 0 || cursor_->dropped != dropped || isDisconnected();
+                });
+                return n;
+            }
+
+            /// Gets the number of items skipped because the consumer fell a whole ring behind
+            [[nodiscard]] std::size_t dropped() const noexcept {
+                return cursor_->dropped;
+            }
+
+            /// Gets true/false if the consumer was detached for falling behind
+            [[nodiscard]] bool isDisconnected() const noexcept {
+                return cursor_->state.load(std::memory_order_acquire) == DISCONNECTED;
+            }
+
+        private:
+            friend class BroadcastRing;
+
+            BroadcastRing *ring_;
+            typename BroadcastRing::Cursor *cursor_;
+
+            Consumer(BroadcastRing *ring, typename BroadcastRing::Cursor *cursor) noexcept
+                    : ring_(ring), cursor_(cursor) {}
+
+            /// Marks the consumer as reading, catching up first if it was lapped. Returns false if disconnected.
+            bool beginRead() {
+                for (;;) {
+                    auto state = IDLE;
+                    if (cursor_->state.compare_exchange_strong(state, READING, std::memory_order_acquire))
+                        return true;
+                    if (state != LAPPED)
+                        return false;
+
+                    // skip to the newest item, the producer no longer waits for the items in between
+                    const auto published = ring_->published_.load(std::memory_order_acquire);
+                    cursor_->dropped += published - cursor_->sequence.load(std::memory_order_relaxed);
+                    cursor_->sequence.store(published, std::memory_order_relaxed);
+                    cursor_->state.store(IDLE, std::memory_order_release);
+                }
+            }
+        };
+
+    private:
+        enum State : std::uint8_t {
+            FREE = 0,
+            ATTACHING,
+            IDLE,
+            READING,
+            LAPPED,
+            DISCONNECTED
+        };
+
+        struct alignas(CACHE_LINE_SIZE) Cursor {
+            // sequence of the next item to read
+            std::atomic<std::size_t> sequence{0};
+            std::atomic<State> state{FREE};
+            std::size_t dropped = 0;
+        };
+
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> published_;
+        alignas(CACHE_LINE_SIZE) WaitStrategy_T notEmpty_;
+        alignas(CACHE_LINE_SIZE) WaitStrategy_T notFull_;
+        // used by the producer only
+        alignas(CACHE_LINE_SIZE) const SlowConsumerPolicy policy_;
+        std::size_t next_;
+        std::size_t cachedGate_;
+        const std::size_t mask_;
+        std::vector<T> slots_;
+        const std::size_t maxConsumers_;
+        std::unique_ptr<Cursor[]> cursors_;
+
+        /// Waits until every attached consumer has read up to `required`, applying the slow consumer policy. Returns
+        /// the cursor of the slowest attached consumer.
+        std::size_t gate(std::size_t required) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto slowest = next_;
+            for (std::size_t i = 0; i < maxConsumers_; ++i) {
+                auto &cursor = cursors_[i];
+                notFull_.waitUntil([&]() {
+                    auto state = cursor.state.load(std::memory_order_acquire);
+                    // an attaching consumer has not stored its start sequence yet
+                    if (state == ATTACHING)
+                        return false;
+                    if (state != IDLE && state != READING)
+                        return true;
+                    if (cursor.sequence.load(std::memory_order_acquire) >= required)
+                        return true;
+                    // a consumer is only detached between batches, never while it reads the slots to be overwritten
+                    if (policy_ == SlowConsumerPolicy::BLOCK || state != IDLE)
+                        return false;
+                    return cursor.state.compare_exchange_strong(
+                            state, policy_ == SlowConsumerPolicy::DROP ? LAPPED : DISCONNECTED);
+                });
+
+                const auto state = cursor.state.load(std::memory_order_acquire);
+                if (state == IDLE || state == READING)
+                    slowest = std::min(slowest, cursor.sequence.load(std::memory_order_acquire));
+            }
+            return slowest;
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_BROADCAST_RING_HPP
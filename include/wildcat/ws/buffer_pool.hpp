@@ -0,0 +1,89 @@
+#ifndef WILDCAT_WS_BUFFER_POOL_HPP
+#define WILDCAT_WS_BUFFER_POOL_HPP
+
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+#include "mirrored_buffer.hpp"
+
+
+namespace wildcat::ws {
+
+    /// Pool of mirrored buffers shared by clients
+    ///
+    /// Buffers are handed out in power of two capacities, so a buffer released by one connection can be reused by any
+    /// other connection asking for the same size. Reusing a buffer saves setting up the mappings and faulting in the
+    /// pages again. Released buffers are kept until the idle bytes reach the limit of the pool, further buffers are
+    /// unmapped. The pool is thread safe, it is only used when a connection is set up, torn down or resizes a buffer.
+    class BufferPool {
+    public:
+        /// Constructs a buffer pool
+        ///
+        /// \param maxIdleBytes maximum number of bytes kept in released buffers
+        /// \param hugePages true to back the buffers with huge pages when available. The smallest buffer is then a
+        /// huge page.
+        explicit BufferPool(std::size_t maxIdleBytes = 256 * 1024 * 1024, bool hugePages = false)
+                : maxIdleBytes_(maxIdleBytes), hugePages_(hugePages), idleBytes_(0), mutex_(), idle_() {}
+
+        BufferPool(const BufferPool &) = delete;
+
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        /// Gets the capacity of the buffer handed out for a request of `capacity` bytes
+        [[nodiscard]] std::size_t capacityFor(std::size_t capacity) const noexcept {
+            const auto minCapacity = hugePages_ ? MirroredBuffer::HUGE_PAGE_SIZE
+                                                : static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            return std::bit_ceil(std::max(capacity, minCapacity));
+        }
+
+        /// Gets an empty buffer of at least `capacity` bytes, reusing a released buffer if there is one
+        MirroredBuffer acquire(std::size_t capacity) {
+            const auto classCapacity = capacityFor(capacity);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = idle_.find(classCapacity);
+                if (it != idle_.end() && !it->second.empty()) {
+                    auto buffer = std::move(it->second.back());
+                    it->second.pop_back();
+                    idleBytes_ -= classCapacity;
+                    return buffer;
+                }
+            }
+            return MirroredBuffer(classCapacity, hugePages_);
+        }
+
+        /// Returns a buffer to the pool. The buffer is unmapped if the pool already holds the maximum idle bytes.
+        void release(MirroredBuffer &&buffer) {
+            const auto capacity = buffer.capacity();
+            if (capacity == 0)
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (idleBytes_ + capacity > maxIdleBytes_)
+                return;
+            buffer.clear();
+            idle_[capacity].push_back(std::move(buffer));
+            idleBytes_ += capacity;
+        }
+
+        /// Gets the number of bytes held in released buffers
+        [[nodiscard]] std::size_t idleBytes() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return idleBytes_;
+        }
+
+    private:
+        std::size_t maxIdleBytes_;
+        bool hugePages_;
+        std::size_t idleBytes_;
+        mutable std::mutex mutex_;
+        std::map<std::size_t, std::vector<MirroredBuffer>> idle_;
+    };
+
+}
+
+#endif //WILDCAT_WS_BUFFER_POOL_HPP
@@ -4,12 +4,33 @@
 
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <chrono>
+#include <concepts>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 #include <byteswap.h>
-
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "buffer_pool.hpp"
+#include "deflate.hpp"
+#include "error.hpp"
+#include "function_ref.hpp"
 #include "handshake.hpp"
+#include "instrumentation.hpp"
+#include "mask.hpp"
+#include "mask_key.hpp"
+#include "mirrored_buffer.hpp"
+#include "timestamping.hpp"
 
 
 namespace wildcat::ws {
@@ -112,6 +133,78 @@ namespace wildcat::ws {
     };
 
 
+    /// Maximum length of the payload of a control frame
+    constexpr std::size_t MAX_CONTROL_PAYLOAD_LENGTH = 125;
+
+    /// Status codes of a close frame, see RFC 6455 section 7.4.1
+    enum class CloseCode : std::uint16_t {
+        NORMAL = 1000,
+        GOING_AWAY = 1001,
+        PROTOCOL_ERROR = 1002,
+        UNSUPPORTED_DATA = 1003,
+        /// Reported when a close frame has no status code, never sent
+        NO_STATUS = 1005,
+        /// Reported when the connection is dropped without a close frame, never sent
+        ABNORMAL = 1006,
+        INVALID_PAYLOAD = 1007,
+        POLICY_VIOLATION = 1008,
+        MESSAGE_TOO_BIG = 1009,
+        MANDATORY_EXTENSION = 1010,
+        INTERNAL_ERROR = 1011
+    };
+
+    /// Gets true/false if the status code may be sent in a close frame, see RFC 6455 section 7.4
+    ///
+    /// Codes reserved for reporting (1005, 1006 and 1015), the unassigned codes of the protocol range and codes out of
+    /// the registered and private ranges are not allowed on the wire.
+    inline bool isValidCloseCode(std::uint16_t code) noexcept {
+        return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+    }
+
+    /// Gets true/false if the bytes are valid UTF-8, without overlong encodings, surrogates or code points above
+    /// U+10FFFF
+    inline bool isValidUtf8(const std::uint8_t *data, std::size_t length) noexcept {
+        for (std::size_t i = 0; i < length;) {
+            const auto c = data[i];
+            if (c < 0x80) {
+                ++i;
+                continue;
+            }
+
+            std::size_t n;
+            std::uint8_t min = 0x80;
+            std::uint8_t max = 0xbf;
+            if (c >= 0xc2 && c <= 0xdf) {
+                n = 1;
+            } else if (c >= 0xe0 && c <= 0xef) {
+                n = 2;
+                // no overlong encodings and no surrogates
+                if (c == 0xe0)
+                    min = 0xa0;
+                else if (c == 0xed)
+                    max = 0x9f;
+            } else if (c >= 0xf0 && c <= 0xf4) {
+                n = 3;
+                // no overlong encodings and nothing above U+10FFFF
+                if (c == 0xf0)
+                    min = 0x90;
+                else if (c == 0xf4)
+                    max = 0x8f;
+            } else {
+                return false;
+            }
+
+            if (length - i <= n || data[i + 1] < min || data[i + 1] > max)
+                return false;
+            for (std::size_t k = 2; k <= n; ++k) {
+                if ((data[i + k] & 0xc0) != 0x80)
+                    return false;
+            }
+            i += n + 1;
+        }
+        return true;
+    }
+
     /// Header of the web socket frame
     struct FrameHeader {
         OpCode opCode;
@@ -119,9 +212,128 @@ namespace wildcat::ws {
         std::size_t messageLength;
         bool mask;
         std::array<std::uint8_t, 4> maskKeys{};
+        /// RSV1 bit, set on the first frame of a message compressed with permessage-deflate
+        bool rsv1 = false;
     };
 
 
+    /// Decodes a frame header from the beginning of the buffer
+    ///
+    /// Only bytes within [buffer, buffer + length) are read. Returns the length of the header, or 0 if the buffer does
+    /// not yet hold the complete header.
+    inline std::size_t decodeFrameHeader(const std::uint8_t *buffer, std::size_t length, FrameHeader &header) {
+        if (length < 2)
+            return 0;
+
+        header.isFinal = (buffer[0] & 0x80) == 0x80;
+        header.rsv1 = (buffer[0] & 0x40) == 0x40;
+        // RSV2 and RSV3 are not used by any extension this client negotiates
+        if (buffer[0] & 0x30)
+            throw ProtocolError("Reserved bits set in frame header");
+        header.opCode = opCodeFrom(buffer[0] & 0x0f);
+        header.mask = (buffer[1] & 0x80) == 0x80;
+        const std::uint8_t lengthByte = (buffer[1] & 0x7f);
+
+        std::size_t headerLength = 2;
+        if (lengthByte == 126) {
+            headerLength += 2;
+        } else if (lengthByte == 127) {
+            headerLength += 8;
+        }
+        if (header.mask)
+            headerLength += 4;
+
+        if (length < headerLength)
+            return 0;
+
+        const auto *next = buffer + 2;
+        if (lengthByte < 126) {
+            // The message length is the value of the length byte
+            header.messageLength = static_cast<std::size_t>(lengthByte);
+        } else if (lengthByte == 126) {
+            // Read the next 16 bits and interpret as an unsigned integer
+            wildcat_u16 tmp{};
+            std::memcpy(&tmp.b, next, sizeof(std::uint16_t));
+            header.messageLength = __builtin_bswap16(tmp.val);
+            next += 2;
+        } else {
+            // Read the next 64 bits and interpret as an unsigned integer
+            wildcat_u64 tmp{};
+            std::memcpy(&tmp.b, next, sizeof(std::uint64_t));
+            const auto val = __builtin_bswap64(tmp.val);
+            // the most significant bit of a 64-bit length must be 0
+            if (val >> 63)
+                throw ProtocolError("Invalid message length");
+            header.messageLength = static_cast<std::size_t>(val);
+            next += 8;
+        }
+
+        if (header.mask)
+            std::memcpy(header.maskKeys.data(), next, 4);
+
+        return headerLength;
+    }
+
+    /// Maximum length of a frame header: 2 bytes, 8 bytes of extended payload length and 4 bytes of masking key
+    constexpr std::size_t MAX_FRAME_HEADER_LENGTH = 14;
+
+    /// Gets the length of the encoded header
+    inline std::size_t frameHeaderLength(const FrameHeader &header) noexcept {
+        std::size_t headerLength = 2;
+        if (header.messageLength >= 65536) {
+            headerLength += 8;
+        } else if (header.messageLength >= 126) {
+            headerLength += 2;
+        }
+        return header.mask ? headerLength + 4 : headerLength;
+    }
+
+    /// Encodes a frame header to the buffer
+    ///
+    /// The buffer must have room for at least `frameHeaderLength(header)` bytes. Returns the length of the header.
+    inline std::size_t encodeFrameHeader(const FrameHeader &header, std::uint8_t *buffer) noexcept {
+        auto *next = buffer;
+        // get the op code as underlying type uint8_t
+        const auto opCode = static_cast<const uint8_t>(header.opCode);
+        // bitwise OR the final flag, op code, and reserved bits for the first element
+        // rsv2 and rsv3 are always false
+        auto first = opCode;
+        first |= (header.isFinal ? 0x80 : 0);
+        first |= (header.rsv1 ? 0x40 : 0);
+        std::memcpy(next, &first, 1);
+        ++next;
+
+        if (header.messageLength < 126) {
+            std::uint8_t second = (header.messageLength & 0xff) | (header.mask ? 0x80 : 0);
+            std::memcpy(next, &second, 1);
+            ++next;
+        } else if (header.messageLength < 65536) {
+            std::uint8_t second = 126 | (header.mask ? 0x80 : 0);
+            std::memcpy(next, &second, 1);
+            ++next;
+            const auto val = static_cast<std::uint16_t>(header.messageLength);
+            wildcat_u16 tmp{};
+            tmp.val = __builtin_bswap16(val);
+            std::memcpy(next, &tmp.b, sizeof(std::uint16_t));
+            next += 2;
+        } else {
+            std::uint8_t second = 127 | (header.mask ? 0x80 : 0);
+            std::memcpy(next, &second, 1);
+            ++next;
+            const auto val = static_cast<std::uint64_t>(header.messageLength);
+            wildcat_u64 tmp{};
+            tmp.val = __builtin_bswap64(val);
+            std::memcpy(next, &tmp.b, sizeof(std::uint64_t));
+            next += 8;
+        }
+
+        if (header.mask) {
+            std::memcpy(next, header.maskKeys.data(), 4);
+            next += 4;
+        }
+        return next - buffer;
+    }
+
     /// Web socket frame writer
     class FrameWriter {
     public:
@@ -135,44 +347,11 @@ namespace wildcat::ws {
         /// \param header frame header for the message
         /// \param message pointer to the beginning of the message data
         void write(const FrameHeader &header, const std::uint8_t *message) {
-            // get the op code as underlying type uint8_t
-            const auto opCode = static_cast<const uint8_t>(header.opCode);
-            // bitwise OR the final flag, op code, and reserved bits for the first element
-            // assume rsv1, rsv2, and rsv3 are false
-            // TODO: support rsv1, rsv2, rsv3 in frame header
-            auto first = opCode;
-            first |= (header.isFinal ? 0x80 : 0);
-            std::memcpy(next_, &first, 1);
-            ++next_;
-
-            if (header.messageLength < 126) {
-                auto second = (header.messageLength & 0xff) | (header.mask ? 0x80 : 0);
-                std::memcpy(next_, &second, 1);
-                ++next_;
-            } else if (header.messageLength < 65536) {
-                auto second = 126 | (header.mask ? 0x80 : 0);
-                std::memcpy(next_, &second, 1);
-                ++next_;
-                const auto val = static_cast<std::uint16_t>(header.messageLength);
-                wildcat_u16 tmp{};
-                tmp.val = __builtin_bswap16(val);
-                std::memcpy(next_, &tmp.b, sizeof(std::uint16_t));
-                next_ += 2;
-            } else {
-                auto second = 127 | (header.mask ? 0x80 : 0);
-                std::memcpy(next_, &second, 1);
-                ++next_;
-                const auto val = static_cast<std::uint64_t>(header.messageLength);
-                wildcat_u64 tmp{};
-                tmp.val = __builtin_bswap64(val);
-                std::memcpy(next_, &tmp.b, sizeof(std::uint64_t));
-                next_ += 8;
-            }
-
-            if (header.mask) {
-                std::memcpy(next_, header.maskKeys.data(), 4);
-                next_ += 4;
+            // Check for enough space in the buffer to write the header
+            if (frameHeaderLength(header) > bufferSizeRemaining()) {
+                throw std::runtime_error("Buffer too short for frame header");
             }
+            next_ += encodeFrameHeader(header, next_);
 
             // Check for enough space in the buffer to write the message payload
             if (header.messageLength > bufferEnd_ - next_) {
@@ -182,14 +361,11 @@ namespace wildcat::ws {
             messageBegin_ = next_;
             messageEnd_ = messageBegin_ + header.messageLength;
 
-            std::memcpy(next_, message, header.messageLength);
             if (header.mask) {
-                int i = 0;
-                for (auto *b = messageBegin_; b != messageEnd_; ++b) {
-                    // i & 0x3 result will always be in the range of [0, 3]
-                    *b ^= header.maskKeys[i & 0x3];
-                    ++i;
-                }
+                // mask while copying so the payload is only touched once
+                ws::mask(message, next_, header.messageLength, header.maskKeys);
+            } else {
+                std::memcpy(next_, message, header.messageLength);
             }
             next_ += header.messageLength;
         }
@@ -239,7 +415,7 @@ namespace wildcat::ws {
         /// Constructs a FrameReader from the specified buffer and length
         FrameReader(std::uint8_t *buffer, std::size_t length)
                 : buffer_(buffer), bufferEnd_(buffer + length), next_(buffer),
-                  messageBegin_(nullptr), messageEnd_(nullptr), isComplete_(false), final_(false),
+                  messageBegin_(nullptr), messageEnd_(nullptr), isComplete_(false), final_(false), rsv1_(false),
                   opCode_(OpCode::NULL_VALUE), isMasked_(false), messageLength_(0),
                   maskKeys_() {
             init();
@@ -255,6 +431,11 @@ namespace wildcat::ws {
             return opCode_;
         }
 
+        /// Gets true/false if the RSV1 bit is set, i.e. the message is compressed with permessage-deflate
+        [[nodiscard]] bool isCompressed() const noexcept {
+            return rsv1_;
+        }
+
         /// Gets true/false if the message is masked
         [[nodiscard]] bool isMasked() const noexcept {
             return isMasked_;
@@ -298,45 +479,30 @@ namespace wildcat::ws {
         std::uint8_t *messageEnd_;
         bool isComplete_;
         bool final_;
+        bool rsv1_;
         OpCode opCode_;
         bool isMasked_;
         std::size_t messageLength_;
         std::array<std::uint8_t, 4> maskKeys_;
 
         void init() {
-            final_ = (*next_ & 0x80) == 0x80;
-            opCode_ = opCodeFrom(*next_ & 0x0f);
-            ++next_;
-            isMasked_ = (*next_ & 0x80) == 0x80;
-            std::uint8_t lengthByte = (*next_ & 0x7f);
-            ++next_;
-            if (lengthByte < 126) {
-                // The message length is the value of the length byte
-                messageLength_ = static_cast<std::size_t>(lengthByte);
-            } else if (lengthByte == 126) {
-                // Read the next 16 bits and interpret as an unsigned integer
-                wildcat_u16 tmp{};
-                std::memcpy(&tmp.b, next_, sizeof(std::uint16_t));
-                messageLength_ = __builtin_bswap16(tmp.val);
-                next_ += 2;
-            } else if (lengthByte == 127) {
-                // Read the next 64 bits and interpret as an unsigned integer
-                wildcat_u64 tmp{};
-                std::memcpy(&tmp.b, next_, sizeof(std::uint64_t));
-                messageLength_ = __builtin_bswap64(tmp.val);
-                next_ += 8;
-            } else {
-                // unknown length byte
-                throw std::runtime_error("Invalid message length");
+            FrameHeader header{};
+            const auto headerLength = decodeFrameHeader(buffer_, bufferEnd_ - buffer_, header);
+            if (headerLength == 0) {
+                // not enough bytes for the header
+                return;
             }
 
-            if (isMasked_) {
-                std::memcpy(maskKeys_.data(), next_, 4);
-                next_ += 4;
-            }
+            final_ = header.isFinal;
+            rsv1_ = header.rsv1;
+            opCode_ = header.opCode;
+            isMasked_ = header.mask;
+            messageLength_ = header.messageLength;
+            maskKeys_ = header.maskKeys;
+            next_ += headerLength;
             messageBegin_ = next_;
 
-            const auto bufferRemainingSize = bufferEnd_ - messageBegin_;
+            const auto bufferRemainingSize = static_cast<std::size_t>(bufferEnd_ - messageBegin_);
             isComplete_ = messageLength_ <= bufferRemainingSize;
             if (!isComplete_)
                 return;
@@ -345,18 +511,229 @@ namespace wildcat::ws {
 
             if (isMasked_) {
                 // unmask
-                int i = 0;
-                for (auto *b = messageBegin_; b != messageEnd_; ++b) {
-                    *b ^= maskKeys_[i & 0x3];
-                    ++i;
-                }
+                ws::mask(messageBegin_, messageLength_, maskKeys_);
             }
             next_ += messageLength_;
         }
     };
 
-    // Message handler
-    typedef std::function<void(OpCode opCode, const std::uint8_t *buffer, std::size_t length)> message_handler_t;
+    /// A masked frame encoded once and sent many times with a few bytes of the payload patched in place
+    ///
+    /// Intended for messages of a fixed layout where only some fields change, e.g. the price and quantity of an order.
+    /// The header is encoded and the payload template is masked when the frame is prepared. A patch masks only the
+    /// bytes it replaces, with the phase of the mask keys at their offset, so the frame is always ready to be sent as
+    /// it is. The frame is sent with `Client::sendPrepared`, it is not compressed.
+    class PreparedFrame {
+    public:
+        /// Prepares a final frame
+        ///
+        /// \param payload payload template, the fields to be patched are placeholders of the length of their values
+        /// \param maskKeys mask keys of the frame, e.g. from `Client::nextMaskKeys`
+        PreparedFrame(OpCode opCode, std::span<const std::byte> payload, const std::array<std::uint8_t, 4> &maskKeys)
+                : frame_(), headerLength_(0), maskKeys_(maskKeys) {
+            FrameHeader header{};
+            header.opCode = opCode;
+            header.isFinal = true;
+            header.messageLength = payload.size();
+            header.mask = true;
+            header.maskKeys = maskKeys;
+            frame_.resize(frameHeaderLength(header) + payload.size());
+            FrameWriter writer(frame_.data(), frame_.size());
+            writer.write(header, reinterpret_cast<const std::uint8_t *>(payload.data()));
+            headerLength_ = writer.headerLength();
+        }
+
+        /// Prepares a final text frame
+        PreparedFrame(std::string_view payload, const std::array<std::uint8_t, 4> &maskKeys)
+                : PreparedFrame(OpCode::TEXT, std::as_bytes(std::span(payload.data(), payload.size())), maskKeys) {}
+
+        /// Replaces the bytes of the payload at `offset`. Throws std::out_of_range if they do not fit in the payload.
+        void patch(std::size_t offset, std::span<const std::byte> bytes) {
+            if (offset > payloadLength() || bytes.size() > payloadLength() - offset)
+                throw std::out_of_range("Patch exceeds the payload of the prepared frame");
+            ws::mask(reinterpret_cast<const std::uint8_t *>(bytes.data()), frame_.data() + headerLength_ + offset,
+                     bytes.size(), maskKeys_, offset);
+        }
+
+        /// Replaces the characters of the payload at `offset`. Throws std::out_of_range if they do not fit in the
+        /// payload.
+        void patch(std::size_t offset, std::string_view chars) {
+            patch(offset, std::as_bytes(std::span(chars.data(), chars.size())));
+        }
+
+        /// Masks the frame with new keys
+        ///
+        /// The payload is masked again in place with the difference of the old and new keys, a single pass over the
+        /// payload without encoding or copying it.
+        void setMaskKeys(const std::array<std::uint8_t, 4> &maskKeys) noexcept {
+            std::array<std::uint8_t, 4> delta;
+            for (std::size_t i = 0; i < delta.size(); ++i)
+                delta[i] = maskKeys_[i] ^ maskKeys[i];
+            ws::mask(frame_.data() + headerLength_, payloadLength(), delta);
+            std::memcpy(frame_.data() + headerLength_ - maskKeys.size(), maskKeys.data(), maskKeys.size());
+            maskKeys_ = maskKeys;
+        }
+
+        /// Gets the opcode of the frame
+        [[nodiscard]] OpCode opCode() const {
+            return opCodeFrom(frame_[0] & 0x0f);
+        }
+
+        /// Gets the mask keys of the frame
+        [[nodiscard]] const std::array<std::uint8_t, 4> &maskKeys() const noexcept {
+            return maskKeys_;
+        }
+
+        /// Gets the encoded frame
+        [[nodiscard]] const std::uint8_t *data() const noexcept {
+            return frame_.data();
+        }
+
+        /// Gets the length of the encoded frame
+        [[nodiscard]] std::size_t size() const noexcept {
+            return frame_.size();
+        }
+
+        /// Gets the length of the payload
+        [[nodiscard]] std::size_t payloadLength() const noexcept {
+            return frame_.size() - headerLength_;
+        }
+
+    private:
+        std::vector<std::uint8_t> frame_;
+        std::size_t headerLength_;
+        std::array<std::uint8_t, 4> maskKeys_;
+    };
+
+    /// Incremental web socket frame parser
+    ///
+    /// Unlike the FrameReader, the parser keeps its progress on the frame at the beginning of the buffer between calls.
+    /// The header of a frame is decoded once and the payload is unmasked as it is received, so each call only costs the
+    /// number of new bytes in the buffer.
+    ///
+    /// Data frames with a payload larger than the stream threshold are streamed: their header is consumed as soon as
+    /// it is decoded and their payload is passed on and consumed in chunks as it is received, so they never have to
+    /// fit in the buffer.
+    class FrameParser {
+    public:
+        /// Constructs a parser
+        ///
+        /// \param streamThreshold payload length above which data frames are streamed, 0 to never stream
+        explicit FrameParser(std::size_t streamThreshold = 0)
+                : header_(), headerLength_(0), unmasked_(0), hasHeader_(false), isStreaming_(false),
+                  streamThreshold_(streamThreshold) {}
+
+        /// Parses complete frames from the buffer and calls `f` for each of them
+        ///
+        /// The buffer must begin with the first byte not yet consumed, i.e. on each call the buffer begins where the
+        /// previous call left off and holds the bytes the previous call did not consume followed by any new bytes.
+        ///
+        /// Returns the total number of bytes of the complete frames in the buffer, which may be consumed by the caller.
+        template<typename F>
+        std::size_t parse(std::uint8_t *buffer, std::size_t length, F &&f) {
+            return parse(buffer, length, f, [](const FrameHeader &, std::uint8_t *, std::size_t, std::uint64_t) {});
+        }
+
+        /// Parses complete frames from the buffer and calls `f` for each of them, and `chunk` for each piece of the
+        /// payload of a streamed frame
+        ///
+        /// `chunk` is called as `chunk(header, payload, length, offset)` where offset is the offset of the piece in
+        /// the payload of the frame. The last piece ends at `header.messageLength`. Returns the number of bytes that
+        /// may be consumed by the caller, i.e. of the complete frames and of the streamed header and pieces.
+        template<typename F, typename C>
+        std::size_t parse(std::uint8_t *buffer, std::size_t length, F &&f, C &&chunk) {
+            std::size_t cursor = 0;
+            while (cursor < length) {
+                auto *frame = buffer + cursor;
+                const auto frameBytes = length - cursor;
+                if (!hasHeader_) {
+                    headerLength_ = decodeFrameHeader(frame, frameBytes, header_);
+                    if (headerLength_ == 0)
+                        break;
+                    hasHeader_ = true;
+                    unmasked_ = 0;
+                    isStreaming_ = streamThreshold_ > 0 && header_.messageLength > streamThreshold_ &&
+                                   (static_cast<std::uint8_t>(header_.opCode) & 0x8) == 0;
+                    if (isStreaming_) {
+                        cursor += headerLength_;
+                        continue;
+                    }
+                }
+
+                if (isStreaming_) {
+                    // the buffer begins with the rest of the payload, pass on what has been received so far
+                    const auto n = std::min<std::uint64_t>(frameBytes, header_.messageLength - unmasked_);
+                    if (header_.mask)
+                        ws::mask(frame, n, header_.maskKeys, unmasked_);
+                    const auto offset = unmasked_;
+                    unmasked_ += n;
+                    if (unmasked_ == header_.messageLength)
+                        hasHeader_ = isStreaming_ = false;
+                    chunk(header_, frame, n, offset);
+                    cursor += n;
+                    continue;
+                }
+
+                auto *payload = frame + headerLength_;
+                const auto payloadBytes = std::min(frameBytes - headerLength_, header_.messageLength);
+                if (header_.mask && payloadBytes > unmasked_) {
+                    // unmask only the bytes received since the last call
+                    ws::mask(payload + unmasked_, payloadBytes - unmasked_, header_.maskKeys, unmasked_);
+                    unmasked_ = payloadBytes;
+                }
+
+                if (payloadBytes < header_.messageLength)
+                    break;
+
+                // A complete message has been read so call the callback function
+                f(header_.opCode, payload, header_.messageLength);
+                cursor += headerLength_ + header_.messageLength;
+                hasHeader_ = false;
+            }
+            return cursor;
+        }
+
+        /// Sets the payload length above which data frames are streamed, 0 to never stream. Applies from the next
+        /// frame.
+        void setStreamThreshold(std::size_t streamThreshold) noexcept {
+            streamThreshold_ = streamThreshold;
+        }
+
+        /// Gets true/false if the frame at the beginning of the buffer is streamed, i.e. the buffer begins with the
+        /// rest of its payload
+        [[nodiscard]] bool isStreaming() const noexcept {
+            return isStreaming_;
+        }
+
+        /// Gets true/false if the header of the frame at the beginning of the buffer has been decoded
+        [[nodiscard]] bool hasHeader() const noexcept {
+            return hasHeader_;
+        }
+
+        /// Gets the header of the frame at the beginning of the buffer. Only valid if `hasHeader()` is true.
+        [[nodiscard]] const FrameHeader &header() const noexcept {
+            return header_;
+        }
+
+        /// Discards the progress on the current frame
+        void reset() noexcept {
+            hasHeader_ = false;
+            isStreaming_ = false;
+            headerLength_ = 0;
+            unmasked_ = 0;
+        }
+
+    private:
+        FrameHeader header_;
+        std::size_t headerLength_;
+        std::size_t unmasked_;
+        bool hasHeader_;
+        bool isStreaming_;
+        std::size_t streamThreshold_;
+    };
+
+    // Message handler, a non-owning reference that can be passed to `poll` without a template
+    typedef FunctionRef<void(OpCode opCode, const std::uint8_t *buffer, std::size_t length)> message_handler_t;
 
     namespace {
 
@@ -388,22 +765,141 @@ namespace wildcat::ws {
 
     }
 
+    /// How `Client::poll` checks the connection for received bytes
+    enum class ReceiveMode : std::uint8_t {
+        /// Waits for readiness with poll(2) and reads once when the socket is readable
+        POLL = 0,
+        /// Reads straight away and keeps reading until the stream has no more data or the receive budget runs out.
+        /// The stream must be non-blocking.
+        RECV_FIRST = 1
+    };
+
     /// Web socket client config
     struct Config {
         std::string host;
         std::string path;
+        /// Capacity in bytes of the outbound buffer for non-blocking sends. When 0, sends block until all bytes are
+        /// written to the stream. Otherwise bytes the stream does not accept right away are queued and written by
+        /// `poll` when the socket is writable. The stream must be non-blocking in this mode. A few control frames worth
+        /// of the queue are kept for control frames, so the client can always answer the server. The queue only grows
+        /// beyond its capacity to hold the rest of a larger frame once part of it is written.
+        std::size_t sendQueueCapacity = 0;
+        /// The high watermark handler is called when the queued bytes reach this size
+        std::size_t sendQueueHighWatermark = 0;
+        /// The low watermark handler is called when the queued bytes drop to this size after reaching the high
+        /// watermark
+        std::size_t sendQueueLowWatermark = 0;
+        /// Initial capacity in bytes of the receive buffer. The buffer grows when a frame larger than its capacity is
+        /// received, and can be shrunk back with `shrinkReceiveBuffer` when the connection is idle.
+        std::size_t receiveBufferSize = 64 * 1024;
+        /// Maximum capacity in bytes of the receive buffer, which bounds the size of a received frame
+        std::size_t maxReceiveBufferSize = 32 * 1024 * 1024;
+        /// Maximum size in bytes of a received message, including all fragments of a fragmented message. 0 for no
+        /// limit.
+        std::size_t maxMessageSize = 32 * 1024 * 1024;
+        /// Pool the receive buffer and the send queue are taken from, typically shared by many clients. When null the
+        /// client maps its own buffers.
+        std::shared_ptr<BufferPool> bufferPool;
+        /// How `poll` checks the connection for received bytes
+        ReceiveMode receiveMode = ReceiveMode::POLL;
+        /// Maximum number of bytes read by a single call to `poll` in recv-first mode, 0 for no limit
+        std::size_t receiveByteBudget = 0;
+        /// Number of frames after which a single call to `poll` stops reading in recv-first mode, 0 for no limit. The
+        /// budget is checked between reads, so the frames completed by the last read are all dispatched.
+        std::size_t receiveFrameBudget = 0;
+        /// Maximum number of frames handed to the handler of `pollBatch` at a time. The batch array is allocated
+        /// once with this capacity.
+        std::size_t batchCapacity = 256;
+        /// true to answer pings and run the close handshake in the client, control frames are then not dispatched to
+        /// the handler. false to dispatch all control frames to the handler.
+        bool handleControlFrames = true;
+        /// Interval between the pings sent by the client to measure the round trip time and keep the connection
+        /// alive, 0 to not send pings
+        std::chrono::milliseconds heartbeatInterval{0};
+        /// Time without receiving any bytes after which the connection is considered dead, 0 for no timeout
+        std::chrono::milliseconds receiveTimeout{0};
+        /// Time to wait for the server to answer a close frame sent by the client
+        std::chrono::milliseconds closeTimeout{1000};
+        /// permessage-deflate compression, offered in the handshake when enabled
+        DeflateConfig deflate;
+        /// true to enable SO_TIMESTAMPING on the socket and read it with recvmsg(2), so the kernel receive timestamp
+        /// of each read is available to the handler with `receiveTimestamp()`. The client then reads the socket of the
+        /// stream directly, which needs a plain TCP stream, e.g. not TLS.
+        bool receiveTimestamps = false;
+        /// true to mask each frame sent with a new key as RFC 6455 requires, false to mask all frames with one key of
+        /// the connection, which saves the few nanoseconds per frame of generating a key
+        bool perFrameMaskKeys = true;
     };
 
-    /// Web Socket Client
+    // Send queue watermark handler, called with the number of queued bytes
+    typedef std::function<void(std::size_t queuedBytes)> watermark_handler_t;
+
+    /// Result of flushing a batch of frames
+    struct BatchResult {
+        /// number of bytes sent
+        std::size_t bytesSent;
+        /// number of complete frames sent
+        std::size_t framesSent;
+    };
+
+    /// A piece of the payload of a streamed message
+    struct PayloadChunk {
+        /// opcode of the message
+        OpCode opCode;
+        /// the piece of the payload, unmasked
+        const std::uint8_t *data;
+        /// length of the piece
+        std::size_t length;
+        /// offset of the piece in the payload of the message
+        std::uint64_t offset;
+        /// length of the payload of the message as far as it is known. For a fragmented message it is the length up
+        /// to the end of the current fragment. For a compressed message it is the length decompressed so far.
+        std::uint64_t messageLength;
+        /// true/false if this is the last piece of the message
+        bool isFinal;
+    };
+
+    /// State of a web socket connection
+    enum class ConnectionState : std::uint8_t {
+        OPEN = 0,
+        /// The client sent a close frame and waits for the server to answer
+        CLOSING = 1,
+        /// The close handshake completed or the connection is considered dead
+        CLOSED = 2
+    };
+
+    // Close handler, called with the status code and reason once the connection is closed
+    typedef std::function<void(CloseCode code, std::string_view reason)> close_handler_t;
+
+    // Stream handler, called with each piece of the payload of a streamed message
+    typedef std::function<void(const PayloadChunk &chunk)> stream_handler_t;
+
+    /// A received message in a batch
+    struct FrameDescriptor {
+        /// opcode of the message
+        OpCode opCode;
+        /// the payload, unmasked
+        const std::uint8_t *data;
+        /// length of the payload
+        std::size_t length;
+    };
+
+    /// Socket stream that can send a gather array of buffers in a single call, e.g. with writev(2) or sendmsg(2)
     template<class SocketStream_T>
+    concept VectoredSocketStream = requires(SocketStream_T &stream, const struct iovec *iov, int iovcnt) {
+        { stream.sendBytes(iov, iovcnt) } -> std::convertible_to<ssize_t>;
+    };
+
+    /// Web Socket Client
+    ///
+    /// \tparam SocketStream_T TCP socket stream
+    /// \tparam Instrumentation_T policy called at each point of the receive path, e.g. LatencyRecorder to time the
+    /// stages. The default NoInstrumentation compiles away.
+    template<class SocketStream_T, class Instrumentation_T = NoInstrumentation>
     class Client {
     public:
         /// Constructs a web socket Client from the specified socket stream
-        explicit Client(std::unique_ptr<SocketStream_T> stream)
-                : stream_(std::move(stream)), hostName_(), path_(), offset_(0), rxBuf_(), txBuf_(), maskKeys_(4) {
-            KeyGenerator generator;
-            generator.fill(maskKeys_);
-        }
+        explicit Client(std::unique_ptr<SocketStream_T> stream) : Client(std::move(stream), Config{}) {}
 
         /// Constructs a web socket Client from the specified stream and config
         ///
@@ -411,99 +907,1220 @@ namespace wildcat::ws {
         /// \param config configuration used for the handshake when sending the upgrade request. The configuration is
         /// useful when connecting through a proxy, e.g. stunnel.
         Client(std::unique_ptr<SocketStream_T> stream, const Config &config)
-                : stream_(std::move(stream)), hostName_(config.host), path_(config.path), offset_(0), rxBuf_(),
-                  txBuf_(), maskKeys_(4) {
-            KeyGenerator generator;
-            generator.fill(maskKeys_);
+                : stream_(std::move(stream)), hostName_(config.host), path_(config.path),
+                  bufferPool_(config.bufferPool), rxBuf_(acquireBuffer(config.receiveBufferSize)),
+                  minRxCapacity_(rxBuf_.capacity()),
+                  maxRxCapacity_(std::max(config.maxReceiveBufferSize, config.receiveBufferSize)), parser_(),
+                  parsed_(0), isAssembling_(false), messageOpCode_(OpCode::NULL_VALUE), messageLength_(0),
+                  maxMessageSize_(config.maxMessageSize), messageBuf_(), isStreamingMessage_(false), streamHandler_(),
+                  txScratch_(), txArena_(), txArenaLength_(0), batchFrameEnds_(), isCorked_(false),
+                  isSendingFragments_(false),
+                  sendQueue_(config.sendQueueCapacity > 0
+                             ? std::make_unique<MirroredBuffer>(acquireBuffer(config.sendQueueCapacity)) : nullptr),
+                  minTxCapacity_(sendQueue_ ? sendQueue_->capacity() : 0),
+                  highWatermark_(config.sendQueueHighWatermark > 0 ? config.sendQueueHighWatermark
+                                                                   : config.sendQueueCapacity),
+                  lowWatermark_(config.sendQueueLowWatermark), isAboveHighWatermark_(false), droppedReplies_(0),
+                  highWatermarkHandler_(),
+                  lowWatermarkHandler_(), receiveMode_(config.receiveMode),
+                  receiveByteBudget_(config.receiveByteBudget), receiveFrameBudget_(config.receiveFrameBudget),
+                  handleControlFrames_(config.handleControlFrames), heartbeatInterval_(config.heartbeatInterval),
+                  receiveTimeout_(config.receiveTimeout), closeTimeout_(config.closeTimeout),
+                  hasTimers_(config.heartbeatInterval.count() > 0 || config.receiveTimeout.count() > 0),
+                  state_(ConnectionState::OPEN), lastReceive_(clock_t::now()), lastPing_(lastReceive_),
+                  closeDeadline_(), pingTimestamp_(0), lastRtt_(0), closeHandler_(), controlFrame_(),
+                  deflateConfig_(config.deflate), deflate_(), isCompressedMessage_(false), batch_(),
+                  batchFlush_(nullptr), receiveTimestamps_(config.receiveTimestamps),
+                  receiveTimestamp_(), maskKeyGenerator_(), perFrameMaskKeys_(config.perFrameMaskKeys),
+                  maskKeys_(maskKeyGenerator_.next()), instrumentation_() {
+            batch_.reserve(std::max<std::size_t>(config.batchCapacity, 1));
+            if (receiveTimestamps_ && stream_->fd() >= 0)
+                enableReceiveTimestamps(stream_->fd());
+        }
+
+        Client(Client &&) noexcept = default;
+
+        ~Client() {
+            releaseBuffer(std::move(rxBuf_));
+            if (messageBuf_)
+                releaseBuffer(std::move(*messageBuf_));
+            if (sendQueue_)
+                releaseBuffer(std::move(*sendQueue_));
         }
 
         /// Connects to the endpoint and initiates the web socket handshake
         bool connect(const std::string &host, std::uint16_t port) {
             try {
                 stream_->connect(host, port);
+                if (receiveTimestamps_)
+                    enableReceiveTimestamps(stream_->fd());
                 const auto hostName = hostName_.empty() ? host : hostName_;
                 const auto path = path_.empty() ? "" : path_;
-                Handshaker<SocketStream_T>::doHandshake(hostName, path, stream_.get());
+                if (deflateConfig_.enabled) {
+                    std::string acceptedExtensions;
+                    Handshaker<SocketStream_T>::doHandshake(hostName, path, stream_.get(),
+                                                            getDeflateOffer(deflateConfig_.parameters),
+                                                            acceptedExtensions);
+                    DeflateParameters negotiated;
+                    if (parseDeflateResponse(acceptedExtensions, deflateConfig_.parameters, negotiated))
+                        enableDeflate(negotiated);
+                } else {
+                    Handshaker<SocketStream_T>::doHandshake(hostName, path, stream_.get());
+                }
             } catch (const std::exception &e) {
                 throw;
             }
             return true;
         }
 
+        /// Enables permessage-deflate with the parameters negotiated in the handshake
+        ///
+        /// Called by `connect` when the server accepts the extension. Only needed when the handshake is done
+        /// elsewhere. Messages received with the RSV1 bit set are decompressed before they are dispatched, and text and
+        /// binary messages sent with `send` and `append` of at least `DeflateConfig::compressThreshold` bytes are
+        /// compressed. Frames sent with `sendFrame`, `appendFrame` and `sendPrepared` and fragmented messages are sent
+        /// as they are.
+        void enableDeflate(const DeflateParameters &params) {
+            deflate_ = std::make_unique<PerMessageDeflate>(params, deflateConfig_);
+        }
+
+        /// Gets true/false if permessage-deflate is enabled on the connection
+        [[nodiscard]] bool isDeflateEnabled() const noexcept {
+            return static_cast<bool>(deflate_);
+        }
+
         /// Polls the connection
+        ///
+        /// In recv-first mode the stream is read without checking for readiness first, which saves a system call per
+        /// read, and a whole burst of frames is handled by a single call. Returns 1 if bytes were received, else 0.
         template<typename F>
         int poll(F &&f) {
+            if (hasTimers_ || state_ == ConnectionState::CLOSING)
+                tick();
+            if (state_ == ConnectionState::CLOSED)
+                return 0;
+
+            instrumentation_.mark(TracePoint::POLL);
+            if (receiveMode_ == ReceiveMode::RECV_FIRST) {
+                drainSendQueue();
+                return drain(f, receiveByteBudget_, receiveFrameBudget_) > 0 ? 1 : 0;
+            }
+
             struct pollfd pfd{};
             pfd.fd = stream_->fd();
             pfd.events = POLLIN;
+            if (hasQueuedBytes())
+                pfd.events |= POLLOUT;
 
             if (::poll(&pfd, 1, 0) < 1)
                 return 0;
 
-            const auto bytesRead = stream_->recvBytes(reinterpret_cast<char *>(rxBuf_.data()) + offset_,
-                                                      rxBuf_.size() - offset_);
-            if (bytesRead > 0) {
+            if (pfd.revents & POLLOUT)
+                drainSendQueue();
 
-                const auto len = offset_ + bytesRead;
-                const auto pos = assembleFrame(rxBuf_.data(), len, f);
-
-                if (pos == 0) {
-                    // No complete frame could be assembled. Update the offset by the number of bytes read so we
-                    // effectively append the data to the buffer and try again to assemble a complete frame the next
-                    // time we poll the stream and receive data.
-                    offset_ += bytesRead;
-                } else if (pos == len) {
-                    // Complete frame(s) read with 0 remaining bytes
-                    offset_ = 0;
-                } else {
-                    // At least 1 complete frame has been read with an incomplete frame at the end of the buffer. Copy
-                    // the remaining bytes to the beginning of the buffer and update the offset.
-                    const auto remaining = len - pos;
-                    std::memcpy(rxBuf_.data(), rxBuf_.data() + pos, remaining);
-                    offset_ = remaining;
+            if ((pfd.revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+                return 0;
+
+            return receive(f) > 0 ? 1 : 0;
+        }
+
+        /// Polls the connection, handing the messages received by each read to `f` as one batch
+        ///
+        /// `f` is called with a `std::span<const FrameDescriptor>` of the complete messages in the order they were
+        /// received, so a handler can work on all of them at once, e.g. prefetch, sort or coalesce updates. Control
+        /// frames handled by the client are not part of the batch. The descriptors point into the buffers of the
+        /// client and are valid only during the call. The batch array is reused, no memory is allocated per batch.
+        ///
+        /// A batch ends early when the batch capacity is reached, and before the client has to reuse memory a
+        /// message of the batch points to: before it reassembles a fragmented message in place, after it hands out a
+        /// decompressed message, and after a message reassembled in a separate buffer.
+        template<typename F>
+        int pollBatch(F &&f) {
+            auto flush = [this, &f]() {
+                f(std::span<const FrameDescriptor>(batch_.data(), batch_.size()));
+                batch_.clear();
+            };
+            // the batch handler is reached through a reference, so it is not copied or allocated
+            FunctionRef<void()> flushRef(flush);
+            batchFlush_ = &flushRef;
+            struct Reset {
+                Client *client;
+
+                ~Reset() {
+                    client->batch_.clear();
+                    client->batchFlush_ = nullptr;
+                }
+            } reset{this};
+
+            return poll([this](OpCode opCode, const std::uint8_t *data, std::size_t length) {
+                batch_.push_back(FrameDescriptor{opCode, data, length});
+                if (batch_.size() == batch_.capacity())
+                    flushBatch();
+            });
+        }
+
+        /// Reads from the stream until it has no more data, dispatching complete frames to `f` after each read
+        ///
+        /// Intended for use with an edge-triggered readiness notification, e.g. by the Reactor, where the stream has to
+        /// be drained before the next notification. The stream must be non-blocking. Returns the number of bytes read.
+        template<typename F>
+        std::size_t read(F &&f) {
+            instrumentation_.mark(TracePoint::POLL);
+            return drain(f, 0, 0);
+        }
+
+        /// Gets the instrumentation policy, e.g. to snapshot the histograms of a LatencyRecorder
+        Instrumentation_T &instrumentation() noexcept {
+            return instrumentation_;
+        }
+
+        /// Gets the receive buffer
+        ///
+        /// Allows a reader other than the stream, e.g. io_uring, to write received bytes directly to
+        /// `receiveBuffer().writeBegin()`. The bytes must then be handed to `commitReceived`. The buffer is replaced
+        /// when it grows or shrinks, so it must be looked up again after `commitReceived`.
+        MirroredBuffer &receiveBuffer() noexcept {
+            return rxBuf_;
+        }
+
+        /// Gets the kernel receive timestamp of the read that completed the message being dispatched
+        ///
+        /// Valid in the handler passed to `poll` or `pollBatch` when receive timestamps are enabled in the config. All
+        /// messages of a batch were completed by the same read. The timestamp is that of the last read of the client,
+        /// or the one passed to `commitReceived`.
+        [[nodiscard]] const ReceiveTimestamp &receiveTimestamp() const noexcept {
+            return receiveTimestamp_;
+        }
+
+        /// Dispatches the complete messages in the receive buffer to `f` after `n` bytes were written to it by a read
+        /// with the specified receive timestamp
+        template<typename F>
+        void commitReceived(std::size_t n, const ReceiveTimestamp &timestamp, F &&f) {
+            receiveTimestamp_ = timestamp;
+            commitReceived(n, f);
+        }
+
+        /// Dispatches the complete messages in the receive buffer to `f` after `n` bytes were written to it
+        ///
+        /// The fragments of a fragmented message are reassembled and `f` is called once with the opcode of the first
+        /// fragment and the whole payload, decompressed if it was compressed. Control frames received between the
+        /// fragments are dispatched right away.
+        template<typename F>
+        void commitReceived(std::size_t n, F &&f) {
+            rxBuf_.commit(n);
+            instrumentation_.mark(TracePoint::RECEIVED);
+            if (hasTimers_)
+                lastReceive_ = clock_t::now();
+
+            auto handler = [this, &f](OpCode opCode, const std::uint8_t *payload, std::size_t length) {
+                instrumentation_.mark(TracePoint::HANDLER_BEGIN);
+                f(opCode, payload, length);
+                instrumentation_.mark(TracePoint::HANDLER_END);
+            };
+
+            // The readable bytes of the mirrored buffer are contiguous even when they wrap around the end of the
+            // ring, so an incomplete frame at the end of the buffer simply stays where it is until the rest of it is
+            // received. The parser keeps its progress on that frame until then. A fragmented message assembled in
+            // place is kept at the beginning of the buffer, so parsing resumes after it.
+            auto *begin = rxBuf_.readBegin();
+            const auto pos = parser_.parse(
+                    begin + parsed_, rxBuf_.size() - parsed_,
+                    [this, &handler](OpCode opCode, std::uint8_t *payload, std::size_t length) {
+                        instrumentation_.mark(TracePoint::PARSED);
+                        dispatchFrame(opCode, payload, length, handler);
+                    },
+                    [this](const FrameHeader &header, std::uint8_t *payload, std::size_t length, std::uint64_t offset) {
+                        streamFrame(header, payload, length, offset);
+                    });
+            // a batch holds the frames of a single read, the receive buffer may be resized below
+            flushBatch();
+            if (isAssembling_ && !isStreamingMessage_ && !messageBuf_) {
+                parsed_ += pos;
+            } else {
+                rxBuf_.consume(parsed_ + pos);
+                parsed_ = 0;
+            }
+
+            if (parser_.hasHeader() && !parser_.isStreaming()) {
+                const auto &header = parser_.header();
+                if (!isControl(header.opCode))
+                    checkMessageSize(header.messageLength);
+
+                // make room for the whole of a frame larger than the buffer in one step, rather than growing as it
+                // arrives. A message assembled in place that no longer fits is moved to a reassembly buffer instead.
+                const auto frameLength = frameHeaderLength(header) + header.messageLength;
+                if (parsed_ + frameLength > rxBuf_.capacity()) {
+                    if (parsed_ > 0)
+                        moveMessageToBuffer(header.messageLength);
+                    if (frameLength > rxBuf_.capacity())
+                        resizeReceiveBuffer(frameLength);
                 }
+            } else if (parsed_ > 0 && parsed_ + MAX_FRAME_HEADER_LENGTH > rxBuf_.capacity()) {
+                // the headers of small fragments assembled in place filled the buffer before the next header is
+                // complete, so the read would get no room
+                moveMessageToBuffer(0);
+            }
+        }
+
+        /// Closes the connection with CloseCode::ABNORMAL when a read found it closed by the server, `error` 0, or
+        /// failed with `error`, after which a failed read throws IOError
+        ///
+        /// Called by the client when it reads the stream itself. A reader other than the stream, e.g. io_uring, calls
+        /// this instead of `commitReceived` when its read returns 0 or fails. Does nothing once the connection is
+        /// closed.
+        void commitClosed(int error) {
+            if (state_ == ConnectionState::CLOSED)
+                return;
+            finishClose(CloseCode::ABNORMAL, error == 0 ? "Connection closed by the server" : strerror(error));
+            if (error != 0)
+                throw wildcat::net::IOError(error, strerror(error));
+        }
+
+        /// Sets the handler of streamed messages
+        ///
+        /// Data frames with a payload larger than `threshold` bytes are not dispatched to the handler passed to `poll`.
+        /// Their payload is unmasked and passed on to `handler` in pieces as it is received instead, so the memory of
+        /// the connection stays bounded regardless of the size of the message and the message can be processed before
+        /// it is received completely. A fragmented message is streamed as a whole from the first fragment that is
+        /// streamed, the fragments before it are passed on as one piece. The maximum message size does not apply to
+        /// streamed messages. A threshold of 0 disables streaming.
+        void setStreamHandler(stream_handler_t handler, std::size_t threshold) {
+            streamHandler_ = std::move(handler);
+            parser_.setStreamThreshold(streamHandler_ ? threshold : 0);
+        }
 
-                return 1;
+        /// Starts the close handshake by sending a close frame
+        ///
+        /// The connection is closed when the server answers with a close frame, or after the close timeout. The close
+        /// handler is called then. The stream is not disconnected by the client, which leaves it to the application,
+        /// e.g. after removing the client from a reactor.
+        ///
+        /// \param code status code sent to the server
+        /// \param reason reason sent to the server, truncated to fit in a control frame
+        void close(CloseCode code = CloseCode::NORMAL, std::string_view reason = {}) {
+            if (state_ != ConnectionState::OPEN)
+                return;
+
+            std::array<std::uint8_t, MAX_CONTROL_PAYLOAD_LENGTH> payload;
+            const auto reasonLength = std::min(reason.size(), payload.size() - 2);
+            payload[0] = static_cast<std::uint16_t>(code) >> 8;
+            payload[1] = static_cast<std::uint16_t>(code) & 0xff;
+            std::memcpy(payload.data() + 2, reason.data(), reasonLength);
+            sendControlFrame(OpCode::CLOSE, payload.data(), 2 + reasonLength, SendPriority::CONTROL);
+
+            state_ = ConnectionState::CLOSING;
+            closeDeadline_ = clock_t::now() + closeTimeout_;
+        }
+
+        /// Gets the state of the connection
+        [[nodiscard]] ConnectionState state() const noexcept {
+            return state_;
+        }
+
+        /// Sets the handler called once the connection is closed
+        ///
+        /// The handler gets the status code of the close frame of the server, or CloseCode::ABNORMAL when the
+        /// connection is dropped because of a timeout, or is closed by the server or fails without a close frame.
+        void setCloseHandler(close_handler_t handler) {
+            closeHandler_ = std::move(handler);
+        }
+
+        /// Sends a heartbeat ping when one is due and closes the connection when a timeout expired
+        ///
+        /// Called by `poll`. When the client is read by a reactor instead, this must be called periodically.
+        void tick() {
+            if (state_ == ConnectionState::CLOSED)
+                return;
+
+            const auto now = clock_t::now();
+            if (state_ == ConnectionState::CLOSING) {
+                if (now >= closeDeadline_)
+                    finishClose(CloseCode::ABNORMAL, "Close handshake timed out");
+                return;
+            }
+
+            if (receiveTimeout_.count() > 0 && now - lastReceive_ >= receiveTimeout_) {
+                finishClose(CloseCode::ABNORMAL, "Receive timed out");
+                return;
+            }
+
+            if (heartbeatInterval_.count() > 0 && now - lastPing_ >= heartbeatInterval_) {
+                // the send time is the payload of the ping, so the round trip time is known when the pong echoes it
+                lastPing_ = now;
+                pingTimestamp_ = now.time_since_epoch().count();
+                sendControlFrame(OpCode::PING, reinterpret_cast<const std::uint8_t *>(&pingTimestamp_),
+                                 sizeof(pingTimestamp_), SendPriority::REPLY);
             }
-            return 0;
         }
 
-        std::size_t send(const std::string &msg) {
-            FrameHeader header;
-            header.opCode = OpCode::TEXT;
-            header.isFinal = true;
-            header.messageLength = msg.size();
-            header.mask = true;
-            std::memcpy(header.maskKeys.data(), maskKeys_.data(), 4 * sizeof(std::uint8_t));
+        /// Gets the round trip time measured by the last heartbeat, 0 until a heartbeat is answered
+        [[nodiscard]] std::chrono::nanoseconds lastRtt() const noexcept {
+            return lastRtt_;
+        }
+
+        /// Returns the receive buffer to its initial capacity after it grew for a large frame
+        ///
+        /// The buffer can only be shrunk when it holds no bytes of a partial frame. Intended to be called when the
+        /// connection is idle, so the memory of a burst of large frames is not held by the connection afterwards.
+        /// Returns true if the buffer was shrunk.
+        bool shrinkReceiveBuffer() {
+            if (!rxBuf_.empty() || rxBuf_.capacity() <= minRxCapacity_)
+                return false;
+            resizeReceiveBuffer(minRxCapacity_);
+            return true;
+        }
+
+        /// Gets the mask keys of the next frame sent, new keys for each frame unless disabled in the config
+        ///
+        /// Used by the client for the frames it encodes. A frame sent with `sendFrame` or `appendFrame` is masked with
+        /// the keys of its header, which should be set with this too.
+        std::array<std::uint8_t, 4> nextMaskKeys() {
+            return perFrameMaskKeys_ ? maskKeyGenerator_.next() : maskKeys_;
+        }
+
+        /// Gets the file descriptor of the underlying socket stream
+        [[nodiscard]] int fd() const {
+            return stream_->fd();
+        }
+
+        /// Sends a text message
+        std::size_t send(std::string_view msg) {
+            return send(OpCode::TEXT, std::as_bytes(std::span(msg.data(), msg.size())));
+        }
+
+        /// Sends a binary message
+        std::size_t send(std::span<const std::byte> msg) {
+            return send(OpCode::BINARY, msg);
+        }
+
+        /// Sends a message in a single frame
+        ///
+        /// \param opCode OpCode::TEXT or OpCode::BINARY, control frames are sent with `ping`, `pong` and `close`
+        std::size_t send(OpCode opCode, std::span<const std::byte> msg) {
+            checkDataMessage(opCode);
+            auto header = messageHeader(opCode, msg.size());
+            return sendFrame(header, compressPayload(header, reinterpret_cast<const std::uint8_t *>(msg.data())));
+        }
+
+        /// Sends the first frame of a message sent in fragments
+        ///
+        /// The message is continued with `sendContinuation` and ended with `sendFinal`, so a large payload can be sent
+        /// piece by piece as it is produced, without holding all of it. Control frames may be sent in between, other
+        /// data messages may not. The fragments are not compressed.
+        ///
+        /// \param opCode OpCode::TEXT or OpCode::BINARY
+        /// \return number of bytes written to the stream
+        std::size_t sendFirst(OpCode opCode, std::span<const std::byte> fragment) {
+            checkDataMessage(opCode);
+            auto header = messageHeader(opCode, fragment.size());
+            header.isFinal = false;
+            const auto n = sendFrame(header, reinterpret_cast<const std::uint8_t *>(fragment.data()));
+            isSendingFragments_ = true;
+            return n;
+        }
+
+        /// Sends a continuation frame of the message started with `sendFirst`
+        std::size_t sendContinuation(std::span<const std::byte> fragment) {
+            return sendContinuationFrame(fragment, false);
+        }
+
+        /// Sends the final frame of the message started with `sendFirst`, which may be empty
+        std::size_t sendFinal(std::span<const std::byte> fragment) {
+            return sendContinuationFrame(fragment, true);
+        }
+
+        /// Sends a ping frame. Throws std::runtime_error if the payload is longer than 125 bytes.
+        void ping(std::span<const std::byte> payload = {}) {
+            sendControlPayload(OpCode::PING, payload);
+        }
+
+        /// Sends an unsolicited pong frame, e.g. as a one-way heartbeat. Pings of the server are answered by `poll`
+        /// unless control frames are left to the application. Throws std::runtime_error if the payload is longer than
+        /// 125 bytes.
+        void pong(std::span<const std::byte> payload = {}) {
+            sendControlPayload(OpCode::PONG, payload);
+        }
+
+        /// Sends a frame with the specified header and payload
+        ///
+        /// Only the header is encoded by the client. An unmasked payload is passed to the stream as is, together with
+        /// the header as a gather array, so it is never copied. A masked payload is masked into a scratch buffer owned
+        /// by the client that is reused between calls and grows to the size of the largest frame sent.
+        ///
+        /// \param header frame header, `header.messageLength` bytes are sent from `payload`
+        /// \param payload pointer to the beginning of the payload
+        /// \return number of bytes written to the stream. In non-blocking send mode the remaining bytes of the frame
+        /// are queued.
+        std::size_t sendFrame(const FrameHeader &header, const std::uint8_t *payload) {
+            struct iovec iov[2];
+            if (header.mask) {
+                // Mask the payload into the scratch buffer right after the header so the frame is contiguous
+                const auto frameLength = frameHeaderLength(header) + header.messageLength;
+                if (txScratch_.size() < frameLength)
+                    txScratch_.resize(frameLength);
+                const auto headerLength = encodeFrameHeader(header, txScratch_.data());
+                ws::mask(payload, txScratch_.data() + headerLength, header.messageLength, header.maskKeys);
+                iov[0].iov_base = txScratch_.data();
+                iov[0].iov_len = frameLength;
+                return sendAll(iov, 1);
+            }
+
+            std::array<std::uint8_t, MAX_FRAME_HEADER_LENGTH> headerBuf;
+            iov[0].iov_base = headerBuf.data();
+            iov[0].iov_len = encodeFrameHeader(header, headerBuf.data());
+            iov[1].iov_base = const_cast<std::uint8_t *>(payload);
+            iov[1].iov_len = header.messageLength;
+            return sendAll(iov, 2);
+        }
+
+        /// Prepares a frame to be patched and sent with `sendPrepared`, masked with the next mask keys
+        PreparedFrame prepareFrame(OpCode opCode, std::span<const std::byte> payload) {
+            return PreparedFrame(opCode, payload, nextMaskKeys());
+        }
+
+        /// Prepares a text frame to be patched and sent with `sendPrepared`, masked with the next mask keys
+        PreparedFrame prepareFrame(std::string_view payload) {
+            return PreparedFrame(payload, nextMaskKeys());
+        }
+
+        /// Sends a prepared frame as it is, in a single send
+        ///
+        /// With new mask keys for each frame the frame is masked again with the next keys first, so it costs a pass
+        /// over the payload but no encoding or copy. The frame is not compressed. A data frame may not be sent while a
+        /// fragmented message is sent.
+        ///
+        /// \return number of bytes written to the stream. In non-blocking send mode the remaining bytes of the frame
+        /// are queued.
+        std::size_t sendPrepared(PreparedFrame &frame) {
+            if (isSendingFragments_ && !isControl(frame.opCode()))
+                throw std::runtime_error("New message before the end of the fragmented message");
+            if (perFrameMaskKeys_)
+                frame.setMaskKeys(maskKeyGenerator_.next());
+            struct iovec iov{const_cast<std::uint8_t *>(frame.data()), frame.size()};
+            return sendAll(&iov, 1);
+        }
+
+        /// Appends a text message to the batch of frames to be sent by the next `flush()`
+        void append(std::string_view msg) {
+            append(OpCode::TEXT, std::as_bytes(std::span(msg.data(), msg.size())));
+        }
+
+        /// Appends a binary message to the batch of frames to be sent by the next `flush()`
+        void append(std::span<const std::byte> msg) {
+            append(OpCode::BINARY, msg);
+        }
+
+        /// Appends a message in a single frame to the batch of frames to be sent by the next `flush()`
+        ///
+        /// \param opCode OpCode::TEXT or OpCode::BINARY
+        void append(OpCode opCode, std::span<const std::byte> msg) {
+            checkDataMessage(opCode);
+            auto header = messageHeader(opCode, msg.size());
+            appendFrame(header, compressPayload(header, reinterpret_cast<const std::uint8_t *>(msg.data())));
+        }
+
+        /// Appends a frame to the batch of frames to be sent by the next `flush()`
+        ///
+        /// The frame is encoded (and masked) into a transmit arena owned by the client. The arena is reused between
+        /// batches and grows to the size of the largest batch.
+        void appendFrame(const FrameHeader &header, const std::uint8_t *payload) {
+            const auto frameLength = frameHeaderLength(header) + header.messageLength;
+            if (txArena_.size() < txArenaLength_ + frameLength)
+                txArena_.resize(txArenaLength_ + frameLength);
+
+            auto *next = txArena_.data() + txArenaLength_;
+            next += encodeFrameHeader(header, next);
+            if (header.mask) {
+                ws::mask(payload, next, header.messageLength, header.maskKeys);
+            } else {
+                std::memcpy(next, payload, header.messageLength);
+            }
+            txArenaLength_ += frameLength;
+            batchFrameEnds_.push_back(txArenaLength_);
+        }
+
+        /// Gets the number of frames appended since the last flush
+        [[nodiscard]] std::size_t batchSize() const noexcept {
+            return batchFrameEnds_.size();
+        }
+
+        /// Sends all frames appended since the last flush with a single call to the stream
+        ///
+        /// \param more true if more data will be sent shortly. The socket is corked (TCP_CORK) so the kernel holds back
+        /// partial segments until the next flush with `more` set to false, which uncorks the socket.
+        /// \return number of bytes and complete frames sent
+        BatchResult flush(bool more = false) {
+            if (more)
+                setCork(true);
+
+            BatchResult result{0, 0};
+            if (txArenaLength_ > 0) {
+                struct iovec iov[1];
+                iov[0].iov_base = txArena_.data();
+                iov[0].iov_len = txArenaLength_;
+                result.bytesSent = sendAll(iov, 1);
+                // count the frames whose last byte was sent
+                result.framesSent = std::upper_bound(batchFrameEnds_.begin(), batchFrameEnds_.end(),
+                                                     result.bytesSent) - batchFrameEnds_.begin();
+            }
+            txArenaLength_ = 0;
+            batchFrameEnds_.clear();
+
+            if (!more)
+                setCork(false);
+            return result;
+        }
+
+        /// Sets the handlers called when the queued bytes of a non-blocking send cross the high and low watermarks
+        ///
+        /// \param highWatermarkHandler called when the queued bytes reach `Config::sendQueueHighWatermark`, the
+        /// application should stop sending until the low watermark handler is called
+        /// \param lowWatermarkHandler called when the queued bytes drop to `Config::sendQueueLowWatermark`
+        void setWatermarkHandlers(watermark_handler_t highWatermarkHandler, watermark_handler_t lowWatermarkHandler) {
+            highWatermarkHandler_ = std::move(highWatermarkHandler);
+            lowWatermarkHandler_ = std::move(lowWatermarkHandler);
+        }
+
+        /// Gets the number of bytes queued by non-blocking sends that have not been written to the stream yet
+        [[nodiscard]] std::size_t queuedBytes() const noexcept {
+            return sendQueue_ ? sendQueue_->size() : 0;
+        }
+
+        /// Gets the number of control frames sent by the client on its own, e.g. the pong answering a ping, that were
+        /// dropped because the send queue was full
+        [[nodiscard]] std::size_t droppedReplies() const noexcept {
+            return droppedReplies_;
+        }
+
+        /// Writes as many queued bytes as the stream accepts without blocking
+        ///
+        /// Called by `poll` when the socket is writable. Returns the number of bytes written.
+        std::size_t drainSendQueue() {
+            if (!hasQueuedBytes())
+                return 0;
 
-            FrameWriter frameWriter(txBuf_.data(), txBuf_.size());
-            frameWriter.write(header, reinterpret_cast<const uint8_t *>(msg.data()));
             std::size_t bytesSent = 0;
-            // effectively a blocking send until all bytes are sent
-            while (bytesSent < frameWriter.frameLength()) {
-                const auto n = stream_->sendBytes(reinterpret_cast<const char *>(frameWriter.bufferBegin() + bytesSent),
-                                                  frameWriter.frameLength() - bytesSent);
+            while (!sendQueue_->empty()) {
+                const auto n = stream_->sendBytes(reinterpret_cast<const char *>(sendQueue_->readBegin()),
+                                                  sendQueue_->size());
+                if (n <= 0)
+                    break;
+                sendQueue_->consume(n);
                 bytesSent += n;
             }
+            // the queue grew to hold the rest of a large frame
+            if (sendQueue_->empty() && sendQueue_->capacity() > minTxCapacity_)
+                resizeSendQueue(minTxCapacity_);
+
+            if (isAboveHighWatermark_ && sendQueue_->size() <= lowWatermark_) {
+                isAboveHighWatermark_ = false;
+                if (lowWatermarkHandler_)
+                    lowWatermarkHandler_(sendQueue_->size());
+            }
             return bytesSent;
         }
 
         /// Disconnects the underlying socket stream
+        ///
+        /// The close handshake is not done, see `close` to close the connection cleanly before disconnecting.
         void disconnect() {
             // RFC 6455 states that in "normal" cases, the underlying TCP connection should be closed by the server. It
             // is considered abnormal for the client to initiate the close. I think it should be ok to simply disconnect
-            // the underlying socket stream... I do not think I have to do the close handshake.
+            // the underlying socket stream after the close handshake.
             stream_->disconnect();
         }
 
     private:
+        /// Which frames a send is for, which decides how much of the send queue it may use
+        enum class SendPriority : std::uint8_t {
+            /// data frames, which leave room in the queue for control frames
+            DATA,
+            /// control frames sent by the application
+            CONTROL,
+            /// control frames the client sends on its own from `poll`, which are dropped rather than throw
+            REPLY
+        };
+
+        /// Room of the send queue kept for control frames
+        static constexpr std::size_t CONTROL_RESERVE = 4 * (6 + MAX_CONTROL_PAYLOAD_LENGTH);
+
+        using clock_t = std::chrono::steady_clock;
+
         std::unique_ptr<SocketStream_T> stream_;
         std::string hostName_;
         std::string path_;
-        std::size_t offset_;
-        std::array<std::uint8_t, 1024 * 1024 * 32> rxBuf_;
-        std::array<std::uint8_t, 1024> txBuf_;
-        std::vector<std::uint8_t> maskKeys_;
+        std::shared_ptr<BufferPool> bufferPool_;
+        MirroredBuffer rxBuf_;
+        std::size_t minRxCapacity_;
+        std::size_t maxRxCapacity_;
+        FrameParser parser_;
+        // bytes at the beginning of the receive buffer that are parsed but kept for the message assembled in place
+        std::size_t parsed_;
+        bool isAssembling_;
+        OpCode messageOpCode_;
+        std::size_t messageLength_;
+        std::size_t maxMessageSize_;
+        // reassembly buffer of a fragmented message that does not fit in place, held without a heap allocation
+        std::optional<MirroredBuffer> messageBuf_;
+        bool isStreamingMessage_;
+        stream_handler_t streamHandler_;
+        std::vector<std::uint8_t> txScratch_;
+        std::vector<std::uint8_t> txArena_;
+        std::size_t txArenaLength_;
+        std::vector<std::size_t> batchFrameEnds_;
+        bool isCorked_;
+        // a message sent in fragments was started and not finished
+        bool isSendingFragments_;
+        std::unique_ptr<MirroredBuffer> sendQueue_;
+        std::size_t minTxCapacity_;
+        std::size_t highWatermark_;
+        std::size_t lowWatermark_;
+        bool isAboveHighWatermark_;
+        std::size_t droppedReplies_;
+        watermark_handler_t highWatermarkHandler_;
+        watermark_handler_t lowWatermarkHandler_;
+        ReceiveMode receiveMode_;
+        std::size_t receiveByteBudget_;
+        std::size_t receiveFrameBudget_;
+        bool handleControlFrames_;
+        std::chrono::milliseconds heartbeatInterval_;
+        std::chrono::milliseconds receiveTimeout_;
+        std::chrono::milliseconds closeTimeout_;
+        bool hasTimers_;
+        ConnectionState state_;
+        clock_t::time_point lastReceive_;
+        clock_t::time_point lastPing_;
+        clock_t::time_point closeDeadline_;
+        std::int64_t pingTimestamp_;
+        std::chrono::nanoseconds lastRtt_;
+        close_handler_t closeHandler_;
+        // template of a masked control frame with the largest payload
+        std::array<std::uint8_t, 6 + MAX_CONTROL_PAYLOAD_LENGTH> controlFrame_;
+        DeflateConfig deflateConfig_;
+        std::unique_ptr<PerMessageDeflate> deflate_;
+        // the message being received was compressed, as marked by the RSV1 bit of its first frame
+        bool isCompressedMessage_;
+        std::vector<FrameDescriptor> batch_;
+        // the batch handler of the current call to pollBatch
+        FunctionRef<void()> *batchFlush_;
+        bool receiveTimestamps_;
+        // kernel receive timestamp of the last read
+        ReceiveTimestamp receiveTimestamp_;
+        MaskKeyGenerator maskKeyGenerator_;
+        bool perFrameMaskKeys_;
+        // the mask keys of all frames when they are not generated per frame
+        std::array<std::uint8_t, 4> maskKeys_;
+        [[no_unique_address]] Instrumentation_T instrumentation_;
+
+        /// Sets or clears TCP_CORK on the socket. Failure is ignored since corking is only a hint, e.g. it is not
+        /// supported on unix domain sockets.
+        void setCork(bool cork) noexcept {
+            if (cork == isCorked_)
+                return;
+            int val = cork ? 1 : 0;
+            if (::setsockopt(stream_->fd(), IPPROTO_TCP, TCP_CORK, &val, sizeof(val)) == 0)
+                isCorked_ = cork;
+        }
+
+        MirroredBuffer acquireBuffer(std::size_t capacity) {
+            return bufferPool_ ? bufferPool_->acquire(capacity) : MirroredBuffer(std::bit_ceil(capacity));
+        }
+
+        void releaseBuffer(MirroredBuffer &&buffer) {
+            if (bufferPool_)
+                bufferPool_->release(std::move(buffer));
+        }
+
+        static bool isControl(OpCode opCode) noexcept {
+            return static_cast<std::uint8_t>(opCode) & 0x8;
+        }
+
+        /// Fails the connection with status code 1009 if the message exceeds the maximum message size
+        void checkMessageSize(std::size_t frameLength) {
+            const auto messageLength = (isAssembling_ ? messageLength_ : 0) + frameLength;
+            if (maxMessageSize_ > 0 && messageLength > maxMessageSize_)
+                failConnection("Message exceeds the maximum message size", CloseCode::MESSAGE_TOO_BIG);
+        }
+
+        /// Dispatches a complete frame, or adds it to the fragmented message being assembled
+        template<typename F>
+        void dispatchFrame(OpCode opCode, std::uint8_t *payload, std::size_t length, F &f) {
+            // the header of the frame is still held by the parser while the frame is dispatched
+            if (state_ == ConnectionState::CLOSED)
+                return;
+
+            const auto isFinal = parser_.header().isFinal;
+            checkCompressed(parser_.header());
+            if (isControl(opCode)) {
+                if (!isFinal)
+                    throw ProtocolError("Fragmented control frame");
+                if (length > MAX_CONTROL_PAYLOAD_LENGTH)
+                    throw ProtocolError("Control frame payload too long");
+                if (!handleControlFrames_ || !handleControlFrame(opCode, payload, length))
+                    f(opCode, payload, length);
+                return;
+            }
+
+            if (opCode == OpCode::CONTINUATION) {
+                if (!isAssembling_)
+                    throw ProtocolError("Continuation frame without a fragmented message");
+            } else if (isAssembling_) {
+                throw ProtocolError("New message before the end of the fragmented message");
+            }
+
+            if (isStreamingMessage_) {
+                // a fragment below the stream threshold of a message that is already streamed
+                streamPayload(payload, length, messageLength_ + length, isFinal);
+                return;
+            }
+            checkMessageSize(length);
+
+            if (opCode != OpCode::CONTINUATION) {
+                isCompressedMessage_ = parser_.header().rsv1;
+                if (isFinal) {
+                    dispatchMessage(opCode, payload, length, f);
+                    return;
+                }
+                isAssembling_ = true;
+                messageOpCode_ = opCode;
+                messageLength_ = 0;
+            }
+
+            if (messageBuf_) {
+                appendToMessageBuffer(payload, length);
+            } else {
+                // compact the payloads in place, over the headers of the fragments and any control frames in between.
+                // Frames of the current batch may be in the way.
+                flushBatch();
+                std::memmove(rxBuf_.readBegin() + messageLength_, payload, length);
+            }
+            messageLength_ += length;
+
+            if (isFinal) {
+                isAssembling_ = false;
+                dispatchMessage(messageOpCode_, messageBuf_ ? messageBuf_->readBegin() : rxBuf_.readBegin(),
+                                messageLength_, f);
+                if (messageBuf_) {
+                    flushBatch();
+                    releaseBuffer(std::move(*messageBuf_));
+                    messageBuf_.reset();
+                }
+            }
+        }
+
+        /// Throws ProtocolError if the RSV1 bit is set on a frame that cannot be compressed
+        void checkCompressed(const FrameHeader &header) const {
+            if (!header.rsv1)
+                return;
+            if (!deflate_)
+                throw ProtocolError("Compressed frame without permessage-deflate");
+            // only the first frame of a data message carries the bit
+            if (isControl(header.opCode) || header.opCode == OpCode::CONTINUATION)
+                throw ProtocolError("RSV1 set on a control or continuation frame");
+        }
+
+        /// Dispatches a complete message to `f`, decompressing it first if it was compressed
+        template<typename F>
+        void dispatchMessage(OpCode opCode, const std::uint8_t *payload, std::size_t length, F &f) {
+            if (!isCompressedMessage_) {
+                f(opCode, payload, length);
+                return;
+            }
+            const auto message = deflate_->decompress(payload, length, maxMessageSize_);
+            f(opCode, message.data(), message.size());
+            // the decompressed message is overwritten by the next one
+            flushBatch();
+        }
+
+        /// Hands the batch of messages collected by `pollBatch` to its handler
+        void flushBatch() {
+            if (!batch_.empty() && batchFlush_) {
+                instrumentation_.mark(TracePoint::BATCH_BEGIN);
+                (*batchFlush_)();
+                instrumentation_.mark(TracePoint::BATCH_END);
+            }
+        }
+
+        /// Handles a control frame in the client. Returns false if the frame is to be dispatched to the handler.
+        bool handleControlFrame(OpCode opCode, const std::uint8_t *payload, std::size_t length) {
+            switch (opCode) {
+                case OpCode::PING:
+                    if (state_ == ConnectionState::OPEN)
+                        sendControlFrame(OpCode::PONG, payload, length, SendPriority::REPLY);
+                    return true;
+                case OpCode::PONG:
+                    // only a pong echoing the last heartbeat gives the round trip time, others are unsolicited
+                    if (length == sizeof(pingTimestamp_) && pingTimestamp_ != 0 &&
+                        std::memcmp(payload, &pingTimestamp_, length) == 0) {
+                        lastRtt_ = clock_t::now().time_since_epoch() - clock_t::duration(pingTimestamp_);
+                        pingTimestamp_ = 0;
+                    }
+                    return true;
+                case OpCode::CLOSE: {
+                    if (length == 1)
+                        failConnection("Close frame with an incomplete status code");
+                    auto code = CloseCode::NO_STATUS;
+                    std::string_view reason;
+                    if (length >= 2) {
+                        const auto value = static_cast<std::uint16_t>((payload[0] << 8) | payload[1]);
+                        if (!isValidCloseCode(value))
+                            failConnection("Close frame with an invalid status code");
+                        if (!isValidUtf8(payload + 2, length - 2))
+                            failConnection("Close frame with a reason that is not valid UTF-8");
+                        code = static_cast<CloseCode>(value);
+                        reason = std::string_view(reinterpret_cast<const char *>(payload + 2), length - 2);
+                    }
+                    // answer a close frame of the server with the same status code
+                    if (state_ == ConnectionState::OPEN)
+                        sendControlFrame(OpCode::CLOSE, payload, std::min<std::size_t>(length, 2), SendPriority::REPLY);
+                    finishClose(code, reason);
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        /// Throws std::runtime_error if a new data message cannot be sent with the opcode, or while a fragmented
+        /// message is sent
+        void checkDataMessage(OpCode opCode) const {
+            if (opCode != OpCode::TEXT && opCode != OpCode::BINARY)
+                throw std::runtime_error("Not a data frame opcode");
+            if (isSendingFragments_)
+                throw std::runtime_error("New message before the end of the fragmented message");
+        }
+
+        std::size_t sendContinuationFrame(std::span<const std::byte> fragment, bool isFinal) {
+            if (!isSendingFragments_)
+                throw std::runtime_error("Continuation frame without a fragmented message");
+            auto header = messageHeader(OpCode::CONTINUATION, fragment.size());
+            header.isFinal = isFinal;
+            const auto n = sendFrame(header, reinterpret_cast<const std::uint8_t *>(fragment.data()));
+            isSendingFragments_ = !isFinal;
+            return n;
+        }
+
+        void sendControlPayload(OpCode opCode, std::span<const std::byte> payload) {
+            if (payload.size() > MAX_CONTROL_PAYLOAD_LENGTH)
+                throw std::runtime_error("Control frame payload too long");
+            sendControlFrame(opCode, reinterpret_cast<const std::uint8_t *>(payload.data()), payload.size(),
+                             SendPriority::CONTROL);
+        }
+
+        /// Masks the payload into the control frame template and sends the frame
+        void sendControlFrame(OpCode opCode, const std::uint8_t *payload, std::size_t length, SendPriority priority) {
+            const auto maskKeys = nextMaskKeys();
+            std::memcpy(controlFrame_.data() + 2, maskKeys.data(), maskKeys.size());
+            controlFrame_[0] = 0x80 | static_cast<std::uint8_t>(opCode);
+            controlFrame_[1] = 0x80 | static_cast<std::uint8_t>(length);
+            ws::mask(payload, controlFrame_.data() + 6, length, maskKeys);
+
+            struct iovec iov{controlFrame_.data(), 6 + length};
+            sendAll(&iov, 1, priority);
+        }
+
+        /// Answers a frame that breaks the protocol with a close frame with the status code, 1002 by default, closes
+        /// the connection and throws ProtocolError
+        [[noreturn]] void failConnection(const char *what, CloseCode code = CloseCode::PROTOCOL_ERROR) {
+            if (state_ == ConnectionState::OPEN) {
+                const auto value = static_cast<std::uint16_t>(code);
+                const std::array<std::uint8_t, 2> payload{static_cast<std::uint8_t>(value >> 8),
+                                                          static_cast<std::uint8_t>(value & 0xff)};
+                sendControlFrame(OpCode::CLOSE, payload.data(), payload.size(), SendPriority::REPLY);
+            }
+            finishClose(code, what);
+            throw ProtocolError(what);
+        }
+
+        void finishClose(CloseCode code, std::string_view reason) {
+            state_ = ConnectionState::CLOSED;
+            if (closeHandler_)
+                closeHandler_(code, reason);
+        }
+
+        /// Passes on a piece of a streamed frame, `offset` is the offset of the piece in the payload of the frame
+        void streamFrame(const FrameHeader &header, const std::uint8_t *payload, std::size_t length,
+                         std::uint64_t offset) {
+            if (offset == 0) {
+                checkCompressed(header);
+                if (header.opCode == OpCode::CONTINUATION) {
+                    if (!isAssembling_)
+                        throw ProtocolError("Continuation frame without a fragmented message");
+                } else {
+                    if (isAssembling_)
+                        throw ProtocolError("New message before the end of the fragmented message");
+                    isAssembling_ = true;
+                    isCompressedMessage_ = header.rsv1;
+                    messageOpCode_ = header.opCode;
+                    messageLength_ = 0;
+                }
+
+                if (!isStreamingMessage_) {
+                    isStreamingMessage_ = true;
+                    if (messageLength_ > 0) {
+                        // pass on the fragments assembled so far as the first piece
+                        const auto assembledLength = messageLength_;
+                        messageLength_ = 0;
+                        streamPayload(messageBuf_ ? messageBuf_->readBegin() : rxBuf_.readBegin(), assembledLength,
+                                      assembledLength, false);
+                    }
+                    if (messageBuf_) {
+                        releaseBuffer(std::move(*messageBuf_));
+                        messageBuf_.reset();
+                    }
+                }
+            }
+
+            const auto messageLength = messageLength_ - offset + header.messageLength;
+            streamPayload(payload, length, messageLength, header.isFinal && offset + length == header.messageLength);
+        }
+
+        /// Passes on a piece of the payload of a streamed message, decompressing it first if the message is compressed
+        void streamPayload(const std::uint8_t *data, std::size_t length, std::uint64_t messageLength, bool isFinal) {
+            if (!isCompressedMessage_) {
+                streamPiece(data, length, messageLength, isFinal);
+                return;
+            }
+            // the decompressed length of the message is only known up to the end of each decompressed piece
+            deflate_->decompress(data, length, isFinal, [this](const std::uint8_t *out, std::size_t n, bool isLast) {
+                streamPiece(out, n, messageLength_ + n, isLast);
+            });
+        }
+
+        void streamPiece(const std::uint8_t *data, std::size_t length, std::uint64_t messageLength, bool isFinal) {
+            const auto offset = messageLength_;
+            messageLength_ += length;
+            if (isFinal)
+                isAssembling_ = isStreamingMessage_ = false;
+            streamHandler_(PayloadChunk{messageOpCode_, data, length, offset, messageLength, isFinal});
+        }
+
+        /// Compresses the payload of a text or binary message when permessage-deflate is enabled and the message is
+        /// long enough
+        ///
+        /// The header is updated for the compressed payload. Returns the payload to send, the compressed bytes are
+        /// valid until the next message is compressed.
+        const std::uint8_t *compressPayload(FrameHeader &header, const std::uint8_t *payload) {
+            if (!deflate_ || header.messageLength < deflateConfig_.compressThreshold)
+                return payload;
+            const auto compressed = deflate_->compress(payload, header.messageLength);
+            header.rsv1 = true;
+            header.messageLength = compressed.size();
+            return compressed.data();
+        }
+
+        /// Gets the header of a single frame message masked with the keys of the client
+        FrameHeader messageHeader(OpCode opCode, std::size_t length) {
+            FrameHeader header{};
+            header.opCode = opCode;
+            header.isFinal = true;
+            header.messageLength = length;
+            header.mask = true;
+            header.maskKeys = nextMaskKeys();
+            return header;
+        }
+
+        /// Moves the message assembled in place to a reassembly buffer, leaving room for a fragment of `length` bytes
+        void moveMessageToBuffer(std::size_t length) {
+            messageBuf_.emplace(acquireBuffer(messageLength_ + length));
+            std::memcpy(messageBuf_->writeBegin(), rxBuf_.readBegin(), messageLength_);
+            messageBuf_->commit(messageLength_);
+            rxBuf_.consume(parsed_);
+            parsed_ = 0;
+        }
+
+        void appendToMessageBuffer(const std::uint8_t *payload, std::size_t length) {
+            if (messageBuf_->available() < length) {
+                auto buffer = acquireBuffer(std::max(messageBuf_->capacity() * 2, messageBuf_->size() + length));
+                std::memcpy(buffer.writeBegin(), messageBuf_->readBegin(), messageBuf_->size());
+                buffer.commit(messageBuf_->size());
+                std::swap(*messageBuf_, buffer);
+                releaseBuffer(std::move(buffer));
+            }
+            std::memcpy(messageBuf_->writeBegin(), payload, length);
+            messageBuf_->commit(length);
+        }
+
+        /// Moves the queued bytes to a new send queue of at least `capacity` bytes
+        void resizeSendQueue(std::size_t capacity) {
+            auto buffer = acquireBuffer(capacity);
+            std::memcpy(buffer.writeBegin(), sendQueue_->readBegin(), sendQueue_->size());
+            buffer.commit(sendQueue_->size());
+            std::swap(*sendQueue_, buffer);
+            releaseBuffer(std::move(buffer));
+        }
+
+        /// Moves the readable bytes to a new receive buffer of at least `capacity` bytes
+        void resizeReceiveBuffer(std::size_t capacity) {
+            if (capacity > maxRxCapacity_)
+                throw std::runtime_error("Frame exceeds the maximum receive buffer size");
+
+            // grow at least twofold so a frame arriving in pieces does not resize the buffer every time
+            auto buffer = acquireBuffer(capacity > rxBuf_.capacity()
+                                        ? std::min(std::max(capacity, rxBuf_.capacity() * 2), maxRxCapacity_)
+                                        : capacity);
+            std::memcpy(buffer.writeBegin(), rxBuf_.readBegin(), rxBuf_.size());
+            buffer.commit(rxBuf_.size());
+            std::swap(rxBuf_, buffer);
+            releaseBuffer(std::move(buffer));
+        }
+
+        /// Reads from the stream once, at most `maxLength` bytes, and dispatches the complete frames in the receive
+        /// buffer to `f`. Returns 0 when there is no data, or when the connection was closed by the server or failed,
+        /// see `commitClosed`.
+        template<typename F>
+        ssize_t receive(F &&f, std::size_t maxLength = SIZE_MAX) {
+            const auto length = std::min(rxBuf_.available(), maxLength);
+            const auto bytesRead = receiveTimestamps_
+                                   ? recvTimestamped(stream_->fd(), rxBuf_.writeBegin(), length, receiveTimestamp_)
+                                   : stream_->recvBytes(reinterpret_cast<char *>(rxBuf_.writeBegin()), length);
+            if (bytesRead > 0) {
+                commitReceived(bytesRead, f);
+                return bytesRead;
+            }
+
+            if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                commitClosed(errno);
+            else if (bytesRead == 0 && length > 0)
+                commitClosed(0);
+            return 0;
+        }
+
+        /// Reads from the stream until it has no more data or a budget runs out. A budget of 0 is no limit. Returns
+        /// the number of bytes read.
+        template<typename F>
+        std::size_t drain(F &f, std::size_t byteBudget, std::size_t frameBudget) {
+            std::size_t bytesRead = 0;
+            std::size_t frames = 0;
+            auto counted = [&f, &frames](OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                ++frames;
+                f(opCode, buffer, length);
+            };
+
+            while (state_ != ConnectionState::CLOSED && rxBuf_.available() > 0) {
+                if (frameBudget > 0 && frames >= frameBudget)
+                    break;
+                const auto maxLength = byteBudget > 0 ? byteBudget - bytesRead : SIZE_MAX;
+                if (maxLength == 0)
+                    break;
+
+                const auto n = receive(counted, maxLength);
+                if (n <= 0)
+                    break;
+                bytesRead += n;
+            }
+            return bytesRead;
+        }
+
+        [[nodiscard]] bool hasQueuedBytes() const noexcept {
+            return sendQueue_ && !sendQueue_->empty();
+        }
+
+        /// Makes a single call to the stream to send the gather array
+        ssize_t sendSome(const struct iovec *iov, int iovcnt) {
+            if constexpr (VectoredSocketStream<SocketStream_T>) {
+                return stream_->sendBytes(iov, iovcnt);
+            } else {
+                return stream_->sendBytes(static_cast<const char *>(iov->iov_base), iov->iov_len);
+            }
+        }
+
+        /// Advances the gather array past the `n` bytes that were sent
+        static void advance(struct iovec *&iov, int &iovcnt, std::size_t n) noexcept {
+            // skip the buffers that were sent completely and advance into the one that was sent partially
+            while (iovcnt > 0 && n >= iov->iov_len) {
+                n -= iov->iov_len;
+                ++iov;
+                --iovcnt;
+            }
+            if (iovcnt > 0) {
+                iov->iov_base = static_cast<std::uint8_t *>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+
+        /// Sends all bytes of the gather array
+        ///
+        /// Without a send queue this is effectively a blocking send until all bytes are sent. With a send queue the
+        /// bytes the stream does not accept right away are queued. Returns the number of bytes written to the stream.
+        std::size_t sendAll(struct iovec *iov, int iovcnt, SendPriority priority = SendPriority::DATA) {
+            if (sendQueue_)
+                return sendOrQueue(iov, iovcnt, priority);
+
+            std::size_t bytesSent = 0;
+            while (iovcnt > 0) {
+                const auto n = sendSome(iov, iovcnt);
+                if (n < 0) {
+                    checkSendError();
+                    continue;
+                }
+
+                bytesSent += n;
+                advance(iov, iovcnt, n);
+            }
+            return bytesSent;
+        }
+
+        /// Throws IOError when a send failed for another reason than the stream not accepting bytes right now
+        static void checkSendError() {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                throw wildcat::net::IOError(errno, strerror(errno));
+        }
+
+        /// Sends what the stream accepts without blocking and queues the rest
+        ///
+        /// When nothing is queued the frame is written to the stream directly and only the bytes not written are
+        /// queued. A frame is queued as a whole or, when it does not fit, rejected: data frames throw std::runtime_error
+        /// and leave room for control frames, replies of the client are dropped and counted. Once part of a frame is
+        /// written the rest of it is always queued, the queue grows to hold the rest of a frame larger than the queue
+        /// and shrinks back when it is drained. Throws IOError when the stream fails.
+        std::size_t sendOrQueue(struct iovec *iov, int iovcnt, SendPriority priority) {
+            std::size_t totalLength = 0;
+            for (int i = 0; i < iovcnt; ++i)
+                totalLength += iov[i].iov_len;
+
+            // bytes already queued must go out first to preserve the order of the frames
+            drainSendQueue();
+
+            std::size_t bytesSent = 0;
+            while (sendQueue_->empty() && iovcnt > 0) {
+                const auto n = sendSome(iov, iovcnt);
+                if (n < 0) {
+                    checkSendError();
+                    if (errno == EINTR)
+                        continue;
+                    break;
+                }
+                bytesSent += n;
+                advance(iov, iovcnt, n);
+            }
+
+            const auto reserve = priority == SendPriority::DATA ? CONTROL_RESERVE : 0;
+            const auto rest = totalLength - bytesSent;
+            if (rest > 0 && rest + reserve > sendQueue_->available()) {
+                if (bytesSent == 0) {
+                    // the frame is rejected as a whole, so it is never partially sent or queued
+                    if (priority == SendPriority::REPLY) {
+                        ++droppedReplies_;
+                        return 0;
+                    }
+                    throw std::runtime_error("Send queue is full");
+                }
+                resizeSendQueue(rest + reserve);
+            }
+
+            for (int i = 0; i < iovcnt; ++i) {
+                std::memcpy(sendQueue_->writeBegin(), iov[i].iov_base, iov[i].iov_len);
+                sendQueue_->commit(iov[i].iov_len);
+            }
+
+            if (!isAboveHighWatermark_ && sendQueue_->size() >= highWatermark_ && sendQueue_->size() > 0) {
+                isAboveHighWatermark_ = true;
+                if (highWatermarkHandler_)
+                    highWatermarkHandler_(sendQueue_->size());
+            }
+            return bytesSent;
+        }
     };
 
 }
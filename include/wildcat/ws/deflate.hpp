@@ -0,0 +1,323 @@
+#ifndef WILDCAT_WS_DEFLATE_HPP
+#define WILDCAT_WS_DEFLATE_HPP
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+#include "error.hpp"
+#include "handshake.hpp"
+
+
+namespace wildcat::ws {
+
+    /// Parameters of the permessage-deflate extension, see RFC 7692
+    struct DeflateParameters {
+        /// The server resets its compression context after each message
+        bool serverNoContextTakeover = false;
+        /// The client resets its compression context after each message
+        bool clientNoContextTakeover = false;
+        /// Base 2 logarithm of the LZ77 window size used by the server to compress, 8 to 15
+        int serverMaxWindowBits = 15;
+        /// Base 2 logarithm of the LZ77 window size used by the client to compress, 9 to 15
+        int clientMaxWindowBits = 15;
+    };
+
+    /// permessage-deflate configuration of a client
+    struct DeflateConfig {
+        /// true to offer permessage-deflate in the handshake
+        bool enabled = false;
+        /// Parameters offered to the server. Smaller windows take less memory per connection at the cost of the
+        /// compression ratio.
+        DeflateParameters parameters;
+        /// zlib compression level of the messages sent, 0 to 9
+        int compressionLevel = Z_BEST_SPEED;
+        /// zlib memory level of the compression state, 1 to 9
+        int memLevel = 8;
+        /// Messages sent shorter than this are not compressed, since it costs more time than it saves on the wire
+        std::size_t compressThreshold = 128;
+        /// Initial size of the compression and decompression output buffers, which grow to the largest message
+        std::size_t bufferSize = 64 * 1024;
+    };
+
+    namespace {
+
+        std::string_view trim(std::string_view s) {
+            const auto begin = s.find_first_not_of(" \t");
+            if (begin == std::string_view::npos)
+                return {};
+            const auto end = s.find_last_not_of(" \t");
+            return s.substr(begin, end - begin + 1);
+        }
+
+        int parseWindowBits(std::string_view value, int min) {
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                value = value.substr(1, value.size() - 2);
+            int bits = 0;
+            for (const auto c: value) {
+                if (c < '0' || c > '9')
+                    throw HandshakeError("Invalid permessage-deflate window bits: " + std::string(value));
+                bits = bits * 10 + (c - '0');
+            }
+            if (value.empty() || bits < min || bits > 15)
+                throw HandshakeError("Unsupported permessage-deflate window bits: " + std::string(value));
+            return bits;
+        }
+
+    }
+
+    /// Gets the value of the Sec-WebSocket-Extensions header offering permessage-deflate with the parameters
+    inline std::string getDeflateOffer(const DeflateParameters &params) {
+        std::string offer = "permessage-deflate";
+        if (params.serverNoContextTakeover)
+            offer += "; server_no_context_takeover";
+        if (params.clientNoContextTakeover)
+            offer += "; client_no_context_takeover";
+        if (params.serverMaxWindowBits < 15)
+            offer += "; server_max_window_bits=" + std::to_string(params.serverMaxWindowBits);
+        // without a value the parameter tells the server it may limit the window of the client
+        offer += "; client_max_window_bits";
+        if (params.clientMaxWindowBits < 15)
+            offer += "=" + std::to_string(params.clientMaxWindowBits);
+        return offer;
+    }
+
+    /// Gets the permessage-deflate parameters accepted by the server
+    ///
+    /// \param header value of the Sec-WebSocket-Extensions header of the handshake response
+    /// \param offered parameters offered by the client
+    /// \param negotiated set to the parameters to use for the connection
+    /// \return true if the server accepted permessage-deflate. Throws HandshakeError if the server responded with
+    /// parameters that are invalid or were not offered.
+    inline bool parseDeflateResponse(std::string_view header, const DeflateParameters &offered,
+                                     DeflateParameters &negotiated) {
+        negotiated = DeflateParameters{};
+        negotiated.clientNoContextTakeover = offered.clientNoContextTakeover;
+        negotiated.clientMaxWindowBits = offered.clientMaxWindowBits;
+
+        bool isAccepted = false;
+        while (!header.empty()) {
+            const auto end = std::min(header.find(','), header.size());
+            auto extension = header.substr(0, end);
+            header.remove_prefix(std::min(end + 1, header.size()));
+
+            auto pos = std::min(extension.find(';'), extension.size());
+            if (trim(extension.substr(0, pos)) != "permessage-deflate")
+                throw HandshakeError("Unexpected extension in response: " + std::string(trim(extension)));
+            if (isAccepted)
+                throw HandshakeError("permessage-deflate accepted more than once");
+            isAccepted = true;
+
+            extension.remove_prefix(std::min(pos + 1, extension.size()));
+            while (!extension.empty()) {
+                pos = std::min(extension.find(';'), extension.size());
+                const auto param = trim(extension.substr(0, pos));
+                extension.remove_prefix(std::min(pos + 1, extension.size()));
+
+                const auto eq = param.find('=');
+                const auto name = trim(param.substr(0, eq));
+                const auto value = eq == std::string_view::npos ? std::string_view() : trim(param.substr(eq + 1));
+                if (name == "server_no_context_takeover") {
+                    negotiated.serverNoContextTakeover = true;
+                } else if (name == "client_no_context_takeover") {
+                    negotiated.clientNoContextTakeover = true;
+                } else if (name == "server_max_window_bits") {
+                    negotiated.serverMaxWindowBits = parseWindowBits(value, 8);
+                    if (negotiated.serverMaxWindowBits > offered.serverMaxWindowBits)
+                        throw HandshakeError("server_max_window_bits larger than offered");
+                } else if (name == "client_max_window_bits") {
+                    // zlib cannot compress with a window of 8 bits
+                    negotiated.clientMaxWindowBits = std::min(parseWindowBits(value, 9), offered.clientMaxWindowBits);
+                } else {
+                    throw HandshakeError("Unexpected permessage-deflate parameter: " + std::string(name));
+                }
+            }
+        }
+        return isAccepted;
+    }
+
+    /// Compression state of a connection using permessage-deflate
+    ///
+    /// The zlib streams live as long as the connection. With context takeover each message is compressed with the
+    /// history of the previous messages, which is where most of the ratio on a feed of similar messages comes from.
+    /// The output buffers are allocated up front and grow to the size of the largest message.
+    class PerMessageDeflate {
+    public:
+        /// Sets up the compression and decompression streams
+        ///
+        /// \param params negotiated parameters
+        /// \param config compression settings
+        /// \param isClient true for the client end of the connection, false for the server end
+        PerMessageDeflate(const DeflateParameters &params, const DeflateConfig &config, bool isClient = true)
+                : deflater_(), inflater_(),
+                  deflateOut_(std::max<std::size_t>(config.bufferSize, MIN_BUFFER_SIZE)),
+                  inflateOut_(std::max<std::size_t>(config.bufferSize, MIN_BUFFER_SIZE)),
+                  resetDeflater_(isClient ? params.clientNoContextTakeover : params.serverNoContextTakeover),
+                  resetInflater_(isClient ? params.serverNoContextTakeover : params.clientNoContextTakeover) {
+            // raw deflate streams, i.e. without the zlib header and trailer, are selected by negative window bits
+            const auto deflateBits = std::max(isClient ? params.clientMaxWindowBits : params.serverMaxWindowBits, 9);
+            const auto inflateBits = isClient ? params.serverMaxWindowBits : params.clientMaxWindowBits;
+            if (::deflateInit2(&deflater_, config.compressionLevel, Z_DEFLATED, -deflateBits, config.memLevel,
+                               Z_DEFAULT_STRATEGY) != Z_OK)
+                throw std::runtime_error("Failed to initialize the deflate stream");
+            if (::inflateInit2(&inflater_, -inflateBits) != Z_OK) {
+                ::deflateEnd(&deflater_);
+                throw std::runtime_error("Failed to initialize the inflate stream");
+            }
+        }
+
+        // zlib streams keep a pointer to themselves, so they can be neither copied nor moved
+        PerMessageDeflate(const PerMessageDeflate &) = delete;
+
+        PerMessageDeflate &operator=(const PerMessageDeflate &) = delete;
+
+        ~PerMessageDeflate() {
+            ::deflateEnd(&deflater_);
+            ::inflateEnd(&inflater_);
+        }
+
+        /// Compresses a message. The compressed bytes are valid until the next call.
+        std::span<const std::uint8_t> compress(const std::uint8_t *data, std::size_t length) {
+            std::size_t n = 0;
+            // zlib counts bytes in uInt, so a message of 4 GiB or more is fed in pieces and flushed after the last one
+            for (std::size_t offset = 0;;) {
+                const auto chunk = clamp(length - offset);
+                deflater_.next_in = const_cast<Bytef *>(data + offset);
+                deflater_.avail_in = chunk;
+                offset += chunk;
+                const auto isLast = offset == length;
+                for (;;) {
+                    // more than 6 bytes of room avoids repeated flush markers
+                    if (deflateOut_.size() - n <= 6)
+                        deflateOut_.resize(deflateOut_.size() * 2);
+                    deflater_.next_out = deflateOut_.data() + n;
+                    deflater_.avail_out = clamp(deflateOut_.size() - n);
+                    const auto ret = ::deflate(&deflater_, isLast ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+                    if (ret != Z_OK && ret != Z_BUF_ERROR)
+                        throw std::runtime_error("Failed to compress message");
+                    n = deflater_.next_out - deflateOut_.data();
+                    // room left means the input is consumed, and flushed after the last piece
+                    if (deflater_.avail_out != 0)
+                        break;
+                }
+                if (isLast)
+                    break;
+            }
+
+            // the flush ends with an empty stored block, 00 00 ff ff, which is removed from the message
+            n -= TAIL.size();
+            if (resetDeflater_)
+                ::deflateReset(&deflater_);
+            return {deflateOut_.data(), n};
+        }
+
+        /// Decompresses a complete message. The decompressed bytes are valid until the next call.
+        ///
+        /// \param maxLength maximum length of the decompressed message, 0 for no limit. ProtocolError is thrown when
+        /// it is exceeded.
+        std::span<const std::uint8_t> decompress(const std::uint8_t *data, std::size_t length,
+                                                 std::size_t maxLength = 0) {
+            std::size_t n = 0;
+            auto grow = [this, maxLength](std::size_t n) {
+                if (maxLength > 0 && n > maxLength)
+                    throw ProtocolError("Message exceeds the maximum message size");
+                inflateOut_.resize(inflateOut_.size() * 2);
+            };
+            inflate(data, length, n, grow);
+            inflate(TAIL.data(), TAIL.size(), n, grow);
+            if (maxLength > 0 && n > maxLength)
+                throw ProtocolError("Message exceeds the maximum message size");
+
+            if (resetInflater_)
+                ::inflateReset(&inflater_);
+            return {inflateOut_.data(), n};
+        }
+
+        /// Decompresses a piece of a message as it is received
+        ///
+        /// Calls `f(data, length, isLast)` for each piece of the decompressed message, at most the size of the output
+        /// buffer at a time, so the memory used does not depend on the length of the message.
+        ///
+        /// \param isFinal true if this is the last piece of the message
+        template<typename F>
+        void decompress(const std::uint8_t *data, std::size_t length, bool isFinal, F &&f) {
+            std::size_t n = 0;
+            auto flush = [this, &f](std::size_t &n) {
+                f(inflateOut_.data(), n, false);
+                n = 0;
+            };
+            inflate(data, length, n, flush);
+            if (isFinal) {
+                inflate(TAIL.data(), TAIL.size(), n, flush);
+                if (resetInflater_)
+                    ::inflateReset(&inflater_);
+                f(inflateOut_.data(), n, true);
+            } else if (n > 0) {
+                f(inflateOut_.data(), n, false);
+            }
+        }
+
+    private:
+        static constexpr std::size_t MIN_BUFFER_SIZE = 64;
+        static constexpr std::array<std::uint8_t, 4> TAIL{0x00, 0x00, 0xff, 0xff};
+
+        z_stream deflater_;
+        z_stream inflater_;
+        std::vector<std::uint8_t> deflateOut_;
+        std::vector<std::uint8_t> inflateOut_;
+        bool resetDeflater_;
+        bool resetInflater_;
+
+        /// Gets a length zlib can count, which is at most the largest uInt
+        static uInt clamp(std::size_t length) noexcept {
+            return static_cast<uInt>(std::min<std::size_t>(length, UINT_MAX));
+        }
+
+        /// Inflates the input to the output buffer from offset `n`, calling `full(n)` when the output buffer is full
+        template<typename F>
+        void inflate(const std::uint8_t *data, std::size_t length, std::size_t &n, F &full) {
+            // zlib counts bytes in uInt, so input of 4 GiB or more is fed in pieces
+            do {
+                const auto chunk = clamp(length);
+                inflatePiece(data, chunk, n, full);
+                data += chunk;
+                length -= chunk;
+            } while (length > 0);
+        }
+
+        template<typename F>
+        void inflatePiece(const std::uint8_t *data, uInt length, std::size_t &n, F &full) {
+            inflater_.next_in = const_cast<Bytef *>(data);
+            inflater_.avail_in = length;
+            for (;;) {
+                if (n == inflateOut_.size())
+                    full(n);
+                inflater_.next_out = inflateOut_.data() + n;
+                inflater_.avail_out = clamp(inflateOut_.size() - n);
+                const auto ret = ::inflate(&inflater_, Z_SYNC_FLUSH);
+                n = inflater_.next_out - inflateOut_.data();
+                if (ret == Z_STREAM_END) {
+                    // the peer ended the deflate stream with a final block, the next block starts a new one
+                    ::inflateReset(&inflater_);
+                    if (inflater_.avail_in == 0)
+                        return;
+                    continue;
+                }
+                if (ret != Z_OK && ret != Z_BUF_ERROR)
+                    throw ProtocolError("Invalid compressed message");
+                if (inflater_.avail_out != 0)
+                    return;
+            }
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_DEFLATE_HPP
@@ -0,0 +1,18 @@
+#ifndef WILDCAT_WS_ERROR_HPP
+#define WILDCAT_WS_ERROR_HPP
+
+#include <stdexcept>
+#include <string>
+
+
+namespace wildcat::ws {
+
+    /// Thrown when the peer violates the web socket protocol
+    class ProtocolError : public std::runtime_error {
+    public:
+        explicit ProtocolError(const std::string &what) : std::runtime_error(what) {}
+    };
+
+}
+
+#endif //WILDCAT_WS_ERROR_HPP
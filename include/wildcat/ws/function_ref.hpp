@@ -0,0 +1,42 @@
+#ifndef WILDCAT_WS_FUNCTION_REF_HPP
+#define WILDCAT_WS_FUNCTION_REF_HPP
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+namespace wildcat::ws {
+
+    template<class Signature>
+    class FunctionRef;
+
+    /// Non-owning reference to a callable, the size of two pointers
+    ///
+    /// Unlike std::function it never allocates or copies the callable, so it is cheap to pass a handler through a
+    /// non-template interface. The callable must outlive the reference, which makes it suited to parameters and to
+    /// handlers held only for the duration of a call.
+    template<class R, class... Args>
+    class FunctionRef<R(Args...)> {
+    public:
+        template<class F>
+        requires (!std::is_same_v<std::remove_cvref_t<F>, FunctionRef> && std::is_invocable_r_v<R, F &, Args...>)
+        FunctionRef(F &&f) noexcept
+                : object_(const_cast<void *>(static_cast<const void *>(std::addressof(f)))),
+                  callback_([](void *object, Args... args) -> R {
+                      return std::invoke(*static_cast<std::add_pointer_t<F>>(object), std::forward<Args>(args)...);
+                  }) {}
+
+        R operator()(Args... args) const {
+            return callback_(object_, std::forward<Args>(args)...);
+        }
+
+    private:
+        void *object_;
+        R (*callback_)(void *, Args...);
+    };
+
+}
+
+#endif //WILDCAT_WS_FUNCTION_REF_HPP
@@ -0,0 +1,85 @@
+#ifndef WILDCAT_WS_HANDOFF_HPP
+#define WILDCAT_WS_HANDOFF_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "client.hpp"
+#include "queue.hpp"
+
+
+namespace wildcat::ws {
+
+    /// A message copied out of the buffers of a client, so it can be handed to another thread
+    ///
+    /// A message longer than the slot is truncated to its first `Capacity` bytes and flagged, so a consumer never
+    /// mistakes it for a complete message.
+    ///
+    /// \tparam Capacity maximum payload length held by the slot
+    template<std::size_t Capacity>
+    struct MessageSlot {
+        /// opcode of the message
+        OpCode opCode;
+        /// true if the message was longer than the slot and the payload holds only its first `Capacity` bytes
+        bool truncated;
+        /// length of the payload held by the slot, at most `Capacity`
+        std::size_t length;
+        /// length of the message, larger than `length` when the message was truncated
+        std::size_t messageLength;
+        /// the payload, the first `length` bytes are valid
+        std::array<std::uint8_t, Capacity> data;
+
+        [[nodiscard]] bool isTruncated() const noexcept {
+            return truncated;
+        }
+    };
+
+    /// Batch handler for `Client::pollBatch` that hands the messages to consumer threads through a queue
+    ///
+    /// The descriptors of a batch point into the buffers of the client and are only valid during the call, so each
+    /// message is copied into a slot of the queue, in place, and the whole batch is published at once. When the queue
+    /// is full the polling thread waits for room with the wait strategy of the queue, which in turn leaves the bytes
+    /// in the socket and pushes back on the server through TCP flow control.
+    ///
+    /// With a BroadcastRing every consumer thread reads the same copy in place, and a full ring is handled by the slow
+    /// consumer policy of the ring.
+    ///
+    /// \tparam Queue_T SpscQueue, MpmcQueue or BroadcastRing of MessageSlot
+    template<class Queue_T>
+    class HandOff {
+    public:
+        explicit HandOff(Queue_T &queue) noexcept: queue_(queue), truncated_(0) {}
+
+        void operator()(std::span<const FrameDescriptor> batch) {
+            queue_.pushBatch(batch.size(), [this, batch](auto &slot, std::size_t i) {
+                copy(batch[i], slot);
+            });
+        }
+
+        /// Gets the number of messages that were larger than a slot and handed off truncated
+        [[nodiscard]] std::size_t truncated() const noexcept {
+            return truncated_;
+        }
+
+    private:
+        Queue_T &queue_;
+        std::size_t truncated_;
+
+        template<std::size_t Capacity>
+        void copy(const FrameDescriptor &frame, MessageSlot<Capacity> &slot) noexcept {
+            slot.opCode = frame.opCode;
+            slot.truncated = frame.length > Capacity;
+            slot.length = std::min(frame.length, Capacity);
+            slot.messageLength = frame.length;
+            std::memcpy(slot.data.data(), frame.data, slot.length);
+            if (slot.truncated)
+                ++truncated_;
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_HANDOFF_HPP
@@ -4,10 +4,14 @@
 
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <random>
+#include <span>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <iostream>
 #include <cstring>
 #include <poll.h>
@@ -85,8 +89,9 @@ namespace wildcat::ws {
             return result;
         }
 
-        /// Gets an http upgrade request
-        std::string getUpgradeRequest(const std::string &host, const std::string &path, const std::string &key) {
+        /// Gets an http upgrade request, offering the `extensions` when not empty
+        std::string getUpgradeRequest(const std::string &host, const std::string &path, const std::string &key,
+                                      const std::string &extensions = "") {
             std::stringstream ss;
             ss << "GET /" << path << " HTTP/1.1\r\n";
             ss << "Host: " << host << "\r\n";
@@ -94,6 +99,8 @@ namespace wildcat::ws {
             ss << "Connection: Upgrade\r\n";
             ss << "Sec-WebSocket-Version: 13\r\n";
             ss << "Sec-WebSocket-Key: " << key << "\r\n";
+            if (!extensions.empty())
+                ss << "Sec-WebSocket-Extensions: " << extensions << "\r\n";
             ss << "\r\n";
             return ss.str();
         }
@@ -112,8 +119,8 @@ namespace wildcat::ws {
             return out;
         }
 
-        /// Fills a vector with randomly generated values
-        void fill(std::vector<std::uint8_t> &v) {
+        /// Fills a buffer with randomly generated values
+        void fill(std::span<std::uint8_t> v) {
             for (auto &i: v) {
                 i = distribution_(engine_);
             }
@@ -237,9 +244,20 @@ namespace wildcat::ws {
 
         /// Initiates the handshake
         static bool doHandshake(const std::string &host, const std::string &path, SocketStream_T *stream) {
+            std::string acceptedExtensions;
+            return doHandshake(host, path, stream, "", acceptedExtensions);
+        }
+
+        /// Initiates the handshake offering extensions
+        ///
+        /// \param extensions value of the Sec-WebSocket-Extensions header of the request, empty to offer none
+        /// \param acceptedExtensions set to the value of the Sec-WebSocket-Extensions header of the response, empty if
+        /// the server accepted none
+        static bool doHandshake(const std::string &host, const std::string &path, SocketStream_T *stream,
+                                const std::string &extensions, std::string &acceptedExtensions) {
             const auto key = generateKey();
             const auto acceptKey = getAcceptKey(key);
-            const auto upgrade = getUpgradeRequest(host, path, key);
+            const auto upgrade = getUpgradeRequest(host, path, key, extensions);
 
             // Write the upgrade request. Use poll to ensure socket is ready to write without blocking.
             struct pollfd pfd{};
@@ -269,11 +287,12 @@ namespace wildcat::ws {
             while (!response.isComplete()) {
                 if (poll(&pfd, 1, pollTimeoutMillis) != -1) {
                     const auto bytesRead = stream->recvBytes(buffer.data() + offset, buffer.size() - offset);
-                    offset += bytesRead;
+                    if (bytesRead > 0)
+                        offset += bytesRead;
 
                     response.parse(buffer.data(), offset);
                     if (response.isComplete()) {
-                        return validateResponse(response, acceptKey);
+                        return validateResponse(response, acceptKey, extensions, acceptedExtensions);
                     }
                 } else {
                     throw wildcat::net::IOError(errno, strerror(errno));
@@ -290,7 +309,8 @@ namespace wildcat::ws {
             return out;
         }
 
-        static bool validateResponse(const HttpResponse &response, const std::string &acceptKey) {
+        static bool validateResponse(const HttpResponse &response, const std::string &acceptKey,
+                                     const std::string &extensions, std::string &acceptedExtensions) {
             if (response.status() != 101) {
                 std::string errMsg = "Unexpected response HTTP status code: ";
                 errMsg += std::to_string(response.status());
@@ -341,6 +361,20 @@ namespace wildcat::ws {
                 }
             }
 
+            // Sec-WebSocket-Extensions, the server may only accept extensions that were offered
+            {
+                acceptedExtensions.clear();
+                const auto h = headers.find("Sec-WebSocket-Extensions");
+                if (h != headers.end() && !h->second.empty()) {
+                    if (extensions.empty()) {
+                        std::string errMsg = "Unexpected value for Sec-WebSocket-Extensions header: ";
+                        errMsg += h->second;
+                        throw HandshakeError(errMsg);
+                    }
+                    acceptedExtensions = h->second;
+                }
+            }
+
             return true;
         }
 
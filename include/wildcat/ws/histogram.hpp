@@ -0,0 +1,158 @@
+#ifndef WILDCAT_WS_HISTOGRAM_HPP
+#define WILDCAT_WS_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace wildcat::ws {
+
+    /// Copy of the counts of a LatencyHistogram, taken with `LatencyHistogram::snapshot`
+    class HistogramSnapshot {
+    public:
+        HistogramSnapshot(std::vector<std::uint64_t> counts, std::uint64_t max, double nanosPerUnit) noexcept
+                : counts_(std::move(counts)), total_(0), max_(max), nanosPerUnit_(nanosPerUnit) {
+            for (auto count: counts_)
+                total_ += count;
+        }
+
+        /// Gets the number of recorded values
+        [[nodiscard]] std::uint64_t count() const noexcept {
+            return total_;
+        }
+
+        /// Gets the largest recorded value in nanoseconds
+        [[nodiscard]] std::uint64_t max() const noexcept {
+            return toNanos(max_);
+        }
+
+        /// Gets the value in nanoseconds below which `percentile` percent of the recorded values are, e.g. 99.9. The
+        /// value is the highest value of its bucket, so it is never below the actual percentile. 0 if no value was
+        /// recorded.
+        [[nodiscard]] std::uint64_t percentile(double percentile) const noexcept;
+
+        /// Gets the mean of the recorded values in nanoseconds, as far as the bucket precision allows
+        [[nodiscard]] double mean() const noexcept;
+
+        /// Gets the count of each bucket
+        [[nodiscard]] const std::vector<std::uint64_t> &counts() const noexcept {
+            return counts_;
+        }
+
+    private:
+        std::vector<std::uint64_t> counts_;
+        std::uint64_t total_;
+        std::uint64_t max_;
+        double nanosPerUnit_;
+
+        [[nodiscard]] std::uint64_t toNanos(std::uint64_t value) const noexcept {
+            return static_cast<std::uint64_t>(std::llround(static_cast<double>(value) * nanosPerUnit_));
+        }
+    };
+
+    /// Histogram of latencies with buckets of bounded relative width (HDR style)
+    ///
+    /// Values below `2 * SUB_BUCKET_COUNT` are counted exactly. Above that each power of two is split in
+    /// `SUB_BUCKET_COUNT` buckets, so a value is known within 1 / SUB_BUCKET_COUNT (about 3%). Values of `MAX_VALUE_BITS`
+    /// bits or more are counted in the last bucket. The values are in the units of the clock they are measured with.
+    ///
+    /// A histogram is recorded by one thread and can be snapshotted by any other thread while it is recorded. With a
+    /// single writer a bucket is counted with a relaxed load and store rather than a locked read-modify-write. The
+    /// snapshot reads each bucket atomically, but not all buckets at the same instant.
+    class LatencyHistogram {
+    public:
+        static constexpr unsigned SUB_BUCKET_BITS = 5;
+        static constexpr std::uint64_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+        static constexpr unsigned MAX_VALUE_BITS = 40;
+        static constexpr std::uint64_t MAX_VALUE = (std::uint64_t(1) << MAX_VALUE_BITS) - 1;
+        static constexpr std::size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+        LatencyHistogram() noexcept: counts_(), max_(0) {}
+
+        LatencyHistogram(const LatencyHistogram &) = delete;
+
+        LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+        /// Counts a value. Recording thread only.
+        void record(std::uint64_t value) noexcept {
+            auto &count = counts_[bucketOf(value)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (value > max_.load(std::memory_order_relaxed))
+                max_.store(value, std::memory_order_relaxed);
+        }
+
+        /// Copies the counts. Any thread.
+        ///
+        /// \param nanosPerUnit nanoseconds per unit of the recorded values
+        [[nodiscard]] HistogramSnapshot snapshot(double nanosPerUnit = 1.0) const {
+            std::vector<std::uint64_t> counts(BUCKET_COUNT);
+            for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+                counts[i] = counts_[i].load(std::memory_order_relaxed);
+            return {std::move(counts), max_.load(std::memory_order_relaxed), nanosPerUnit};
+        }
+
+        /// Gets the index of the bucket of a value
+        static std::size_t bucketOf(std::uint64_t value) noexcept {
+            value = std::min(value, MAX_VALUE);
+            if (value < 2 * SUB_BUCKET_COUNT)
+                return value;
+            // the leading SUB_BUCKET_BITS + 1 bits of the value select the bucket within its power of two
+            const auto shift = static_cast<unsigned>(std::bit_width(value)) - SUB_BUCKET_BITS - 1;
+            return shift * SUB_BUCKET_COUNT + (value >> shift);
+        }
+
+        /// Gets the lowest value of a bucket
+        static std::uint64_t lowestValueOf(std::size_t bucket) noexcept {
+            if (bucket < 2 * SUB_BUCKET_COUNT)
+                return bucket;
+            const auto shift = bucket / SUB_BUCKET_COUNT - 1;
+            return (bucket - shift * SUB_BUCKET_COUNT) << shift;
+        }
+
+        /// Gets the highest value of a bucket
+        static std::uint64_t highestValueOf(std::size_t bucket) noexcept {
+            return bucket + 1 < BUCKET_COUNT ? lowestValueOf(bucket + 1) - 1 : MAX_VALUE;
+        }
+
+    private:
+        std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> counts_;
+        std::atomic<std::uint64_t> max_;
+    };
+
+    inline std::uint64_t HistogramSnapshot::percentile(double percentile) const noexcept {
+        if (total_ == 0)
+            return 0;
+        const auto rank = std::max<std::uint64_t>(
+                static_cast<std::uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 *
+                                                     static_cast<double>(total_))), 1);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank)
+                return toNanos(std::min(LatencyHistogram::highestValueOf(i), max_));
+        }
+        return max();
+    }
+
+    inline double HistogramSnapshot::mean() const noexcept {
+        if (total_ == 0)
+            return 0;
+        double sum = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] > 0) {
+                const auto middle = (LatencyHistogram::lowestValueOf(i) + LatencyHistogram::highestValueOf(i)) / 2;
+                sum += static_cast<double>(counts_[i]) * static_cast<double>(middle);
+            }
+        }
+        return sum / static_cast<double>(total_) * nanosPerUnit_;
+    }
+
+}
+
+#endif //WILDCAT_WS_HISTOGRAM_HPP
@@ -0,0 +1,193 @@
+#ifndef WILDCAT_WS_INSTRUMENTATION_HPP
+#define WILDCAT_WS_INSTRUMENTATION_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "histogram.hpp"
+
+
+namespace wildcat::ws {
+
+    /*
+     * The Client takes an instrumentation policy as a template parameter and calls `mark(point)` at each point of the
+     * receive path below, in this order for each read. A policy with an empty `mark`, like NoInstrumentation, compiles
+     * away to nothing.
+     */
+
+    /// Points of the receive path of a Client
+    enum class TracePoint : std::uint8_t {
+        /// `poll` or `read` was called, i.e. the thread woke up to check the connection
+        POLL = 0,
+        /// bytes were received, before they are parsed
+        RECEIVED = 1,
+        /// a frame was parsed and its payload unmasked
+        PARSED = 2,
+        /// a message is about to be dispatched to the handler, after it was reassembled and decompressed if needed
+        HANDLER_BEGIN = 3,
+        /// the handler returned
+        HANDLER_END = 4,
+        /// a batch is about to be dispatched to the handler of `pollBatch`
+        BATCH_BEGIN = 5,
+        /// the handler of `pollBatch` returned
+        BATCH_END = 6
+    };
+
+    /// Instrumentation policy that records nothing and costs nothing
+    struct NoInstrumentation {
+        constexpr void mark(TracePoint) noexcept {}
+    };
+
+    /// Clock reading CLOCK_MONOTONIC through the vDSO, in nanoseconds
+    struct MonotonicClock {
+        static std::uint64_t now() noexcept {
+            struct timespec ts{};
+            ::clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 + static_cast<std::uint64_t>(ts.tv_nsec);
+        }
+
+        static double nanosPerTick() noexcept {
+            return 1.0;
+        }
+    };
+
+    /// Clock reading the time stamp counter of the CPU, a few times cheaper than `clock_gettime`
+    ///
+    /// Needs an invariant TSC, which is constant rate and synchronised across cores on current x86 CPUs. The rate is
+    /// calibrated against CLOCK_MONOTONIC the first time it is needed, which takes 10ms. The read is not serialising,
+    /// so it can be reordered with the instructions around it by a few cycles. Falls back to MonotonicClock on other
+    /// architectures.
+    struct TscClock {
+        static std::uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return MonotonicClock::now();
+#endif
+        }
+
+        static double nanosPerTick() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+            static const double value = calibrate();
+            return value;
+#else
+            return 1.0;
+#endif
+        }
+
+    private:
+        static double calibrate() noexcept {
+            const auto beginNanos = MonotonicClock::now();
+            const auto beginTicks = now();
+            auto endNanos = beginNanos;
+            while (endNanos - beginNanos < 10000000)
+                endNanos = MonotonicClock::now();
+            const auto endTicks = now();
+            return static_cast<double>(endNanos - beginNanos) / static_cast<double>(endTicks - beginTicks);
+        }
+    };
+
+    /// Stages of the receive path timed by LatencyRecorder, each between two trace points
+    enum class LatencyStage : std::uint8_t {
+        /// from the wake-up, or the end of the previous message of the same poll, to the bytes received
+        RECEIVE = 0,
+        /// from the bytes received, or the end of the previous message, to the frame parsed and unmasked
+        PARSE = 1,
+        /// from the last frame of a message parsed to the handler called, i.e. reassembly and decompression
+        DISPATCH = 2,
+        /// time spent in the handler
+        HANDLER = 3,
+        /// time spent in the handler of `pollBatch`
+        BATCH_HANDLER = 4,
+        /// from the wake-up to the handler called, i.e. the time a message waited in the client
+        WAKE_TO_HANDLER = 5
+    };
+
+    constexpr std::size_t LATENCY_STAGE_COUNT = 6;
+
+    /// Instrumentation policy that times the stages of the receive path into a histogram per stage
+    ///
+    /// Used as `Client<SocketStream_T, LatencyRecorder<>>`, the recorder is then reached with
+    /// `client.instrumentation()`. The trace points are recorded by the polling thread, and the histograms can be
+    /// snapshotted by any other thread. A reader other than `poll`, e.g. io_uring, calls `mark(TracePoint::POLL)` on
+    /// wake-up itself, otherwise the receive stage is not recorded.
+    ///
+    /// \tparam Clock_T MonotonicClock or TscClock
+    template<class Clock_T = MonotonicClock>
+    class LatencyRecorder {
+    public:
+        LatencyRecorder()
+                : histograms_(std::make_unique<std::array<LatencyHistogram, LATENCY_STAGE_COUNT>>()), wakeUp_(0),
+                  last_(0), parsed_(0), handlerBegin_(0), batchBegin_(0) {}
+
+        void mark(TracePoint point) noexcept {
+            const auto now = Clock_T::now();
+            switch (point) {
+                case TracePoint::POLL:
+                    wakeUp_ = now;
+                    last_ = now;
+                    break;
+                case TracePoint::RECEIVED:
+                    if (wakeUp_ != 0)
+                        record(LatencyStage::RECEIVE, now - last_);
+                    last_ = now;
+                    break;
+                case TracePoint::PARSED:
+                    record(LatencyStage::PARSE, now - last_);
+                    parsed_ = now;
+                    last_ = now;
+                    break;
+                case TracePoint::HANDLER_BEGIN:
+                    record(LatencyStage::DISPATCH, now - parsed_);
+                    if (wakeUp_ != 0)
+                        record(LatencyStage::WAKE_TO_HANDLER, now - wakeUp_);
+                    handlerBegin_ = now;
+                    break;
+                case TracePoint::HANDLER_END:
+                    record(LatencyStage::HANDLER, now - handlerBegin_);
+                    last_ = now;
+                    break;
+                case TracePoint::BATCH_BEGIN:
+                    batchBegin_ = now;
+                    break;
+                case TracePoint::BATCH_END:
+                    record(LatencyStage::BATCH_HANDLER, now - batchBegin_);
+                    last_ = now;
+                    break;
+            }
+        }
+
+        /// Gets the histogram of a stage
+        [[nodiscard]] const LatencyHistogram &histogram(LatencyStage stage) const noexcept {
+            return (*histograms_)[static_cast<std::size_t>(stage)];
+        }
+
+        /// Copies the histogram of a stage, with the values in nanoseconds. Any thread.
+        [[nodiscard]] HistogramSnapshot snapshot(LatencyStage stage) const {
+            return histogram(stage).snapshot(Clock_T::nanosPerTick());
+        }
+
+    private:
+        // allocated, since the atomic counters cannot be moved with the client
+        std::unique_ptr<std::array<LatencyHistogram, LATENCY_STAGE_COUNT>> histograms_;
+        std::uint64_t wakeUp_;
+        // the end of the previous stage of the receive path
+        std::uint64_t last_;
+        std::uint64_t parsed_;
+        std::uint64_t handlerBegin_;
+        std::uint64_t batchBegin_;
+
+        void record(LatencyStage stage, std::uint64_t duration) noexcept {
+            (*histograms_)[static_cast<std::size_t>(stage)].record(duration);
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_INSTRUMENTATION_HPP
@@ -0,0 +1,403 @@
+#ifndef WILDCAT_WS_LOOPBACK_HPP
+#define WILDCAT_WS_LOOPBACK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "client.hpp"
+#include "handshake.hpp"
+
+
+namespace wildcat::ws {
+
+    /// Non-blocking socket stream over one end of a connected socket pair, to run a Client in-process without a network
+    ///
+    /// `connect` does nothing: the stream is connected when it is constructed, so `Client::connect` only runs the
+    /// handshake, e.g. against a MockServer on the other end of the pair. The stream owns the file descriptor.
+    class LoopbackStream {
+    public:
+        explicit LoopbackStream(int fd) : fd_(fd), sendCalls_(0), recvCalls_(0) {
+            ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) | O_NONBLOCK);
+        }
+
+        LoopbackStream(const LoopbackStream &) = delete;
+
+        LoopbackStream &operator=(const LoopbackStream &) = delete;
+
+        ~LoopbackStream() {
+            disconnect();
+        }
+
+        [[nodiscard]] int fd() const noexcept {
+            return fd_;
+        }
+
+        void connect(const std::string &, std::uint16_t) {}
+
+        /// Returns the result of recv(2): -1 with errno set to EAGAIN when there is no data, 0 when the peer closed
+        /// the connection
+        ssize_t recvBytes(char *buffer, std::size_t length) {
+            ++recvCalls_;
+            return ::recv(fd_, buffer, length, 0);
+        }
+
+        ssize_t sendBytes(const char *buffer, std::size_t length) {
+            ++sendCalls_;
+            return ::send(fd_, buffer, length, MSG_NOSIGNAL);
+        }
+
+        ssize_t sendBytes(const struct iovec *iov, int iovcnt) {
+            ++sendCalls_;
+            // sendmsg rather than writev, which raises SIGPIPE when the peer closed the connection
+            struct msghdr msg{};
+            msg.msg_iov = const_cast<struct iovec *>(iov);
+            msg.msg_iovlen = static_cast<std::size_t>(iovcnt);
+            return ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+        }
+
+        void disconnect() {
+            if (fd_ != -1) {
+                ::close(fd_);
+                fd_ = -1;
+            }
+        }
+
+        /// Gets the number of calls made to send bytes
+        [[nodiscard]] std::size_t sendCalls() const noexcept {
+            return sendCalls_;
+        }
+
+        /// Gets the number of calls made to receive bytes
+        [[nodiscard]] std::size_t recvCalls() const noexcept {
+            return recvCalls_;
+        }
+
+    private:
+        int fd_;
+        std::size_t sendCalls_;
+        std::size_t recvCalls_;
+    };
+
+    /// Creates a connected pair of unix domain stream sockets
+    inline std::pair<int, int> makeSocketPair() {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw wildcat::net::IOError(errno, strerror(errno));
+        return {fds[0], fds[1]};
+    }
+
+    /// Creates a connected pair of TCP sockets over the loopback interface, for what a unix domain socket does not
+    /// have, e.g. segmentation and receive timestamps
+    inline std::pair<int, int> makeTcpLoopbackPair() {
+        const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLength = sizeof(addr);
+        if (listener == -1 || ::bind(listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1 ||
+            ::listen(listener, 1) == -1 ||
+            ::getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr), &addrLength) == -1) {
+            const auto error = errno;
+            if (listener != -1)
+                ::close(listener);
+            throw wildcat::net::IOError(error, strerror(error));
+        }
+
+        const int client = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (client == -1 || ::connect(client, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+            const auto error = errno;
+            ::close(listener);
+            if (client != -1)
+                ::close(client);
+            throw wildcat::net::IOError(error, strerror(error));
+        }
+        const int server = ::accept(listener, nullptr, nullptr);
+        const auto error = errno;
+        ::close(listener);
+        if (server == -1) {
+            ::close(client);
+            throw wildcat::net::IOError(error, strerror(error));
+        }
+        return {client, server};
+    }
+
+    /// Reads exactly `length` bytes from a blocking socket. Throws IOError on failure or when the peer closes first.
+    inline std::string readBytes(int fd, std::size_t length) {
+        std::string out(length, '\0');
+        std::size_t offset = 0;
+        while (offset < length) {
+            const auto n = ::recv(fd, out.data() + offset, length - offset, 0);
+            if (n == 0)
+                throw wildcat::net::IOError(ECONNRESET, "Connection closed by peer");
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw wildcat::net::IOError(errno, strerror(errno));
+            }
+            offset += n;
+        }
+        return out;
+    }
+
+    /// Message of a MockServer replay
+    struct ScriptedMessage {
+        OpCode opCode;
+        std::string payload;
+    };
+
+    /// How a MockServer replays its script
+    struct ReplayConfig {
+        /// messages per second, 0 to write as fast as the client reads
+        double messageRate = 0;
+        /// messages written back to back at each tick of the rate, e.g. the updates of a market data burst
+        std::size_t burstSize = 1;
+        /// largest payload of a frame, longer messages are sent in fragments. 0 to send every message in one frame.
+        std::size_t fragmentSize = 0;
+        /// bytes per send(2), so the client sees frames split across reads like segments of a TCP stream. 0 to send a
+        /// burst with a single call.
+        std::size_t chunkSize = 0;
+        /// number of times the script is replayed
+        std::size_t repeat = 1;
+        /// true to overwrite the first 8 bytes of each payload with the steady clock time of the send in nanoseconds,
+        /// to measure the latency of the receive path. Payloads shorter than 8 bytes are not stamped.
+        bool stampSendTime = false;
+    };
+
+    /// Scriptable websocket server on the other end of a socket pair, to exercise and measure a Client in-process
+    ///
+    /// The server answers the handshake, reads the frames the client sends and sends frames to the client, either
+    /// directly or by replaying a script of messages from a background thread at a configurable rate, fragmentation
+    /// and chunking. The direct calls and the replay must not send at the same time. The server owns the file
+    /// descriptor, which it makes blocking.
+    class MockServer {
+    public:
+        explicit MockServer(int fd) : fd_(fd), stop_(false), messagesSent_(0) {
+            ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) & ~O_NONBLOCK);
+        }
+
+        MockServer(const MockServer &) = delete;
+
+        MockServer &operator=(const MockServer &) = delete;
+
+        ~MockServer() {
+            // unblocks a replay waiting for the client to read
+            ::shutdown(fd_, SHUT_WR);
+            stop();
+            ::close(fd_);
+        }
+
+        [[nodiscard]] int fd() const noexcept {
+            return fd_;
+        }
+
+        /// Reads the upgrade request of the client and accepts it. Blocks until the request is complete.
+        ///
+        /// \param extensions value of the Sec-WebSocket-Extensions header of the response, empty to accept none
+        void acceptHandshake(const std::string &extensions = "") {
+            std::string request;
+            char buffer[1024];
+            while (request.find("\r\n\r\n") == std::string::npos) {
+                const auto n = ::recv(fd_, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    throw HandshakeError("Connection closed before the upgrade request was complete");
+                request.append(buffer, n);
+            }
+
+            static const std::string KEY_HEADER = "Sec-WebSocket-Key: ";
+            const auto keyBegin = request.find(KEY_HEADER);
+            if (keyBegin == std::string::npos)
+                throw HandshakeError("Upgrade request without Sec-WebSocket-Key");
+            const auto valueBegin = keyBegin + KEY_HEADER.size();
+            const auto key = request.substr(valueBegin, request.find("\r\n", valueBegin) - valueBegin);
+
+            auto response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                            "Sec-WebSocket-Accept: " + getAcceptKey(key) + "\r\n";
+            if (!extensions.empty())
+                response += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+            response += "\r\n";
+            write(response);
+        }
+
+        /// Appends the frames of a message, unmasked as a server sends them
+        ///
+        /// \param fragmentSize largest payload of a frame, longer messages are split in a first frame of `opCode`
+        /// followed by continuation frames. 0 to encode the message in one frame.
+        static void encode(std::string &out, OpCode opCode, std::string_view payload, std::size_t fragmentSize = 0) {
+            std::size_t offset = 0;
+            do {
+                const auto length = fragmentSize == 0 ? payload.size() - offset
+                                                      : std::min(fragmentSize, payload.size() - offset);
+                FrameHeader header{};
+                header.opCode = offset == 0 ? opCode : OpCode::CONTINUATION;
+                header.isFinal = offset + length == payload.size();
+                header.messageLength = length;
+
+                const auto begin = out.size();
+                out.resize(begin + MAX_FRAME_HEADER_LENGTH + length);
+                FrameWriter writer(reinterpret_cast<std::uint8_t *>(out.data() + begin), out.size() - begin);
+                writer.write(header, reinterpret_cast<const std::uint8_t *>(payload.data() + offset));
+                out.resize(begin + writer.frameLength());
+                offset += length;
+            } while (offset < payload.size());
+        }
+
+        /// Sends bytes to the client
+        ///
+        /// \param chunkSize bytes per send(2), 0 to send them with a single call
+        /// \param gap pause between two chunks
+        void write(std::string_view bytes, std::size_t chunkSize = 0,
+                   std::chrono::nanoseconds gap = std::chrono::nanoseconds::zero()) {
+            if (!writeChunks(bytes, chunkSize, gap))
+                throw wildcat::net::IOError(errno, strerror(errno));
+        }
+
+        /// Sends a message to the client
+        void sendMessage(OpCode opCode, std::string_view payload, std::size_t fragmentSize = 0,
+                         std::size_t chunkSize = 0) {
+            std::string frames;
+            encode(frames, opCode, payload, fragmentSize);
+            write(frames, chunkSize);
+        }
+
+        /// Reads a frame sent by the client and unmasks its payload. Blocks until the frame is complete.
+        std::pair<FrameHeader, std::string> readFrame() {
+            std::uint8_t header[MAX_FRAME_HEADER_LENGTH];
+            readInto(header, 2);
+            const auto lengthByte = header[1] & 0x7f;
+            const std::size_t headerLength = 2 + (lengthByte == 126 ? 2 : lengthByte == 127 ? 8 : 0) +
+                                             ((header[1] & 0x80) ? 4 : 0);
+            readInto(header + 2, headerLength - 2);
+
+            FrameHeader frameHeader{};
+            decodeFrameHeader(header, headerLength, frameHeader);
+            std::string payload(frameHeader.messageLength, '\0');
+            readInto(reinterpret_cast<std::uint8_t *>(payload.data()), payload.size());
+            if (frameHeader.mask) {
+                auto *data = reinterpret_cast<std::uint8_t *>(payload.data());
+                mask(data, data, payload.size(), frameHeader.maskKeys);
+            }
+            return {frameHeader, std::move(payload)};
+        }
+
+        /// Starts replaying a script from a background thread. Stops any replay still running first.
+        ///
+        /// Bursts of `config.burstSize` messages are encoded and sent at the scheduled time of their first message,
+        /// so a slow client sees the bursts queue up in the socket rather than the rate drop. The replay ends after
+        /// `config.repeat` rounds of the script, on `stop`, or when the client closes its end.
+        void replay(std::vector<ScriptedMessage> script, const ReplayConfig &config) {
+            stop();
+            stop_.store(false, std::memory_order_relaxed);
+            messagesSent_.store(0, std::memory_order_relaxed);
+            replayThread_ = std::thread([this, script = std::move(script), config]() { runReplay(script, config); });
+        }
+
+        /// Waits for the replay to end
+        void join() {
+            if (replayThread_.joinable())
+                replayThread_.join();
+        }
+
+        /// Stops the replay at the end of the current burst and waits for it to end
+        void stop() {
+            stop_.store(true, std::memory_order_relaxed);
+            join();
+        }
+
+        /// Gets the number of messages sent by the replay
+        [[nodiscard]] std::size_t messagesSent() const noexcept {
+            return messagesSent_.load(std::memory_order_relaxed);
+        }
+
+        /// Gets the steady clock time stamped by a replay with `ReplayConfig::stampSendTime`
+        static std::chrono::steady_clock::time_point sendTimeOf(const std::uint8_t *payload) noexcept {
+            std::int64_t nanos;
+            std::memcpy(&nanos, payload, sizeof(nanos));
+            return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(nanos));
+        }
+
+    private:
+        int fd_;
+        std::thread replayThread_;
+        std::atomic<bool> stop_;
+        std::atomic<std::size_t> messagesSent_;
+
+        void readInto(std::uint8_t *buffer, std::size_t length) {
+            const auto bytes = readBytes(fd_, length);
+            std::memcpy(buffer, bytes.data(), length);
+        }
+
+        /// Returns false when a send fails, e.g. once the client closed its end
+        bool writeChunks(std::string_view bytes, std::size_t chunkSize, std::chrono::nanoseconds gap) {
+            const auto step = chunkSize == 0 ? bytes.size() : chunkSize;
+            for (std::size_t offset = 0; offset < bytes.size(); offset += step) {
+                if (offset > 0 && gap > std::chrono::nanoseconds::zero())
+                    std::this_thread::sleep_for(gap);
+                const auto chunk = bytes.substr(offset, step);
+                std::size_t sent = 0;
+                while (sent < chunk.size()) {
+                    const auto n = ::send(fd_, chunk.data() + sent, chunk.size() - sent, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        return false;
+                    sent += n;
+                }
+            }
+            return true;
+        }
+
+        void runReplay(const std::vector<ScriptedMessage> &script, const ReplayConfig &config) {
+            if (script.empty())
+                return;
+            const auto burstSize = std::max<std::size_t>(config.burstSize, 1);
+            const auto total = config.repeat > SIZE_MAX / script.size() ? SIZE_MAX : script.size() * config.repeat;
+            const auto start = std::chrono::steady_clock::now();
+            std::string burst;
+            std::string payload;
+
+            for (std::size_t first = 0; first < total && !stop_.load(std::memory_order_relaxed); first += burstSize) {
+                if (config.messageRate > 0) {
+                    const auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(static_cast<double>(first) / config.messageRate));
+                    std::this_thread::sleep_until(due);
+                }
+
+                const auto last = std::min(first + burstSize, total);
+                const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+                burst.clear();
+                for (auto i = first; i < last; ++i) {
+                    const auto &message = script[i % script.size()];
+                    if (config.stampSendTime && message.payload.size() >= sizeof(now)) {
+                        payload = message.payload;
+                        std::memcpy(payload.data(), &now, sizeof(now));
+                        encode(burst, message.opCode, payload, config.fragmentSize);
+                    } else {
+                        encode(burst, message.opCode, message.payload, config.fragmentSize);
+                    }
+                }
+                if (!writeChunks(burst, config.chunkSize, std::chrono::nanoseconds::zero()))
+                    return;
+                messagesSent_.store(last, std::memory_order_relaxed);
+            }
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_LOOPBACK_HPP
@@ -0,0 +1,206 @@
+#ifndef WILDCAT_WS_MASK_HPP
+#define WILDCAT_WS_MASK_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WILDCAT_WS_MASK_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace wildcat::ws {
+
+    /*
+     * Masking of the payload is a XOR of each byte of the payload with the byte of the masking key at index i % 4 (see
+     * RFC 6455 section 5.3). The same operation is used to both mask and unmask the payload.
+     *
+     * The masking key is handled as a 32-bit word in native byte order, i.e. byte 0 of the word is the first byte of
+     * the masking key. Wider words are formed by repeating the 32-bit word, so byte j of any word always lines up with
+     * maskKeys[j & 0x3]. When a kernel skips ahead by n bytes the word is rotated so byte 0 lines up with
+     * maskKeys[n & 0x3].
+     */
+
+    namespace detail {
+
+        /// Signature of the masking kernels. `src` and `dst` may be the same pointer to mask in place.
+        typedef void (*mask_fn_t)(const std::uint8_t *src, std::uint8_t *dst, std::size_t length, std::uint32_t key);
+
+        /// Loads the masking key as a 32-bit word in native byte order
+        inline std::uint32_t loadMaskKey(const std::array<std::uint8_t, 4> &maskKeys) noexcept {
+            std::uint32_t key;
+            std::memcpy(&key, maskKeys.data(), sizeof(key));
+            return key;
+        }
+
+        /// Rotates the key so that byte 0 of the result lines up with the byte `n` positions further in the payload
+        inline std::uint32_t advanceMaskKey(std::uint32_t key, std::size_t n) noexcept {
+            const auto shift = static_cast<unsigned>(n & 0x3) * 8;
+            if (shift == 0)
+                return key;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return (key >> shift) | (key << (32 - shift));
+#else
+            return (key << shift) | (key >> (32 - shift));
+#endif
+        }
+
+        /// Reference implementation, one byte at a time
+        inline void maskScalar(const std::uint8_t *src, std::uint8_t *dst, std::size_t length,
+                               std::uint32_t key) noexcept {
+            std::uint8_t k[4];
+            std::memcpy(k, &key, sizeof(k));
+// When inlined where the length is computed, e.g. `v.size() - 1`, GCC assumes the length may wrap around and warns
+// that the loop writes past the end of `dst`, which it never does for a valid length
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstringop-overflow"
+#endif
+            for (std::size_t i = 0; i < length; ++i) {
+                // i & 0x3 result will always be in the range of [0, 3]
+                dst[i] = src[i] ^ k[i & 0x3];
+            }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+        }
+
+        /// Portable implementation, 64 bits at a time. Bytes up to the first 8 byte aligned address of `dst` and the
+        /// bytes after the last full word are handled one byte at a time.
+        inline void maskWord(const std::uint8_t *src, std::uint8_t *dst, std::size_t length,
+                             std::uint32_t key) noexcept {
+            std::size_t head = (8 - (reinterpret_cast<std::uintptr_t>(dst) & 0x7)) & 0x7;
+            if (head > length)
+                head = length;
+            maskScalar(src, dst, head, key);
+
+            src += head;
+            dst += head;
+            length -= head;
+            key = advanceMaskKey(key, head);
+
+            const std::uint64_t key64 = (static_cast<std::uint64_t>(key) << 32) | key;
+            std::size_t i = 0;
+            for (; i + 8 <= length; i += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, src + i, sizeof(word));
+                word ^= key64;
+                std::memcpy(dst + i, &word, sizeof(word));
+            }
+            // tail is shorter than a word so the key phase is unchanged since i is a multiple of 8
+            maskScalar(src + i, dst + i, length - i, key);
+        }
+
+#ifdef WILDCAT_WS_MASK_X86
+        /// SSE2 implementation, 16 bytes at a time
+        __attribute__((target("sse2")))
+        inline void maskSse2(const std::uint8_t *src, std::uint8_t *dst, std::size_t length,
+                             std::uint32_t key) noexcept {
+            const auto k = _mm_set1_epi32(static_cast<int>(key));
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(v, k));
+            }
+            maskWord(src + i, dst + i, length - i, key);
+        }
+
+        /// AVX2 implementation, 64 bytes per iteration
+        __attribute__((target("avx2")))
+        inline void maskAvx2(const std::uint8_t *src, std::uint8_t *dst, std::size_t length,
+                             std::uint32_t key) noexcept {
+            const auto k = _mm256_set1_epi32(static_cast<int>(key));
+            std::size_t i = 0;
+            for (; i + 64 <= length; i += 64) {
+                const auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                const auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 32));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(v0, k));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 32), _mm256_xor_si256(v1, k));
+            }
+            for (; i + 32 <= length; i += 32) {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(v, k));
+            }
+            maskWord(src + i, dst + i, length - i, key);
+        }
+
+        /// AVX-512 implementation, 128 bytes per iteration with a masked load/store for the tail
+        __attribute__((target("avx512f,avx512bw")))
+        inline void maskAvx512(const std::uint8_t *src, std::uint8_t *dst, std::size_t length,
+                               std::uint32_t key) noexcept {
+            const auto k = _mm512_set1_epi32(static_cast<int>(key));
+            std::size_t i = 0;
+            for (; i + 128 <= length; i += 128) {
+                const auto v0 = _mm512_loadu_si512(src + i);
+                const auto v1 = _mm512_loadu_si512(src + i + 64);
+                _mm512_storeu_si512(dst + i, _mm512_xor_si512(v0, k));
+                _mm512_storeu_si512(dst + i + 64, _mm512_xor_si512(v1, k));
+            }
+            for (; i + 64 <= length; i += 64) {
+                const auto v = _mm512_loadu_si512(src + i);
+                _mm512_storeu_si512(dst + i, _mm512_xor_si512(v, k));
+            }
+            const auto remaining = length - i;
+            if (remaining > 0) {
+                const __mmask64 m = (~0ULL) >> (64 - remaining);
+                const auto v = _mm512_maskz_loadu_epi8(m, src + i);
+                _mm512_mask_storeu_epi8(dst + i, m, _mm512_xor_si512(v, k));
+            }
+        }
+#endif
+
+        /// Selects the widest masking kernel supported by the cpu
+        ///
+        /// The AVX-512 kernel is only selected when WILDCAT_WS_MASK_AVX512 is defined. On the cpus measured so far
+        /// the AVX2 kernel is as fast or faster and does not risk lowering the clock frequency of the core.
+        inline mask_fn_t selectMaskImpl() noexcept {
+#ifdef WILDCAT_WS_MASK_X86
+            __builtin_cpu_init();
+#ifdef WILDCAT_WS_MASK_AVX512
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+                return &maskAvx512;
+#endif
+            if (__builtin_cpu_supports("avx2"))
+                return &maskAvx2;
+            if (__builtin_cpu_supports("sse2"))
+                return &maskSse2;
+#endif
+            return &maskWord;
+        }
+
+        /// Masking kernel chosen at runtime, resolved once during static initialization
+        inline const mask_fn_t maskImpl = selectMaskImpl();
+
+        /// Payloads shorter than this are masked inline rather than through the runtime selected kernel
+        constexpr std::size_t SMALL_MASK_LENGTH = 16;
+    }
+
+    /// Masks (or unmasks) `length` bytes from `src` into `dst` with the specified masking key
+    ///
+    /// \param src pointer to the beginning of the payload
+    /// \param dst pointer to the beginning of the output, may be equal to `src` to mask in place
+    /// \param length number of bytes to mask
+    /// \param maskKeys masking key
+    /// \param offset offset of `src` from the beginning of the payload, used to line up the masking key when a payload
+    /// is masked in several pieces
+    inline void mask(const std::uint8_t *src, std::uint8_t *dst, std::size_t length,
+                     const std::array<std::uint8_t, 4> &maskKeys, std::size_t offset = 0) noexcept {
+        const auto key = detail::advanceMaskKey(detail::loadMaskKey(maskKeys), offset);
+        if (length < detail::SMALL_MASK_LENGTH) {
+            detail::maskScalar(src, dst, length, key);
+        } else {
+            detail::maskImpl(src, dst, length, key);
+        }
+    }
+
+    /// Masks (or unmasks) `length` bytes in place with the specified masking key
+    inline void mask(std::uint8_t *buffer, std::size_t length, const std::array<std::uint8_t, 4> &maskKeys,
+                     std::size_t offset = 0) noexcept {
+        mask(buffer, buffer, length, maskKeys, offset);
+    }
+
+}
+
+#endif //WILDCAT_WS_MASK_HPP
@@ -0,0 +1,68 @@
+#ifndef WILDCAT_WS_MASK_KEY_HPP
+#define WILDCAT_WS_MASK_KEY_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+
+namespace wildcat::ws {
+
+    /// Generator of the mask keys of the frames sent by a client
+    ///
+    /// RFC 6455 requires a new key for each frame that the application cannot predict. The keys are taken from a
+    /// ChaCha20 keystream with a key and nonce drawn from the random generator of OpenSSL. The keystream is generated
+    /// in blocks of `KEYS_PER_BLOCK` keys, so a key costs a few nanoseconds and no allocation.
+    class MaskKeyGenerator {
+    public:
+        static constexpr std::size_t KEYS_PER_BLOCK = 256;
+
+        MaskKeyGenerator() : ctx_(EVP_CIPHER_CTX_new()), keystream_(), next_(keystream_.size()) {
+            // a 256 bit key, and a 32 bit block counter followed by a 96 bit nonce
+            std::array<unsigned char, 32> key{};
+            std::array<unsigned char, 16> iv{};
+            if (!ctx_ || RAND_bytes(key.data(), key.size()) != 1 || RAND_bytes(iv.data() + 4, iv.size() - 4) != 1 ||
+                EVP_EncryptInit_ex(ctx_.get(), EVP_chacha20(), nullptr, key.data(), iv.data()) != 1)
+                throw std::runtime_error("Failed to initialize the mask key generator");
+        }
+
+        /// Gets the key of the next frame
+        std::array<std::uint8_t, 4> next() {
+            if (next_ == keystream_.size())
+                refill();
+            std::array<std::uint8_t, 4> key;
+            std::memcpy(key.data(), keystream_.data() + next_, key.size());
+            next_ += key.size();
+            return key;
+        }
+
+    private:
+        struct CipherDeleter {
+            void operator()(EVP_CIPHER_CTX *ctx) const noexcept {
+                EVP_CIPHER_CTX_free(ctx);
+            }
+        };
+
+        std::unique_ptr<EVP_CIPHER_CTX, CipherDeleter> ctx_;
+        std::array<std::uint8_t, 4 * KEYS_PER_BLOCK> keystream_;
+        std::size_t next_;
+
+        void refill() {
+            // the keystream is the encryption of zeros, encrypted in place
+            keystream_.fill(0);
+            int length = 0;
+            if (EVP_EncryptUpdate(ctx_.get(), keystream_.data(), &length, keystream_.data(),
+                                  static_cast<int>(keystream_.size())) != 1 ||
+                static_cast<std::size_t>(length) != keystream_.size())
+                throw std::runtime_error("Failed to generate mask keys");
+            next_ = 0;
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_MASK_KEY_HPP
@@ -0,0 +1,206 @@
+#ifndef WILDCAT_WS_MIRRORED_BUFFER_HPP
+#define WILDCAT_WS_MIRRORED_BUFFER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wildcat/net/error.hpp>
+
+
+namespace wildcat::ws {
+
+    /// Ring buffer backed by virtual memory that maps the same physical pages twice, back to back
+    ///
+    /// Any region of up to `capacity()` bytes starting anywhere in the first mapping is contiguous in memory, so the
+    /// readable bytes and the writable space are always a single span even when they wrap around the end of the ring.
+    /// This removes the need to move a partially received frame to the front of the buffer.
+    class MirroredBuffer {
+    public:
+        /// Size of a huge page, the default huge page size on x86-64 and aarch64
+        static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        /// Constructs a mirrored buffer with at least `capacity` bytes, rounded up to a multiple of the page size
+        ///
+        /// \param capacity minimum capacity in bytes
+        /// \param hugePages true to back the buffer with huge pages, which saves TLB misses on large buffers. Falls
+        /// back to regular pages when no huge pages are available.
+        explicit MirroredBuffer(std::size_t capacity, bool hugePages = false)
+                : base_(nullptr), capacity_(0), head_(0), size_(0), hasHugePages_(false) {
+            if (hugePages && map(capacity, HUGE_PAGE_SIZE, MFD_HUGETLB) == 0) {
+                hasHugePages_ = true;
+                return;
+            }
+
+            const auto err = map(capacity, pageSize(), 0);
+            if (err != 0)
+                throw wildcat::net::IOError(err, strerror(err));
+        }
+
+        MirroredBuffer(const MirroredBuffer &) = delete;
+
+        MirroredBuffer &operator=(const MirroredBuffer &) = delete;
+
+        MirroredBuffer(MirroredBuffer &&other) noexcept
+                : base_(std::exchange(other.base_, nullptr)), capacity_(std::exchange(other.capacity_, 0)),
+                  head_(std::exchange(other.head_, 0)), size_(std::exchange(other.size_, 0)),
+                  hasHugePages_(std::exchange(other.hasHugePages_, false)) {}
+
+        MirroredBuffer &operator=(MirroredBuffer &&other) noexcept {
+            if (this != &other) {
+                release();
+                base_ = std::exchange(other.base_, nullptr);
+                capacity_ = std::exchange(other.capacity_, 0);
+                head_ = std::exchange(other.head_, 0);
+                size_ = std::exchange(other.size_, 0);
+                hasHugePages_ = std::exchange(other.hasHugePages_, false);
+            }
+            return *this;
+        }
+
+        ~MirroredBuffer() {
+            release();
+        }
+
+        /// Gets the capacity of the buffer
+        [[nodiscard]] std::size_t capacity() const noexcept {
+            return capacity_;
+        }
+
+        /// Gets true/false if the buffer is backed by huge pages
+        [[nodiscard]] bool hasHugePages() const noexcept {
+            return hasHugePages_;
+        }
+
+        /// Gets the number of readable bytes
+        [[nodiscard]] std::size_t size() const noexcept {
+            return size_;
+        }
+
+        /// Gets true/false if there are no readable bytes
+        [[nodiscard]] bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        /// Gets the number of bytes that can be written
+        [[nodiscard]] std::size_t available() const noexcept {
+            return capacity_ - size_;
+        }
+
+        /// Gets a pointer to the beginning of the readable bytes. `size()` bytes are contiguous from this pointer.
+        [[nodiscard]] std::uint8_t *readBegin() const noexcept {
+            return base_ + head_;
+        }
+
+        /// Gets a pointer to the beginning of the writable space. `available()` bytes are contiguous from this pointer.
+        [[nodiscard]] std::uint8_t *writeBegin() const noexcept {
+            return base_ + head_ + size_;
+        }
+
+        /// Gets a pointer to the beginning of the double mapping, e.g. to register the buffer with the kernel
+        [[nodiscard]] std::uint8_t *mappingBegin() const noexcept {
+            return base_;
+        }
+
+        /// Gets the length of the double mapping, i.e. twice the capacity
+        [[nodiscard]] std::size_t mappingLength() const noexcept {
+            return capacity_ * 2;
+        }
+
+        /// Marks `n` bytes written at `writeBegin()` as readable
+        void commit(std::size_t n) noexcept {
+            size_ += n;
+        }
+
+        /// Releases `n` bytes from the beginning of the readable bytes
+        void consume(std::size_t n) noexcept {
+            size_ -= n;
+            if (size_ == 0) {
+                // start over at the beginning of the mapping to keep reusing the same pages while they are hot
+                head_ = 0;
+            } else {
+                head_ += n;
+                if (head_ >= capacity_)
+                    head_ -= capacity_;
+            }
+        }
+
+        /// Discards all readable bytes
+        void clear() noexcept {
+            head_ = 0;
+            size_ = 0;
+        }
+
+    private:
+        std::uint8_t *base_;
+        std::size_t capacity_;
+        std::size_t head_;
+        std::size_t size_;
+        bool hasHugePages_;
+
+        static std::size_t pageSize() noexcept {
+            return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        }
+
+        /// Maps a memory file of at least `capacity` bytes twice, back to back, with pages of `pageSize` bytes
+        ///
+        /// Returns 0 on success, else the error number.
+        int map(std::size_t capacity, std::size_t pageSize, unsigned int memfdFlags) noexcept {
+            const auto length = capacity == 0 ? pageSize : (capacity + pageSize - 1) / pageSize * pageSize;
+            const auto fd = ::memfd_create("wildcat-ws", MFD_CLOEXEC | memfdFlags);
+            if (fd == -1)
+                return errno;
+
+            if (::ftruncate(fd, static_cast<off_t>(length)) == -1) {
+                const auto err = errno;
+                ::close(fd);
+                return err;
+            }
+
+            // reserve a contiguous range of address space for both mappings, with room to align it to the page size,
+            // then map the file over each half
+            const auto reservedLength = length * 2 + pageSize;
+            auto *addr = ::mmap(nullptr, reservedLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                                0);
+            if (addr == MAP_FAILED) {
+                const auto err = errno;
+                ::close(fd);
+                return err;
+            }
+
+            auto *reserved = static_cast<std::uint8_t *>(addr);
+            auto *base = reinterpret_cast<std::uint8_t *>(
+                    (reinterpret_cast<std::uintptr_t>(reserved) + pageSize - 1) / pageSize * pageSize);
+            if (base != reserved)
+                ::munmap(reserved, base - reserved);
+            if (base + length * 2 != reserved + reservedLength)
+                ::munmap(base + length * 2, reserved + reservedLength - (base + length * 2));
+
+            for (auto *half: {base, base + length}) {
+                if (::mmap(half, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                    const auto err = errno;
+                    ::munmap(base, length * 2);
+                    ::close(fd);
+                    return err;
+                }
+            }
+
+            // the mappings keep a reference to the memory file
+            ::close(fd);
+            base_ = base;
+            capacity_ = length;
+            return 0;
+        }
+
+        void release() noexcept {
+            if (base_ != nullptr) {
+                ::munmap(base_, capacity_ * 2);
+                base_ = nullptr;
+            }
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_MIRRORED_BUFFER_HPP
@@ -0,0 +1,317 @@
+#ifndef WILDCAT_WS_QUEUE_HPP
+#define WILDCAT_WS_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "wait_strategy.hpp"
+
+
+namespace wildcat::ws {
+
+    /// Size of a cache line. Indices written by different threads are kept on separate cache lines, so a write by one
+    /// thread does not evict the line the other thread is reading (false sharing).
+    constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    /// Bounded lock-free queue for a single producer thread and a single consumer thread
+    ///
+    /// Intended to hand messages from the thread polling the connection to a worker thread. The capacity is rounded up
+    /// to a power of two. Each side keeps a cached copy of the index of the other side and only reads the shared index
+    /// when the cached one says the queue is full or empty, so in the steady state the cache line of the other side is
+    /// not touched for every item. Batches are published and released with a single store.
+    ///
+    /// \tparam T item type, copied into preallocated slots
+    /// \tparam WaitStrategy_T how the blocking operations wait, see SpinWait, YieldWait and FutexWait
+    template<typename T, typename WaitStrategy_T = SpinWait>
+    class SpscQueue {
+    public:
+        explicit SpscQueue(std::size_t capacity)
+                : head_(0), cachedTail_(0), tail_(0), cachedHead_(0), notEmpty_(), notFull_(),
+                  mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1), slots_(mask_ + 1) {}
+
+        SpscQueue(const SpscQueue &) = delete;
+
+        SpscQueue &operator=(const SpscQueue &) = delete;
+
+        /// Gets the number of slots of the queue
+        [[nodiscard]] std::size_t capacity() const noexcept {
+            return mask_ + 1;
+        }
+
+        /// Gets the number of items in the queue. Only a snapshot when called while the other thread is active.
+        [[nodiscard]] std::size_t size() const noexcept {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        /// Gets true/false if the queue is empty. Only a snapshot when called while the other thread is active.
+        [[nodiscard]] bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        /// Pushes an item if there is room. Producer only.
+        bool tryPush(const T &item) {
+            return tryPushBatch(1, [&item](T &slot, std::size_t) { slot = item; }) == 1;
+        }
+
+        /// Pushes as many of the `n` items as there is room for and publishes them at once. Returns the number of
+        /// items pushed. Producer only.
+        std::size_t tryPushBatch(const T *items, std::size_t n) {
+            return tryPushBatch(n, [items](T &slot, std::size_t i) { slot = items[i]; });
+        }
+
+        /// Fills as many of `n` slots as there is room for in place with `fill(slot, i)` and publishes them at once.
+        /// Returns the number of slots filled. Producer only.
+        template<typename F>
+        std::size_t tryPushBatch(std::size_t n, F &&fill) {
+            const auto tail = tail_.load(std::memory_order_relaxed);
+            if (tail + n - cachedHead_ > capacity())
+                cachedHead_ = head_.load(std::memory_order_acquire);
+            n = std::min(n, capacity() - (tail - cachedHead_));
+            if (n == 0)
+                return 0;
+
+            for (std::size_t i = 0; i < n; ++i)
+                fill(slots_[(tail + i) & mask_], i);
+            tail_.store(tail + n, std::memory_order_release);
+            notEmpty_.notifyAll();
+            return n;
+        }
+
+        /// Pushes an item, waiting for room. Producer only.
+        void push(const T &item) {
+            notFull_.waitUntil([this, &item]() { return tryPush(item); });
+        }
+
+        /// Fills `n` slots in place with `fill(slot, i)`, waiting for room as needed. Producer only.
+        template<typename F>
+        void pushBatch(std::size_t n, F &&fill) {
+            std::size_t pushed = 0;
+            while (pushed < n) {
+                notFull_.waitUntil([&]() {
+                    const auto k = tryPushBatch(n - pushed, [&](T &slot, std::size_t i) { fill(slot, pushed + i); });
+                    pushed += k;
+                    return k > 0;
+                });
+            }
+        }
+
+        /// Pops an item if there is one. Consumer only.
+        bool tryPop(T &item) {
+            return consume([&item](T &slot) { item = std::move(slot); }, 1) == 1;
+        }
+
+        /// Calls `f(item)` on up to `maxItems` items in place and releases their slots at once. Returns the number of
+        /// items consumed. Consumer only.
+        template<typename F>
+        std::size_t consume(F &&f, std::size_t maxItems = SIZE_MAX) {
+            const auto head = head_.load(std::memory_order_relaxed);
+            if (cachedTail_ - head < maxItems)
+                cachedTail_ = tail_.load(std::memory_order_acquire);
+            const auto n = std::min(cachedTail_ - head, maxItems);
+            if (n == 0)
+                return 0;
+
+            for (std::size_t i = 0; i < n; ++i)
+                f(slots_[(head + i) & mask_]);
+            head_.store(head + n, std::memory_order_release);
+            notFull_.notifyAll();
+            return n;
+        }
+
+        /// Waits for at least one item, then consumes up to `maxItems` items like `consume`. Consumer only.
+        template<typename F>
+        std::size_t waitConsume(F &&f, std::size_t maxItems = SIZE_MAX) {
+            std::size_t n = 0;
+            notEmpty_.waitUntil([&]() {
+                n = consume(f, maxItems);
+                return n > 0;
+            });
+            return n;
+        }
+
+    private:
+        // written by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head_;
+        std::size_t cachedTail_;
+        // written by the producer
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail_;
+        std::size_t cachedHead_;
+        alignas(CACHE_LINE_SIZE) WaitStrategy_T notEmpty_;
+        alignas(CACHE_LINE_SIZE) WaitStrategy_T notFull_;
+        alignas(CACHE_LINE_SIZE) const std::size_t mask_;
+        std::vector<T> slots_;
+    };
+
+    /// Bounded lock-free queue for any number of producer and consumer threads
+    ///
+    /// Each slot carries a sequence number that tells whether it is free to fill or ready to consume for a given lap
+    /// of the ring (D. Vyukov's bounded MPMC queue). Producers and consumers claim slots with a compare-and-swap on
+    /// their index and then fill or drain them independently. With several consumer threads each item goes to one of
+    /// them, which spreads the messages of a connection over a pool of workers. Slots are padded to a cache line.
+    ///
+    /// \tparam T item type, copied into preallocated slots
+    /// \tparam WaitStrategy_T how the blocking operations wait, see SpinWait, YieldWait and FutexWait
+    template<typename T, typename WaitStrategy_T = SpinWait>
+    class MpmcQueue {
+    public:
+        explicit MpmcQueue(std::size_t capacity)
+                : enqueuePos_(0), dequeuePos_(0), notEmpty_(), notFull_(),
+                  mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+                  slots_(std::make_unique<Slot[]>(mask_ + 1)) {
+            for (std::size_t i = 0; i <= mask_; ++i)
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MpmcQueue(const MpmcQueue &) = delete;
+
+        MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+        /// Gets the number of slots of the queue
+        [[nodiscard]] std::size_t capacity() const noexcept {
+            return mask_ + 1;
+        }
+
+        /// Gets the approximate number of items in the queue
+        [[nodiscard]] std::size_t size() const noexcept {
+            const auto dequeuePos = dequeuePos_.load(std::memory_order_acquire);
+            const auto enqueuePos = enqueuePos_.load(std::memory_order_acquire);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        }
+
+        /// Pushes an item if there is room
+        bool tryPush(const T &item) {
+            return tryPushBatch(1, [&item](T &slot, std::size_t) { slot = item; }) == 1;
+        }
+
+        /// Pushes as many of the `n` items as there are consecutive free slots for. Returns the number of items pushed.
+        std::size_t tryPushBatch(const T *items, std::size_t n) {
+            return tryPushBatch(n, [items](T &slot, std::size_t i) { slot = items[i]; });
+        }
+
+        /// Claims up to `n` consecutive free slots with a single compare-and-swap, fills them in place with
+        /// `fill(slot, i)` and publishes them. Returns the number of slots filled. `fill` must not throw, a claimed slot
+        /// that is never published stalls the consumers.
+        template<typename F>
+        std::size_t tryPushBatch(std::size_t n, F &&fill) {
+            auto pos = enqueuePos_.load(std::memory_order_relaxed);
+            std::size_t k;
+            for (;;) {
+                // a slot is free for position pos when its sequence is pos
+                k = 0;
+                while (k < n && slot(pos + k).sequence.load(std::memory_order_acquire) == pos + k)
+                    ++k;
+                if (k == 0) {
+                    const auto diff = static_cast<std::intptr_t>(slot(pos).sequence.load(std::memory_order_acquire) -
+                                                                 pos);
+                    if (diff < 0 || n == 0)
+                        return 0;
+                    // another producer claimed the slot
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                } else if (enqueuePos_.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+
+            for (std::size_t i = 0; i < k; ++i) {
+                auto &s = slot(pos + i);
+                fill(s.item, i);
+                s.sequence.store(pos + i + 1, std::memory_order_release);
+            }
+            notEmpty_.notifyAll();
+            return k;
+        }
+
+        /// Pushes an item, waiting for room
+        void push(const T &item) {
+            notFull_.waitUntil([this, &item]() { return tryPush(item); });
+        }
+
+        /// Fills `n` slots in place with `fill(slot, i)`, waiting for room as needed. The items may be interleaved
+        /// with the items of other producers.
+        template<typename F>
+        void pushBatch(std::size_t n, F &&fill) {
+            std::size_t pushed = 0;
+            while (pushed < n) {
+                notFull_.waitUntil([&]() {
+                    const auto k = tryPushBatch(n - pushed, [&](T &slot, std::size_t i) { fill(slot, pushed + i); });
+                    pushed += k;
+                    return k > 0;
+                });
+            }
+        }
+
+        /// Pops an item if there is one
+        bool tryPop(T &item) {
+            return consume([&item](T &slot) { item = std::move(slot); }, 1) == 1;
+        }
+
+        /// Claims up to `maxItems` consecutive ready items with a single compare-and-swap and calls `f(item)` on each
+        /// of them in place. Returns the number of items consumed. `f` must not throw, a claimed slot that is never
+        /// released stalls the producers.
+        template<typename F>
+        std::size_t consume(F &&f, std::size_t maxItems = SIZE_MAX) {
+            auto pos = dequeuePos_.load(std::memory_order_relaxed);
+            std::size_t k;
+            for (;;) {
+                // an item is ready at position pos when the sequence of its slot is pos + 1
+                k = 0;
+                while (k < maxItems && slot(pos + k).sequence.load(std::memory_order_acquire) == pos + k + 1)
+                    ++k;
+                if (k == 0) {
+                    const auto diff = static_cast<std::intptr_t>(slot(pos).sequence.load(std::memory_order_acquire) -
+                                                                 (pos + 1));
+                    if (diff < 0 || maxItems == 0)
+                        return 0;
+                    // another consumer claimed the item
+                    pos = dequeuePos_.load(std::memory_order_relaxed);
+                } else if (dequeuePos_.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+
+            for (std::size_t i = 0; i < k; ++i) {
+                auto &s = slot(pos + i);
+                f(s.item);
+                // the slot is free for the producer one lap later
+                s.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+            }
+            notFull_.notifyAll();
+            return k;
+        }
+
+        /// Waits for at least one item, then consumes up to `maxItems` items like `consume`
+        template<typename F>
+        std::size_t waitConsume(F &&f, std::size_t maxItems = SIZE_MAX) {
+            std::size_t n = 0;
+            notEmpty_.waitUntil([&]() {
+                n = consume(f, maxItems);
+                return n > 0;
+            });
+            return n;
+        }
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) Slot {
+            std::atomic<std::size_t> sequence;
+            T item;
+        };
+
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> enqueuePos_;
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> dequeuePos_;
+        alignas(CACHE_LINE_SIZE) WaitStrategy_T notEmpty_;
+        alignas(CACHE_LINE_SIZE) WaitStrategy_T notFull_;
+        alignas(CACHE_LINE_SIZE) const std::size_t mask_;
+        std::unique_ptr<Slot[]> slots_;
+
+        Slot &slot(std::size_t pos) noexcept {
+            return slots_[pos & mask_];
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_QUEUE_HPP
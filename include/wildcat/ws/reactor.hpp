@@ -0,0 +1,144 @@
+#ifndef WILDCAT_WS_REACTOR_HPP
+#define WILDCAT_WS_REACTOR_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <wildcat/net/error.hpp>
+
+#include "client.hpp"
+
+
+namespace wildcat::ws {
+
+    /// How the reactor waits for connections to become ready
+    enum class WaitMode : std::uint8_t {
+        /// Checks for ready connections and returns immediately, intended to be called in a loop on a dedicated core
+        BUSY_POLL = 0,
+        /// Blocks until a connection is ready or the timeout expires
+        BLOCKING = 1
+    };
+
+    /// Dispatches frames for many clients from a single epoll set
+    ///
+    /// Clients are registered edge-triggered for both read and write readiness. When a client is readable it is read
+    /// until the stream is drained and its frames are dispatched to the handler. When it is writable its send queue is
+    /// drained. Only the clients that are ready are touched, so a round of polling is a single syscall regardless of
+    /// the number of clients. The streams of the clients must be non-blocking.
+    ///
+    /// A client whose connection is closed by the server or fails is closed with CloseCode::ABNORMAL by its read, so
+    /// its close handler reports it. It stays registered until it is removed.
+    template<class SocketStream_T>
+    class Reactor {
+    public:
+        using client_t = Client<SocketStream_T>;
+
+        /// Constructs a reactor
+        ///
+        /// \param waitMode how `poll` waits for ready connections
+        /// \param maxEvents maximum number of ready connections handled per call to `poll`
+        explicit Reactor(WaitMode waitMode = WaitMode::BLOCKING, int maxEvents = 256)
+                : epfd_(::epoll_create1(EPOLL_CLOEXEC)), waitMode_(waitMode), events_(maxEvents), next_(0), ready_(0),
+                  size_(0) {
+            if (epfd_ == -1)
+                throw wildcat::net::IOError(errno, strerror(errno));
+        }
+
+        Reactor(const Reactor &) = delete;
+
+        Reactor &operator=(const Reactor &) = delete;
+
+        ~Reactor() {
+            ::close(epfd_);
+        }
+
+        /// Registers the client. The client must outlive its registration.
+        void add(client_t *client) {
+            struct epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = client;
+            if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, client->fd(), &ev) == -1)
+                throw wildcat::net::IOError(errno, strerror(errno));
+            ++size_;
+        }
+
+        /// Removes the registration of the client
+        ///
+        /// May be called from the handler passed to `poll`, the events of the client not handled yet are dropped.
+        void remove(client_t *client) {
+            if (::epoll_ctl(epfd_, EPOLL_CTL_DEL, client->fd(), nullptr) == -1)
+                throw wildcat::net::IOError(errno, strerror(errno));
+            for (auto i = next_; i < ready_; ++i) {
+                if (events_[i].data.ptr == client)
+                    events_[i].data.ptr = nullptr;
+            }
+            --size_;
+        }
+
+        /// Gets the number of registered clients
+        [[nodiscard]] std::size_t size() const noexcept {
+            return size_;
+        }
+
+        /// Polls the registered clients and dispatches frames of the ready clients
+        ///
+        /// The clients are registered edge-triggered, so their readiness is reported only once. When reading a client
+        /// throws, e.g. ProtocolError or IOError, or the handler throws, the exception is passed on and the ready
+        /// clients not handled yet, the client that threw included, are handled by the next call before it waits for
+        /// new events. A client that keeps throwing should be removed. A client must not be destroyed while it is
+        /// registered, and so while it may still be pending from an earlier call.
+        ///
+        /// \param f handler called as `f(client, opCode, buffer, length)` for each complete frame
+        /// \param timeoutMillis maximum time to wait in blocking mode, -1 to wait indefinitely. Ignored in busy poll
+        /// mode.
+        /// \return number of ready clients handled
+        template<typename F>
+        int poll(F &&f, int timeoutMillis = -1) {
+            if (next_ == ready_) {
+                const auto timeout = waitMode_ == WaitMode::BUSY_POLL ? 0 : timeoutMillis;
+                const auto n = ::epoll_wait(epfd_, events_.data(), static_cast<int>(events_.size()), timeout);
+                if (n == -1) {
+                    if (errno == EINTR)
+                        return 0;
+                    throw wildcat::net::IOError(errno, strerror(errno));
+                }
+                next_ = 0;
+                ready_ = n;
+            }
+
+            const auto n = ready_ - next_;
+            for (; next_ < ready_; ++next_) {
+                auto *client = static_cast<client_t *>(events_[next_].data.ptr);
+                // removed by the handler
+                if (client == nullptr)
+                    continue;
+
+                const auto events = events_[next_].events;
+                if (events & EPOLLOUT)
+                    client->drainSendQueue();
+                if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    // reads until the stream is drained, closing the client when the read finds the connection
+                    // closed by the server or failed
+                    client->read([&f, client](OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                        f(*client, opCode, buffer, length);
+                    });
+                }
+            }
+            return n;
+        }
+
+    private:
+        int epfd_;
+        WaitMode waitMode_;
+        std::vector<struct epoll_event> events_;
+        // ready events not handled yet, [next_, ready_) of events_
+        int next_;
+        int ready_;
+        std::size_t size_;
+    };
+
+}
+
+#endif //WILDCAT_WS_REACTOR_HPP
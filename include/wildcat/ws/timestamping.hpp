@@ -0,0 +1,68 @@
+#ifndef WILDCAT_WS_TIMESTAMPING_HPP
+#define WILDCAT_WS_TIMESTAMPING_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <wildcat/net/error.hpp>
+
+
+namespace wildcat::ws {
+
+    /// Time at which the bytes of a read were received, as reported by the kernel with SO_TIMESTAMPING
+    ///
+    /// For TCP the kernel reports the timestamps of the last segment read, i.e. of the segment that completed the read.
+    /// A timestamp is 0 when it was not reported.
+    struct ReceiveTimestamp {
+        /// time the segment entered the network stack, since the epoch of CLOCK_REALTIME
+        std::chrono::nanoseconds software{0};
+        /// time the NIC received the segment, in the clock of the NIC (its PTP hardware clock). Only reported when
+        /// hardware receive timestamping is enabled on the interface, e.g. with the SIOCSHWTSTAMP ioctl.
+        std::chrono::nanoseconds hardware{0};
+    };
+
+    /// Enables software and, where supported, hardware receive timestamps on a socket. Throws IOError on failure.
+    inline void enableReceiveTimestamps(int fd) {
+        const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE |
+                          SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1)
+            throw wildcat::net::IOError(errno, strerror(errno));
+    }
+
+    /// Reads from a socket with recvmsg(2) and picks up the receive timestamp of the bytes read
+    ///
+    /// Returns the result of recvmsg(2). `timestamp` is reset when the read reports no timestamp.
+    inline ssize_t recvTimestamped(int fd, void *buffer, std::size_t length, ReceiveTimestamp &timestamp) noexcept {
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+        struct iovec iov{buffer, length};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        const auto n = ::recvmsg(fd, &msg, 0);
+        timestamp = ReceiveTimestamp{};
+        if (n <= 0)
+            return n;
+
+        for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                // ts[0] is the software timestamp, ts[1] is deprecated and ts[2] is the raw hardware timestamp
+                struct scm_timestamping ts{};
+                std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                timestamp.software = std::chrono::seconds(ts.ts[0].tv_sec) + std::chrono::nanoseconds(ts.ts[0].tv_nsec);
+                timestamp.hardware = std::chrono::seconds(ts.ts[2].tv_sec) + std::chrono::nanoseconds(ts.ts[2].tv_nsec);
+            }
+        }
+        return n;
+    }
+
+}
+
+#endif //WILDCAT_WS_TIMESTAMPING_HPP
@@ -0,0 +1,496 @@
+#ifndef WILDCAT_WS_URING_REACTOR_HPP
+#define WILDCAT_WS_URING_REACTOR_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <wildcat/net/error.hpp>
+
+#include "client.hpp"
+#include "reactor.hpp"
+
+
+namespace wildcat::ws {
+
+    /// Minimal io_uring submission and completion queue pair, using the raw system calls
+    class IoUring {
+    public:
+        /// Sets up an io_uring instance with at least `entries` submission queue entries
+        explicit IoUring(unsigned entries)
+                : fd_(-1), params_(), sqRing_(nullptr), sqRingLength_(0), cqRing_(nullptr), cqRingLength_(0),
+                  sqes_(nullptr), sqesLength_(0), sqeTail_(0) {
+            fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params_));
+            if (fd_ < 0)
+                throw wildcat::net::IOError(errno, strerror(errno));
+
+            sqRingLength_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+            cqRingLength_ = params_.cq_off.cqes + params_.cq_entries * sizeof(struct io_uring_cqe);
+            if (params_.features & IORING_FEAT_SINGLE_MMAP)
+                sqRingLength_ = cqRingLength_ = std::max(sqRingLength_, cqRingLength_);
+
+            sqRing_ = map(sqRingLength_, IORING_OFF_SQ_RING);
+            cqRing_ = (params_.features & IORING_FEAT_SINGLE_MMAP) ? sqRing_ : map(cqRingLength_, IORING_OFF_CQ_RING);
+            sqesLength_ = params_.sq_entries * sizeof(struct io_uring_sqe);
+            sqes_ = static_cast<struct io_uring_sqe *>(map(sqesLength_, IORING_OFF_SQES));
+
+            auto *sq = static_cast<std::uint8_t *>(sqRing_);
+            sqHead_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.head);
+            sqTail_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned *>(sq + params_.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.array);
+            sqeTail_ = *sqTail_;
+
+            auto *cq = static_cast<std::uint8_t *>(cqRing_);
+            cqHead_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned *>(cq + params_.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params_.cq_off.cqes);
+        }
+
+        IoUring(const IoUring &) = delete;
+
+        IoUring &operator=(const IoUring &) = delete;
+
+        ~IoUring() {
+            release();
+        }
+
+        /// Gets true/false if io_uring can be set up on this system
+        static bool isSupported() noexcept {
+            try {
+                IoUring ring(1);
+                return true;
+            } catch (const std::exception &) {
+                return false;
+            }
+        }
+
+        /// Gets the next free submission queue entry, cleared, or nullptr if the submission queue is full
+        struct io_uring_sqe *getSqe() noexcept {
+            const auto head = std::atomic_ref<unsigned>(*sqHead_).load(std::memory_order_acquire);
+            if (sqeTail_ - head >= params_.sq_entries)
+                return nullptr;
+            auto *sqe = &sqes_[sqeTail_ & sqMask_];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqArray_[sqeTail_ & sqMask_] = sqeTail_ & sqMask_;
+            ++sqeTail_;
+            return sqe;
+        }
+
+        /// Submits the pending entries and waits for at least `waitNr` completions in a single system call
+        ///
+        /// \param timeoutMillis maximum time to wait for the completions, -1 to wait indefinitely. Requires kernel
+        /// support for extended arguments, without it the call waits indefinitely.
+        int submit(unsigned waitNr = 0, int timeoutMillis = -1) {
+            const auto tail = std::atomic_ref<unsigned>(*sqTail_).load(std::memory_order_relaxed);
+            const auto toSubmit = sqeTail_ - tail;
+            std::atomic_ref<unsigned>(*sqTail_).store(sqeTail_, std::memory_order_release);
+            if (toSubmit == 0 && waitNr == 0)
+                return 0;
+
+            unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+            struct __kernel_timespec ts{};
+            struct io_uring_getevents_arg arg{};
+            const void *argp = nullptr;
+            std::size_t argLength = 0;
+            if (waitNr > 0 && timeoutMillis >= 0 && (params_.features & IORING_FEAT_EXT_ARG)) {
+                ts.tv_sec = timeoutMillis / 1000;
+                ts.tv_nsec = static_cast<long long>(timeoutMillis % 1000) * 1000000;
+                arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+                argp = &arg;
+                argLength = sizeof(arg);
+                flags |= IORING_ENTER_EXT_ARG;
+            }
+
+            const auto ret = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, toSubmit, waitNr, flags, argp,
+                                                        argLength));
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME)
+                throw wildcat::net::IOError(errno, strerror(errno));
+            return ret;
+        }
+
+        /// Calls `f` with each available completion and marks them as seen. Returns the number of completions.
+        ///
+        /// Each completion is marked as seen before `f` is called with a copy of it, so when `f` throws the completions
+        /// already handled are not handed out again.
+        template<typename F>
+        unsigned reap(F &&f) {
+            auto head = std::atomic_ref<unsigned>(*cqHead_).load(std::memory_order_relaxed);
+            const auto tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+            unsigned n = 0;
+            while (head != tail) {
+                const auto cqe = cqes_[head & cqMask_];
+                std::atomic_ref<unsigned>(*cqHead_).store(++head, std::memory_order_release);
+                ++n;
+                f(cqe);
+            }
+            return n;
+        }
+
+        /// Registers a sparse table of `n` fixed buffers. Returns false if the kernel does not support it.
+        bool registerBuffers(unsigned n) noexcept {
+            struct io_uring_rsrc_register reg{};
+            reg.nr = n;
+            reg.flags = IORING_RSRC_REGISTER_SPARSE;
+            return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) == 0;
+        }
+
+        /// Sets the fixed buffer at `index`, a null buffer clears the slot. Returns false on failure.
+        bool updateBuffer(unsigned index, void *base, std::size_t length) noexcept {
+            struct iovec iov{base, length};
+            struct io_uring_rsrc_update2 update{};
+            update.offset = index;
+            update.data = reinterpret_cast<std::uint64_t>(&iov);
+            update.nr = 1;
+            return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS_UPDATE, &update,
+                             sizeof(update)) == 1;
+        }
+
+    private:
+        int fd_;
+        struct io_uring_params params_;
+        void *sqRing_;
+        std::size_t sqRingLength_;
+        void *cqRing_;
+        std::size_t cqRingLength_;
+        struct io_uring_sqe *sqes_;
+        std::size_t sqesLength_;
+        unsigned *sqHead_{};
+        unsigned *sqTail_{};
+        unsigned sqMask_{};
+        unsigned *sqArray_{};
+        unsigned sqeTail_;
+        unsigned *cqHead_{};
+        unsigned *cqTail_{};
+        unsigned cqMask_{};
+        struct io_uring_cqe *cqes_{};
+
+        void *map(std::size_t length, off_t offset) {
+            auto *addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+            if (addr == MAP_FAILED) {
+                const auto err = errno;
+                release();
+                throw wildcat::net::IOError(err, strerror(err));
+            }
+            return addr;
+        }
+
+        void release() noexcept {
+            if (sqes_ != nullptr)
+                ::munmap(sqes_, sqesLength_);
+            if (cqRing_ != nullptr && cqRing_ != sqRing_)
+                ::munmap(cqRing_, cqRingLength_);
+            if (sqRing_ != nullptr)
+                ::munmap(sqRing_, sqRingLength_);
+            if (fd_ >= 0)
+                ::close(fd_);
+            sqes_ = nullptr;
+            cqRing_ = nullptr;
+            sqRing_ = nullptr;
+            fd_ = -1;
+        }
+    };
+
+    /// Dispatches frames for many clients, receiving through io_uring
+    ///
+    /// Each registered client has one read in flight that lands directly in the writable region of its receive buffer.
+    /// The receive buffers are registered as fixed buffers when the kernel supports it, which saves pinning and
+    /// unpinning the pages on every read. Completions of all clients are reaped in a batch and the reads are re-armed
+    /// with the same system call that waits for the next completions, so a round of polling is a single system call.
+    ///
+    /// io_uring reads the socket directly, bypassing the stream, so this reactor is only suited to plaintext streams.
+    /// Only the receive path goes through io_uring, sends still go through the stream. When io_uring is not available
+    /// the reactor falls back to the epoll Reactor.
+    ///
+    /// A client whose read finds the connection closed by the server or failed is closed with CloseCode::ABNORMAL, so
+    /// its close handler reports it, and is no longer read. It stays registered until it is removed.
+    template<class SocketStream_T>
+    class UringReactor {
+    public:
+        using client_t = Client<SocketStream_T>;
+
+        /// Constructs a reactor
+        ///
+        /// \param waitMode how `poll` waits for completions
+        /// \param maxClients maximum number of clients that can be registered at the same time
+        /// \param useUring false to use the epoll fallback even when io_uring is available
+        explicit UringReactor(WaitMode waitMode = WaitMode::BLOCKING, unsigned maxClients = 256, bool useUring = true)
+                : waitMode_(waitMode), ring_(), fallback_(), slots_(maxClients), hasFixedBuffers_(false),
+                  hasDeferred_(false), size_(0) {
+            if (useUring) {
+                try {
+                    ring_.emplace(maxClients);
+                    hasFixedBuffers_ = ring_->registerBuffers(maxClients);
+                } catch (const wildcat::net::IOError &) {
+                    ring_.reset();
+                }
+            }
+            if (!ring_)
+                fallback_.emplace(waitMode, static_cast<int>(maxClients));
+        }
+
+        /// Gets true/false if the reactor receives through io_uring rather than the epoll fallback
+        [[nodiscard]] bool isUringEnabled() const noexcept {
+            return ring_.has_value();
+        }
+
+        /// Gets true/false if the receive buffers are registered with io_uring as fixed buffers
+        [[nodiscard]] bool hasFixedBuffers() const noexcept {
+            return hasFixedBuffers_;
+        }
+
+        /// Registers the client. The client must outlive its registration and must not be read by other means while
+        /// registered.
+        void add(client_t *client) {
+            if (fallback_) {
+                fallback_->add(client);
+                ++size_;
+                return;
+            }
+
+            unsigned index = 0;
+            while (index < slots_.size() && slots_[index].client != nullptr)
+                ++index;
+            if (index == slots_.size())
+                throw std::runtime_error("Too many clients registered with the reactor");
+
+            auto &slot = slots_[index];
+            slot.client = client;
+            arm(index);
+            ring_->submit();
+            ++size_;
+        }
+
+        /// Removes the registration of the client
+        void remove(client_t *client) {
+            if (fallback_) {
+                fallback_->remove(client);
+                --size_;
+                return;
+            }
+
+            for (unsigned index = 0; index < slots_.size(); ++index) {
+                auto &slot = slots_[index];
+                if (slot.client != client)
+                    continue;
+
+                if (slot.isArmed) {
+                    // cancel the read in flight and wait until it completes so the kernel no longer writes to the
+                    // receive buffer of the client
+                    auto *sqe = nextSqe();
+                    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                    sqe->addr = userData(index, slot.generation);
+                    sqe->user_data = CANCEL_USER_DATA;
+                    while (slot.isArmed) {
+                        ring_->submit(1);
+                        ring_->reap([this, index](const struct io_uring_cqe &cqe) { defer(cqe, index); });
+                    }
+                }
+                if (slot.isFixed)
+                    ring_->updateBuffer(index, nullptr, 0);
+                slot = Slot{};
+                --size_;
+                return;
+            }
+        }
+
+        /// Gets the number of registered clients
+        [[nodiscard]] std::size_t size() const noexcept {
+            return size_;
+        }
+
+        /// Polls the registered clients and dispatches frames of the clients with completed reads
+        ///
+        /// \param f handler called as `f(client, opCode, buffer, length)` for each complete frame
+        /// \param timeoutMillis maximum time to wait in blocking mode, -1 to wait indefinitely. Ignored in busy poll
+        /// mode.
+        /// \return number of completed reads
+        template<typename F>
+        int poll(F &&f, int timeoutMillis = -1) {
+            if (fallback_)
+                return fallback_->poll(f, timeoutMillis);
+
+            // dispatch the frames of reads that completed while a client was being removed. When one throws, the others
+            // are handled by the next call.
+            int n = 0;
+            if (hasDeferred_) {
+                for (auto &slot: slots_) {
+                    if (slot.client != nullptr && slot.isDeferred) {
+                        slot.isDeferred = false;
+                        ++n;
+                        finishRead(static_cast<unsigned>(&slot - slots_.data()), slot.deferredResult, 0, f);
+                    }
+                }
+                hasDeferred_ = false;
+            }
+
+            // submit the reads re-armed by the previous call and wait for completions in one system call
+            const auto shouldWait = waitMode_ == WaitMode::BLOCKING && timeoutMillis != 0 && size_ > 0 && n == 0;
+            ring_->submit(shouldWait ? 1 : 0, timeoutMillis);
+            n += static_cast<int>(ring_->reap([this, &f](const struct io_uring_cqe &cqe) { complete(cqe, f); }));
+            return n;
+        }
+
+    private:
+        static constexpr std::uint64_t CANCEL_USER_DATA = ~0ULL;
+
+        struct Slot {
+            client_t *client = nullptr;
+            std::uint32_t generation = 0;
+            bool isFixed = false;
+            const std::uint8_t *fixedBase = nullptr;
+            bool isArmed = false;
+            bool isDeferred = false;
+            // result of the deferred read, its bytes are already committed to the receive buffer
+            int deferredResult = 0;
+        };
+
+        WaitMode waitMode_;
+        std::optional<IoUring> ring_;
+        std::optional<Reactor<SocketStream_T>> fallback_;
+        std::vector<Slot> slots_;
+        bool hasFixedBuffers_;
+        bool hasDeferred_;
+        std::size_t size_;
+
+        static std::uint64_t userData(unsigned index, std::uint32_t generation) noexcept {
+            return (static_cast<std::uint64_t>(generation) << 32) | index;
+        }
+
+        struct io_uring_sqe *nextSqe() {
+            auto *sqe = ring_->getSqe();
+            while (sqe == nullptr) {
+                // submission queue is full, hand the entries to the kernel to make room
+                ring_->submit();
+                sqe = ring_->getSqe();
+            }
+            return sqe;
+        }
+
+        /// Queues a read into the writable region of the receive buffer of the client in the slot
+        ///
+        /// The client leaves room in the buffer after dispatching the frames received, so a full buffer throws
+        /// std::runtime_error rather than leave the client without a read.
+        void arm(unsigned index) {
+            auto &slot = slots_[index];
+            auto &rxBuf = slot.client->receiveBuffer();
+            if (rxBuf.available() == 0)
+                throw std::runtime_error("Receive buffer is full");
+
+            if (hasFixedBuffers_ && slot.fixedBase != rxBuf.mappingBegin()) {
+                // register the double mapping so any writable region of the ring is inside the fixed buffer. The
+                // client replaces its buffer when it grows or shrinks, so this is repeated for the new buffer.
+                slot.isFixed = ring_->updateBuffer(index, rxBuf.mappingBegin(), rxBuf.mappingLength());
+                slot.fixedBase = rxBuf.mappingBegin();
+            }
+
+            auto *sqe = nextSqe();
+            sqe->opcode = slot.isFixed ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+            sqe->fd = slot.client->fd();
+            sqe->addr = reinterpret_cast<std::uint64_t>(rxBuf.writeBegin());
+            sqe->len = static_cast<std::uint32_t>(std::min<std::size_t>(rxBuf.available(), UINT32_MAX));
+            if (slot.isFixed)
+                sqe->buf_index = static_cast<std::uint16_t>(index);
+            sqe->user_data = userData(index, ++slot.generation);
+            slot.isArmed = true;
+        }
+
+        /// Gets the slot of the completion, or nullptr if the completion is stale or not for a read
+        Slot *slotOf(const struct io_uring_cqe &cqe) noexcept {
+            if (cqe.user_data == CANCEL_USER_DATA)
+                return nullptr;
+
+            const auto index = static_cast<unsigned>(cqe.user_data & 0xffffffff);
+            const auto generation = static_cast<std::uint32_t>(cqe.user_data >> 32);
+            auto &slot = slots_[index];
+            if (slot.client == nullptr || slot.generation != generation)
+                return nullptr;
+            return &slot;
+        }
+
+        static bool shouldRearm(int res) noexcept {
+            // not when the peer closed the connection or the read failed
+            return res > 0 || res == -EAGAIN || res == -EINTR;
+        }
+
+        template<typename F>
+        static void dispatch(client_t *client, std::size_t n, F &f) {
+            client->commitReceived(n, [&f, client](OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                f(*client, opCode, buffer, length);
+            });
+        }
+
+        /// Handles a completion, dispatching the frames received and re-arming the read
+        template<typename F>
+        void complete(const struct io_uring_cqe &cqe, F &f) {
+            auto *slot = slotOf(cqe);
+            if (slot == nullptr)
+                return;
+            slot->isArmed = false;
+            finishRead(static_cast<unsigned>(slot - slots_.data()), cqe.res,
+                       cqe.res > 0 ? static_cast<std::size_t>(cqe.res) : 0, f);
+        }
+
+        /// Dispatches the frames of a read of the client in the slot that completed with `res`, of which `n` bytes are
+        /// not committed to the receive buffer yet, then re-arms the read
+        ///
+        /// When the read found the connection closed by the server or failed, the client is closed with
+        /// CloseCode::ABNORMAL instead, see `Client::commitClosed`.
+        template<typename F>
+        void finishRead(unsigned index, int res, std::size_t n, F &f) {
+            auto *client = slots_[index].client;
+            if (res > 0) {
+                try {
+                    dispatch(client, n, f);
+                } catch (...) {
+                    // the client is not left without a read when it or the handler throws
+                    arm(index);
+                    throw;
+                }
+            }
+
+            if (shouldRearm(res))
+                arm(index);
+            else
+                client->commitClosed(-res);
+        }
+
+        /// Handles a completion while the client in slot `removing` is being removed, without a handler at hand
+        ///
+        /// The bytes received are kept in the receive buffer. For the other clients the frames are dispatched, and the
+        /// read re-armed, by the next call to `poll`.
+        void defer(const struct io_uring_cqe &cqe, unsigned removing) {
+            auto *slot = slotOf(cqe);
+            if (slot == nullptr)
+                return;
+            slot->isArmed = false;
+
+            if (cqe.res > 0)
+                slot->client->receiveBuffer().commit(static_cast<std::size_t>(cqe.res));
+
+            const auto index = static_cast<unsigned>(slot - slots_.data());
+            if (index != removing) {
+                if (cqe.res > 0 || !shouldRearm(cqe.res)) {
+                    // re-armed by the next poll once the frames are dispatched: dispatching moves the writable region
+                    // of the buffer, which a read in flight would not follow, and makes room in a full buffer. A
+                    // closed or failed connection is also reported by the next poll.
+                    slot->isDeferred = true;
+                    slot->deferredResult = cqe.res;
+                    hasDeferred_ = true;
+                } else {
+                    arm(index);
+                }
+            }
+        }
+    };
+
+}
+
+#endif //WILDCAT_WS_URING_REACTOR_HPP
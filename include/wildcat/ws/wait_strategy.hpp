@@ -0,0 +1,112 @@
+#ifndef WILDCAT_WS_WAIT_STRATEGY_HPP
+#define WILDCAT_WS_WAIT_STRATEGY_HPP
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace wildcat::ws {
+
+    /// Hints the CPU that the thread is spinning, which saves power and frees the core's resources for a sibling
+    /// hyper-thread
+    inline void cpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    // A wait strategy decides how a thread waits for a condition that another thread makes true, e.g. a consumer
+    // waiting for a queue to become non-empty. `waitUntil(ready)` returns as soon as `ready()` returns true, and the
+    // other thread calls `notifyAll()` after each change that can make it true. `ready()` may act on the condition, e.g.
+    // pop an item, so it is never called again after it returned true. Each strategy trades latency for CPU.
+
+    /// Spins on the condition. The lowest latency, at the cost of a core that is always busy.
+    struct SpinWait {
+        template<typename F>
+        void waitUntil(F &&ready) noexcept(noexcept(ready())) {
+            while (!ready())
+                cpuRelax();
+        }
+
+        void notifyAll() noexcept {}
+    };
+
+    /// Spins on the condition for a while, then yields the core to other threads between checks
+    struct YieldWait {
+        /// number of checks before the first yield
+        static constexpr int SPIN_COUNT = 100;
+
+        template<typename F>
+        void waitUntil(F &&ready) noexcept(noexcept(ready())) {
+            for (int i = 0; !ready(); ++i) {
+                if (i < SPIN_COUNT) {
+                    cpuRelax();
+                } else {
+                    ::sched_yield();
+                }
+            }
+        }
+
+        void notifyAll() noexcept {}
+    };
+
+    /// Spins on the condition for a while, then sleeps on a futex until notified
+    ///
+    /// The waiting thread uses no CPU while asleep, at the cost of a system call to wake it. The notifying thread only
+    /// makes the system call when a thread is asleep, otherwise a notification is an atomic increment.
+    class FutexWait {
+    public:
+        /// number of checks before going to sleep
+        static constexpr int SPIN_COUNT = 100;
+
+        FutexWait() noexcept: epoch_(0), waiters_(0) {}
+
+        template<typename F>
+        void waitUntil(F &&ready) {
+            for (int i = 0; i < SPIN_COUNT; ++i) {
+                if (ready())
+                    return;
+                cpuRelax();
+            }
+
+            for (;;) {
+                // a notification after the epoch is read changes it, so the futex does not sleep through it
+                const auto epoch = epoch_.load();
+                if (ready())
+                    return;
+                // checked again once registered as a waiter, a notification before that may not have seen the waiter
+                waiters_.fetch_add(1);
+                const auto isReady = ready();
+                if (!isReady)
+                    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&epoch_), FUTEX_WAIT_PRIVATE, epoch,
+                              nullptr, nullptr, 0);
+                waiters_.fetch_sub(1);
+                if (isReady)
+                    return;
+            }
+        }
+
+        void notifyAll() noexcept {
+            epoch_.fetch_add(1);
+            if (waiters_.load() > 0)
+                ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&epoch_), FUTEX_WAKE_PRIVATE, INT_MAX,
+                          nullptr, nullptr, 0);
+        }
+
+    private:
+        static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+        std::atomic<std::uint32_t> epoch_;
+        std::atomic<std::uint32_t> waiters_;
+    };
+
+}
+
+#endif //WILDCAT_WS_WAIT_STRATEGY_HPP
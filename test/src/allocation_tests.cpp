@@ -0,0 +1,256 @@
+#include <cstdlib>
+#include <new>
+#include <wildcat/ws/client.hpp>
+#include <wildcat/ws/loopback.hpp>
+#include "gtest/gtest.h"
+
+/*
+ * Counts the heap allocations of the thread that enables counting, through operator new and through malloc, calloc and
+ * realloc, which are replaced by wrappers around the allocator of glibc.
+ */
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+
+    thread_local bool isCounting = false;
+    thread_local std::size_t allocations = 0;
+
+    void countAllocation() noexcept {
+        if (isCounting)
+            ++allocations;
+    }
+
+    /// Counts the allocations of the current thread while in scope
+    class AllocationCounter {
+    public:
+        AllocationCounter() noexcept: start_(allocations) {
+            isCounting = true;
+        }
+
+        ~AllocationCounter() {
+            isCounting = false;
+        }
+
+        [[nodiscard]] std::size_t count() const noexcept {
+            return allocations - start_;
+        }
+
+    private:
+        std::size_t start_;
+    };
+
+}
+
+extern "C" {
+void *malloc(std::size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) {
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, std::size_t size) {
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+}
+
+void *operator new(std::size_t size) {
+    countAllocation();
+    if (auto *ptr = __libc_malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    countAllocation();
+    if (auto *ptr = __libc_memalign(static_cast<std::size_t>(alignment), size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    __libc_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    __libc_free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    __libc_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+    __libc_free(ptr);
+}
+
+namespace {
+
+    using wildcat::ws::LoopbackStream;
+    using wildcat::ws::MockServer;
+    using wildcat::ws::OpCode;
+    using client_t = wildcat::ws::Client<LoopbackStream>;
+
+    /// Frames of a burst from the server: messages of several sizes, a fragmented message with a ping in between
+    std::string makeBurst() {
+        std::string burst;
+        for (std::size_t length: {1, 100, 1000, 20000})
+            MockServer::encode(burst, OpCode::BINARY, std::string(length, 'x'));
+        MockServer::encode(burst, OpCode::TEXT, "abc");
+        MockServer::encode(burst, OpCode::PING, "ping");
+        MockServer::encode(burst, OpCode::TEXT, std::string(5000, 'y'), 1000);
+        return burst;
+    }
+
+    constexpr std::size_t MESSAGES_PER_BURST = 6;
+
+    /// Sends bursts to the client and polls them, then sends messages of each kind
+    template<typename Poll>
+    void exchange(client_t &client, MockServer &server, const std::string &burst, Poll &&poll) {
+        // created by the first round
+        static const std::string text(200, 't');
+        static const std::vector<std::byte> binary(300, std::byte{0x42});
+        for (int i = 0; i < 10; ++i) {
+            server.write(burst);
+            std::size_t messages = 0;
+            while (messages < MESSAGES_PER_BURST)
+                messages += poll();
+
+            client.send(text);
+            client.send(std::span<const std::byte>(binary));
+            client.append(text);
+            client.append(std::span<const std::byte>(binary));
+            client.flush();
+        }
+    }
+
+    void drain(MockServer &server, std::size_t frames) {
+        for (std::size_t i = 0; i < frames; ++i)
+            server.readFrame();
+    }
+
+    TEST(AllocationTests, CounterCountsAllocations) {
+        AllocationCounter counter;
+        auto *p = new int(1);
+        delete p;
+        auto *q = std::malloc(16);
+        std::free(q);
+        std::string s(100, 'x');
+        EXPECT_EQ(counter.count(), 3);
+    }
+
+    TEST(AllocationTests, SteadyStatePollAndSend) {
+        for (const auto mode: {wildcat::ws::ReceiveMode::POLL, wildcat::ws::ReceiveMode::RECV_FIRST}) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            MockServer server(serverFd);
+            wildcat::ws::Config config;
+            config.receiveMode = mode;
+            client_t client(std::make_unique<LoopbackStream>(clientFd), config);
+            const auto burst = makeBurst();
+
+            std::size_t messages = 0;
+            auto poll = [&client, &messages]() {
+                messages = 0;
+                client.poll([&messages](OpCode, const std::uint8_t *, std::size_t) { ++messages; });
+                return messages;
+            };
+
+            // the first round grows the buffers of the client to their steady state size
+            exchange(client, server, burst, poll);
+            // 4 messages and a pong per round
+            drain(server, 50);
+
+            std::size_t count;
+            {
+                AllocationCounter counter;
+                exchange(client, server, burst, poll);
+                count = counter.count();
+            }
+            EXPECT_EQ(count, 0);
+            drain(server, 50);
+        }
+    }
+
+    TEST(AllocationTests, SteadyStatePollBatch) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        MockServer server(serverFd);
+        client_t client(std::make_unique<LoopbackStream>(clientFd));
+        const auto burst = makeBurst();
+
+        std::size_t messages = 0;
+        auto poll = [&client, &messages]() {
+            messages = 0;
+            client.pollBatch([&messages](std::span<const wildcat::ws::FrameDescriptor> batch) {
+                messages += batch.size();
+            });
+            return messages;
+        };
+
+        exchange(client, server, burst, poll);
+        drain(server, 50);
+
+        std::size_t count;
+        {
+            AllocationCounter counter;
+            exchange(client, server, burst, poll);
+            count = counter.count();
+        }
+        EXPECT_EQ(count, 0);
+        drain(server, 50);
+    }
+
+    TEST(AllocationTests, MessageHandlerRef) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        MockServer server(serverFd);
+        client_t client(std::make_unique<LoopbackStream>(clientFd));
+        const auto burst = makeBurst();
+
+        std::size_t messages = 0;
+        auto counting = [&messages](OpCode, const std::uint8_t *, std::size_t) { ++messages; };
+        // a type erased handler, e.g. to choose the handler at run time without a template
+        const wildcat::ws::message_handler_t handler(counting);
+        auto poll = [&client, &handler, &messages]() {
+            const auto before = messages;
+            client.poll(handler);
+            return messages - before;
+        };
+
+        exchange(client, server, burst, poll);
+        drain(server, 50);
+
+        std::size_t count;
+        {
+            AllocationCounter counter;
+            exchange(client, server, burst, poll);
+            count = counter.count();
+        }
+        EXPECT_EQ(count, 0);
+        EXPECT_EQ(messages, 20 * MESSAGES_PER_BURST);
+        drain(server, 50);
+    }
+
+    TEST(AllocationTests, MaskKeyRefill) {
+        wildcat::ws::MaskKeyGenerator generator;
+        generator.next();
+        AllocationCounter counter;
+        for (std::size_t i = 0; i < 4 * wildcat::ws::MaskKeyGenerator::KEYS_PER_BLOCK; ++i)
+            generator.next();
+        EXPECT_EQ(counter.count(), 0);
+    }
+
+}
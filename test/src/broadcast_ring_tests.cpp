@@ -0,0 +1,252 @@
+#include <thread>
+#include <wildcat/ws/broadcast_ring.hpp>
+#include <wildcat/ws/handoff.hpp>
+#include <wildcat/ws/loopback.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using wildcat::ws::BroadcastRing;
+    using wildcat::ws::FutexWait;
+    using wildcat::ws::SlowConsumerPolicy;
+    using wildcat::ws::YieldWait;
+
+    std::vector<int> consumeAll(BroadcastRing<int>::Consumer &consumer, std::size_t maxItems = SIZE_MAX) {
+        std::vector<int> items;
+        consumer.consume([&items](const int &item) { items.push_back(item); }, maxItems);
+        return items;
+    }
+
+    TEST(BroadcastRingTests, FanOut) {
+        BroadcastRing<int> ring(3, 2);
+        EXPECT_EQ(ring.capacity(), 4);
+
+        ring.push(-1);
+        // a consumer only reads what is published after it subscribed
+        auto first = ring.subscribe();
+        auto second = ring.subscribe();
+        EXPECT_THROW(ring.subscribe(), std::length_error);
+
+        ring.pushBatch(3, [](int &slot, std::size_t i) { slot = static_cast<int>(i); });
+        EXPECT_EQ(consumeAll(first, 2), (std::vector<int>{0, 1}));
+        EXPECT_EQ(consumeAll(second), (std::vector<int>{0, 1, 2}));
+
+        // wraps around the end of the ring, each consumer at its own pace
+        ring.pushBatch(2, [](int &slot, std::size_t i) { slot = 3 + static_cast<int>(i); });
+        EXPECT_EQ(consumeAll(first), (std::vector<int>{2, 3, 4}));
+        EXPECT_EQ(consumeAll(second), (std::vector<int>{3, 4}));
+        EXPECT_TRUE(consumeAll(first).empty());
+
+        // both consumers read the same slot
+        const int *firstItem = nullptr;
+        const int *secondItem = nullptr;
+        ring.push(5);
+        first.consume([&firstItem](const int &item) { firstItem = &item; });
+        second.consume([&secondItem](const int &item) { secondItem = &item; });
+        EXPECT_EQ(firstItem, secondItem);
+
+        // an unsubscribed consumer frees its place
+        {
+            auto moved = std::move(second);
+        }
+        auto third = ring.subscribe();
+        ring.push(6);
+        EXPECT_EQ(consumeAll(third), (std::vector<int>{6}));
+        EXPECT_EQ(first.dropped(), 0);
+        EXPECT_FALSE(first.isDisconnected());
+    }
+
+    TEST(BroadcastRingTests, DropSlowConsumer) {
+        BroadcastRing<int> ring(4, 2, SlowConsumerPolicy::DROP);
+        auto fast = ring.subscribe();
+        auto slow = ring.subscribe();
+
+        for (int i = 0; i < 10; ++i) {
+            ring.push(i);
+            EXPECT_EQ(consumeAll(fast), (std::vector<int>{i}));
+        }
+
+        // lapped when the producer needed its slot, after 4 items, then skips to the newest item
+        EXPECT_TRUE(consumeAll(slow).empty());
+        EXPECT_EQ(slow.dropped(), 10);
+        EXPECT_FALSE(slow.isDisconnected());
+
+        ring.pushBatch(2, [](int &slot, std::size_t i) { slot = 10 + static_cast<int>(i); });
+        EXPECT_EQ(consumeAll(slow), (std::vector<int>{10, 11}));
+        EXPECT_EQ(consumeAll(fast), (std::vector<int>{10, 11}));
+    }
+
+    TEST(BroadcastRingTests, DisconnectSlowConsumer) {
+        BroadcastRing<int> ring(4, 2, SlowConsumerPolicy::DISCONNECT);
+        auto fast = ring.subscribe();
+        auto slow = ring.subscribe();
+
+        ring.pushBatch(4, [](int &slot, std::size_t i) { slot = static_cast<int>(i); });
+        EXPECT_EQ(consumeAll(fast).size(), 4);
+        EXPECT_FALSE(slow.isDisconnected());
+
+        ring.push(4);
+        EXPECT_TRUE(slow.isDisconnected());
+        EXPECT_TRUE(consumeAll(slow).empty());
+        EXPECT_EQ(slow.waitConsume([](const int &) {}), 0);
+        EXPECT_EQ(consumeAll(fast), (std::vector<int>{4}));
+    }
+
+    /// Publishes `n` sequence numbers in batches to consumer threads, where one consumer sleeps now and then, and
+    /// checks each consumer sees increasing numbers and accounts for every number as read or dropped
+    template<class Ring_T>
+    void broadcast(SlowConsumerPolicy policy, int consumers) {
+        constexpr std::uint64_t n = 50000;
+        Ring_T ring(64, consumers, policy);
+        std::vector<typename Ring_T::Consumer> cursors;
+        for (int c = 0; c < consumers; ++c)
+            cursors.push_back(ring.subscribe());
+
+        std::vector<std::uint64_t> sums(consumers, 0);
+        std::vector<std::uint64_t> counts(consumers, 0);
+        std::vector<std::thread> threads;
+        for (int c = 0; c < consumers; ++c) {
+            threads.emplace_back([&, c]() {
+                auto &consumer = cursors[c];
+                std::uint64_t last = 0;
+                while (counts[c] + consumer.dropped() < n && !consumer.isDisconnected()) {
+                    counts[c] += consumer.waitConsume([&](const std::uint64_t &item) {
+                        EXPECT_GT(item, last);
+                        last = item;
+                        sums[c] += item;
+                    }, 16);
+                    if (c == 0 && last % 1000 < 16)
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            });
+        }
+
+        for (std::uint64_t i = 1; i <= n; i += 8) {
+            ring.pushBatch(std::min<std::uint64_t>(8, n + 1 - i), [&](std::uint64_t &slot, std::size_t j) {
+                slot = i + j;
+            });
+        }
+        for (auto &thread: threads)
+            thread.join();
+
+        for (int c = 0; c < consumers; ++c) {
+            if (policy == SlowConsumerPolicy::BLOCK) {
+                EXPECT_EQ(counts[c], n);
+                EXPECT_EQ(sums[c], n * (n + 1) / 2);
+            } else if (policy == SlowConsumerPolicy::DROP) {
+                EXPECT_EQ(counts[c] + cursors[c].dropped(), n);
+            }
+        }
+    }
+
+    TEST(BroadcastRingTests, Broadcast) {
+        broadcast<BroadcastRing<std::uint64_t, YieldWait>>(SlowConsumerPolicy::BLOCK, 3);
+        broadcast<BroadcastRing<std::uint64_t, FutexWait>>(SlowConsumerPolicy::BLOCK, 3);
+        broadcast<BroadcastRing<std::uint64_t, YieldWait>>(SlowConsumerPolicy::DROP, 3);
+        broadcast<BroadcastRing<std::uint64_t, FutexWait>>(SlowConsumerPolicy::DROP, 2);
+        broadcast<BroadcastRing<std::uint64_t, FutexWait>>(SlowConsumerPolicy::DISCONNECT, 2);
+    }
+
+    TEST(BroadcastRingTests, SubscribeWhilePublishing) {
+        // each item carries its sequence twice, so an item overwritten while read shows as torn
+        struct Item {
+            std::uint64_t sequence;
+            std::uint64_t check;
+        };
+        constexpr std::uint64_t n = 100000;
+        constexpr std::uint64_t batch = 4;
+        BroadcastRing<Item, YieldWait> ring(16, 4);
+        std::atomic<std::uint64_t> pushed{0};
+        std::atomic<bool> done{false};
+
+        // consumers attach and detach over and over while the producer wraps the ring
+        std::vector<std::thread> threads;
+        for (int c = 0; c < 3; ++c) {
+            threads.emplace_back([&]() {
+                while (!done.load()) {
+                    auto consumer = ring.subscribe();
+                    const auto upper = pushed.load() + batch;
+                    std::uint64_t next = 0;
+                    std::uint64_t count = 0;
+                    while (count < 64 && !done.load()) {
+                        const auto n = consumer.consume([&](const Item &item) {
+                            EXPECT_EQ(item.check, ~item.sequence);
+                            if (count == 0 && next == 0) {
+                                // no later than the items published by the time it subscribed
+                                EXPECT_LE(item.sequence, upper);
+                            } else {
+                                EXPECT_EQ(item.sequence, next);
+                            }
+                            next = item.sequence + 1;
+                        });
+                        // leaves the core to the producer, the test may run on a single core
+                        if (n == 0)
+                            std::this_thread::yield();
+                        count += n;
+                    }
+                }
+            });
+        }
+
+        for (std::uint64_t i = 0; i < n; i += batch) {
+            ring.pushBatch(batch, [&](Item &slot, std::size_t j) {
+                slot.sequence = i + j;
+                slot.check = ~(i + j);
+            });
+            pushed.store(i + batch);
+        }
+        done.store(true);
+        for (auto &thread: threads)
+            thread.join();
+    }
+
+    TEST(BroadcastRingTests, HandOff) {
+        using wildcat::ws::OpCode;
+        using slot_t = wildcat::ws::MessageSlot<32>;
+        BroadcastRing<slot_t, FutexWait> ring(4, 2);
+        std::vector<BroadcastRing<slot_t, FutexWait>::Consumer> consumers;
+        consumers.push_back(ring.subscribe());
+        consumers.push_back(ring.subscribe());
+        wildcat::ws::HandOff handOff(ring);
+
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // more messages than the ring holds, so the polling thread waits for both consumers
+        std::vector<std::string> messages;
+        std::string data;
+        for (int i = 0; i < 10; ++i) {
+            messages.push_back("message " + std::to_string(i));
+            data += static_cast<char>(0x81);
+            data += static_cast<char>(messages.back().size());
+            data += messages.back();
+        }
+
+        std::vector<std::vector<std::string>> received(consumers.size());
+        std::vector<std::thread> threads;
+        for (std::size_t c = 0; c < consumers.size(); ++c) {
+            threads.emplace_back([&, c]() {
+                while (received[c].size() < messages.size()) {
+                    consumers[c].waitConsume([&received, c](const slot_t &slot) {
+                        EXPECT_EQ(slot.opCode, OpCode::TEXT);
+                        received[c].emplace_back(reinterpret_cast<const char *>(slot.data.data()), slot.length);
+                    });
+                }
+            });
+        }
+
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        client->pollBatch(handOff);
+        for (auto &thread: threads)
+            thread.join();
+
+        for (const auto &messagesOfConsumer: received)
+            EXPECT_EQ(messagesOfConsumer, messages);
+        EXPECT_EQ(handOff.truncated(), 0);
+        close(serverFd);
+    }
+
+}
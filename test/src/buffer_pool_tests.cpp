@@ -0,0 +1,56 @@
+
+#include <unistd.h>
+#include <wildcat/ws/buffer_pool.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    TEST(BufferPoolTests, SizeClasses) {
+        const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        wildcat::ws::BufferPool pool;
+        EXPECT_EQ(pool.capacityFor(1), pageSize);
+        EXPECT_EQ(pool.capacityFor(pageSize + 1), pageSize * 2);
+        EXPECT_EQ(pool.capacityFor(pageSize * 3), pageSize * 4);
+
+        auto buffer = pool.acquire(pageSize * 3);
+        EXPECT_EQ(buffer.capacity(), pageSize * 4);
+        EXPECT_TRUE(buffer.empty());
+    }
+
+    TEST(BufferPoolTests, Reuse) {
+        wildcat::ws::BufferPool pool;
+        auto buffer = pool.acquire(100000);
+        const auto *mapping = buffer.mappingBegin();
+        const auto capacity = buffer.capacity();
+        buffer.commit(10);
+
+        pool.release(std::move(buffer));
+        EXPECT_EQ(pool.idleBytes(), capacity);
+
+        // a request of another size class gets a new buffer
+        auto other = pool.acquire(1);
+        EXPECT_NE(other.mappingBegin(), mapping);
+        EXPECT_EQ(pool.idleBytes(), capacity);
+
+        // a request of the same size class gets the released buffer, emptied
+        auto reused = pool.acquire(capacity);
+        EXPECT_EQ(reused.mappingBegin(), mapping);
+        EXPECT_TRUE(reused.empty());
+        EXPECT_EQ(pool.idleBytes(), 0);
+    }
+
+    TEST(BufferPoolTests, MaxIdleBytes) {
+        const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        wildcat::ws::BufferPool pool(pageSize * 3);
+        auto first = pool.acquire(pageSize * 2);
+        auto second = pool.acquire(pageSize * 2);
+
+        pool.release(std::move(first));
+        EXPECT_EQ(pool.idleBytes(), pageSize * 2);
+
+        // the second buffer would exceed the limit and is unmapped instead
+        pool.release(std::move(second));
+        EXPECT_EQ(pool.idleBytes(), pageSize * 2);
+    }
+
+}
@@ -1,5 +1,8 @@
 
+#include <thread>
+#include <tuple>
 #include <wildcat/ws/client.hpp>
+#include <wildcat/ws/loopback.hpp>
 #include "gtest/gtest.h"
 
 namespace {
@@ -37,6 +40,7 @@ namespace {
             EXPECT_EQ(frameReader.isFinal(), header.isFinal);
             EXPECT_EQ(frameReader.opCode(), header.opCode);
             EXPECT_EQ(frameReader.isMasked(), header.mask);
+            EXPECT_FALSE(frameReader.isCompressed());
             EXPECT_EQ(frameReader.messageLength(), header.messageLength);
             const auto maskKeys = frameReader.maskKeys();
             EXPECT_EQ(maskKeys[0], header.maskKeys[0]);
@@ -244,7 +248,7 @@ namespace {
 
             std::vector<std::string> messages{message, message2};
             auto i = 0;
-            auto f = [&i, &messages](wildcat::ws::OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+            auto f = [&i, &messages](wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
                 EXPECT_EQ(std::string(reinterpret_cast<const char *>(buffer), length), messages[i]);
                 ++i;
             };
@@ -256,4 +260,1195 @@ namespace {
 
     }
 
+    TEST(ClientTests, FrameReaderIncompleteHeader) {
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::TEXT;
+        header.isFinal = true;
+        header.messageLength = 1024 * 1024;
+        header.mask = true;
+        header.maskKeys = {1, 2, 3, 4};
+
+        const auto message = genRandomMessage(header.messageLength);
+        std::vector<std::uint8_t> buffer(header.messageLength + 14);
+        wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+        frameWriter.write(header, reinterpret_cast<const uint8_t *>(message.data()));
+        EXPECT_EQ(frameWriter.headerLength(), 14);
+
+        // every prefix shorter than the header must be reported as incomplete without reading past the end
+        for (std::size_t n = 0; n < frameWriter.headerLength(); ++n) {
+            std::vector<std::uint8_t> prefix(buffer.begin(), buffer.begin() + n);
+            wildcat::ws::FrameReader frameReader(prefix.data(), prefix.size());
+            EXPECT_FALSE(frameReader.isComplete());
+
+            wildcat::ws::FrameHeader decoded{};
+            EXPECT_EQ(wildcat::ws::decodeFrameHeader(prefix.data(), prefix.size(), decoded), 0);
+        }
+
+        wildcat::ws::FrameHeader decoded{};
+        EXPECT_EQ(wildcat::ws::decodeFrameHeader(buffer.data(), frameWriter.headerLength(), decoded), 14);
+        EXPECT_EQ(decoded.messageLength, header.messageLength);
+        EXPECT_EQ(decoded.maskKeys, header.maskKeys);
+
+        // the most significant bit of a 64-bit length must be 0
+        const std::uint8_t invalidLength[] = {0x82, 0x7f, 0x80, 0, 0, 0, 0, 0, 0, 0};
+        EXPECT_THROW(wildcat::ws::decodeFrameHeader(invalidLength, sizeof(invalidLength), decoded),
+                     wildcat::ws::ProtocolError);
+    }
+
+    TEST(ClientTests, FrameParser) {
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::BINARY;
+        header.isFinal = true;
+        header.mask = true;
+        header.maskKeys = {5, 6, 7, 8};
+
+        // a small frame, a 16-bit length frame and a 64-bit length frame back to back
+        std::vector<std::string> messages{genRandomMessage(5), genRandomMessage(1000), genRandomMessage(70000)};
+        std::vector<std::uint8_t> buffer(1024 * 128);
+        wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+        for (const auto &message: messages) {
+            header.messageLength = message.size();
+            frameWriter.write(header, reinterpret_cast<const uint8_t *>(message.data()));
+        }
+        const std::size_t totalSize = frameWriter.messageEnd() - buffer.data();
+
+        // feed the frames in chunks of different sizes to simulate the byte stream nature of tcp
+        for (std::size_t chunkSize: {1, 3, 7, 100, 4096, 65536}) {
+            auto data = std::vector<std::uint8_t>(buffer.begin(), buffer.begin() + totalSize);
+            wildcat::ws::FrameParser parser;
+            std::vector<std::string> received;
+            auto f = [&received](wildcat::ws::OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                EXPECT_EQ(opCode, wildcat::ws::OpCode::BINARY);
+                received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+            };
+
+            // begin is the first byte not consumed and end is one past the last byte received
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            while (end < totalSize) {
+                end = std::min(end + chunkSize, totalSize);
+                begin += parser.parse(data.data() + begin, end - begin, f);
+            }
+            EXPECT_EQ(begin, totalSize);
+            EXPECT_FALSE(parser.hasHeader());
+            EXPECT_EQ(received, messages) << "chunk size: " << chunkSize;
+        }
+    }
+
+    TEST(ClientTests, FrameParserPartialHeader) {
+        std::string message = genRandomMessage(300);
+
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::TEXT;
+        header.isFinal = true;
+        header.messageLength = message.size();
+        header.mask = false;
+
+        std::uint8_t buffer[1024];
+        wildcat::ws::FrameWriter frameWriter(buffer, 1024);
+        frameWriter.write(header, reinterpret_cast<const uint8_t *>(message.data()));
+
+        int i = 0;
+        auto f = [&i](wildcat::ws::OpCode, const std::uint8_t *, std::size_t) { ++i; };
+
+        wildcat::ws::FrameParser parser;
+        // first byte and length byte only, the 16-bit extended length is missing
+        EXPECT_EQ(parser.parse(buffer, 2, f), 0);
+        EXPECT_FALSE(parser.hasHeader());
+        // complete header, partial payload
+        EXPECT_EQ(parser.parse(buffer, 10, f), 0);
+        EXPECT_TRUE(parser.hasHeader());
+        EXPECT_EQ(parser.header().messageLength, message.size());
+        EXPECT_EQ(i, 0);
+        // complete frame
+        EXPECT_EQ(parser.parse(buffer, frameWriter.frameLength(), f), frameWriter.frameLength());
+        EXPECT_FALSE(parser.hasHeader());
+        EXPECT_EQ(i, 1);
+    }
+
+    TEST(ClientTests, SendLargeMessage) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(std::move(stream));
+
+        // larger than the 1 KiB transmit buffer the client used to have
+        const auto message = genRandomMessage(50000);
+        const auto n = client->send(message);
+        EXPECT_EQ(n, message.size() + 8);
+
+        auto frame = wildcat::ws::readBytes(serverFd, n);
+        wildcat::ws::FrameReader frameReader(reinterpret_cast<std::uint8_t *>(frame.data()), frame.size());
+        EXPECT_TRUE(frameReader.isComplete());
+        EXPECT_TRUE(frameReader.isMasked());
+        EXPECT_EQ(frameReader.opCode(), wildcat::ws::OpCode::TEXT);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(frameReader.messageBegin()), frameReader.messageLength()),
+                  message);
+        close(serverFd);
+    }
+
+    TEST(ClientTests, SendFrameUnmasked) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        auto *streamPtr = stream.get();
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(std::move(stream));
+
+        const auto message = genRandomMessage(1000);
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::BINARY;
+        header.isFinal = true;
+        header.messageLength = message.size();
+        header.mask = false;
+        const auto n = client->sendFrame(header, reinterpret_cast<const std::uint8_t *>(message.data()));
+        EXPECT_EQ(n, message.size() + 4);
+        // header and payload are sent with a single gather write
+        EXPECT_EQ(streamPtr->sendCalls(), 1);
+
+        auto frame = wildcat::ws::readBytes(serverFd, n);
+        wildcat::ws::FrameReader frameReader(reinterpret_cast<std::uint8_t *>(frame.data()), frame.size());
+        EXPECT_TRUE(frameReader.isComplete());
+        EXPECT_FALSE(frameReader.isMasked());
+        EXPECT_EQ(frameReader.opCode(), wildcat::ws::OpCode::BINARY);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(frameReader.messageBegin()), frameReader.messageLength()),
+                  message);
+        close(serverFd);
+    }
+
+    TEST(ClientTests, BatchSend) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        auto *streamPtr = stream.get();
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(std::move(stream));
+
+        const std::vector<std::string> messages{"cancel", genRandomMessage(300), "replace"};
+        client->append(messages[0]);
+
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::BINARY;
+        header.isFinal = true;
+        header.messageLength = messages[1].size();
+        header.mask = true;
+        header.maskKeys = {9, 8, 7, 6};
+        client->appendFrame(header, reinterpret_cast<const std::uint8_t *>(messages[1].data()));
+
+        header.opCode = wildcat::ws::OpCode::PING;
+        header.messageLength = messages[2].size();
+        client->appendFrame(header, reinterpret_cast<const std::uint8_t *>(messages[2].data()));
+        EXPECT_EQ(client->batchSize(), 3);
+        EXPECT_EQ(streamPtr->sendCalls(), 0);
+
+        const auto result = client->flush();
+        EXPECT_EQ(result.framesSent, 3);
+        EXPECT_EQ(result.bytesSent, (6 + 6) + (300 + 8) + (7 + 6));
+        EXPECT_EQ(streamPtr->sendCalls(), 1);
+        EXPECT_EQ(client->batchSize(), 0);
+
+        auto data = wildcat::ws::readBytes(serverFd, result.bytesSent);
+        std::vector<wildcat::ws::OpCode> opCodes;
+        std::vector<std::string> received;
+        wildcat::ws::FrameParser parser;
+        const auto n = parser.parse(reinterpret_cast<std::uint8_t *>(data.data()), data.size(),
+                                    [&](wildcat::ws::OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                                        opCodes.push_back(opCode);
+                                        received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+                                    });
+        EXPECT_EQ(n, data.size());
+        EXPECT_EQ(received, messages);
+        const std::vector<wildcat::ws::OpCode> expectedOpCodes{wildcat::ws::OpCode::TEXT, wildcat::ws::OpCode::BINARY,
+                                                               wildcat::ws::OpCode::PING};
+        EXPECT_EQ(opCodes, expectedOpCodes);
+
+        // flushing an empty batch sends nothing
+        const auto empty = client->flush(true);
+        EXPECT_EQ(empty.bytesSent, 0);
+        EXPECT_EQ(empty.framesSent, 0);
+        EXPECT_EQ(streamPtr->sendCalls(), 1);
+        close(serverFd);
+    }
+
+    TEST(ClientTests, NonBlockingSend) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        int sndbuf = 4096;
+        setsockopt(clientFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+        wildcat::ws::Config config;
+        config.sendQueueCapacity = 1024 * 1024;
+        config.sendQueueHighWatermark = 64 * 1024;
+        config.sendQueueLowWatermark = 16 * 1024;
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(std::move(stream),
+                                                                                                   config);
+        std::vector<std::size_t> highWatermarks;
+        std::vector<std::size_t> lowWatermarks;
+        client->setWatermarkHandlers([&](std::size_t n) { highWatermarks.push_back(n); },
+                                     [&](std::size_t n) { lowWatermarks.push_back(n); });
+
+        // the peer is not reading, so the sends must queue rather than block
+        std::vector<std::string> messages;
+        while (highWatermarks.empty()) {
+            messages.push_back(genRandomMessage(10000));
+            client->send(messages.back());
+        }
+        EXPECT_GE(client->queuedBytes(), 64 * 1024);
+        EXPECT_TRUE(lowWatermarks.empty());
+
+        // a frame that does not fit in the queue is rejected as a whole
+        const auto tooLarge = genRandomMessage(1024 * 1024);
+        EXPECT_THROW(client->send(tooLarge), std::runtime_error);
+
+        // the peer reads while the client polls, which drains the queue when the socket is writable
+        auto noop = [](wildcat::ws::OpCode, const std::uint8_t *, std::size_t) {};
+        std::string data;
+        char buf[65536];
+        while (client->queuedBytes() > 0) {
+            client->poll(noop);
+            const auto n = recv(serverFd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0)
+                data.append(buf, n);
+        }
+        ssize_t n;
+        while ((n = recv(serverFd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+            data.append(buf, n);
+
+        EXPECT_EQ(highWatermarks.size(), 1);
+        EXPECT_EQ(lowWatermarks.size(), 1);
+        EXPECT_LE(lowWatermarks.front(), 16 * 1024);
+
+        // all frames arrive complete and in order
+        std::vector<std::string> received;
+        wildcat::ws::FrameParser parser;
+        const auto pos = parser.parse(reinterpret_cast<std::uint8_t *>(data.data()), data.size(),
+                                      [&](wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+                                          received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+                                      });
+        EXPECT_EQ(pos, data.size());
+        EXPECT_EQ(received, messages);
+        close(serverFd);
+    }
+
+
+    TEST(ClientTests, RecvFirstPoll) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.receiveByteBudget = 2 * 102;
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        auto *streamPtr = stream.get();
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(std::move(stream),
+                                                                                                   config);
+        std::vector<std::string> received;
+        auto f = [&received](wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+            received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+
+        // no data is a single empty read rather than an error
+        EXPECT_EQ(client->poll(f), 0);
+        EXPECT_EQ(streamPtr->recvCalls(), 1);
+
+        // frames of 102 bytes written by the server, unmasked
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::TEXT;
+        header.isFinal = true;
+        header.messageLength = 100;
+        header.mask = false;
+
+        std::vector<std::string> messages;
+        std::vector<std::uint8_t> buffer(10 * 102);
+        wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+        for (int i = 0; i < 10; ++i) {
+            messages.push_back(genRandomMessage(100));
+            frameWriter.write(header, reinterpret_cast<const uint8_t *>(messages.back().data()));
+        }
+        ASSERT_EQ(send(serverFd, buffer.data(), buffer.size(), 0), buffer.size());
+
+        // the byte budget limits a poll to two frames
+        EXPECT_EQ(client->poll(f), 1);
+        EXPECT_EQ(received.size(), 2);
+
+        // without a budget the whole burst is handled by one poll, which reads until the socket is empty
+        wildcat::ws::Config unlimitedConfig;
+        unlimitedConfig.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        auto unlimited = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(dup(clientFd)), unlimitedConfig);
+        EXPECT_EQ(unlimited->poll(f), 1);
+        EXPECT_EQ(received, messages);
+        EXPECT_EQ(unlimited->poll(f), 0);
+        close(serverFd);
+    }
+
+
+    TEST(ClientTests, GrowAndShrinkReceiveBuffer) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto pool = std::make_shared<wildcat::ws::BufferPool>();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.receiveBufferSize = 4096;
+        config.maxReceiveBufferSize = 256 * 1024;
+        config.bufferPool = pool;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+        const auto initialCapacity = client->receiveBuffer().capacity();
+
+        std::vector<std::string> received;
+        auto f = [&received](wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+            received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+
+        // a frame larger than the initial buffer makes it grow
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::BINARY;
+        header.isFinal = true;
+        header.mask = false;
+        const auto message = genRandomMessage(100000);
+        header.messageLength = message.size();
+        std::vector<std::uint8_t> buffer(message.size() + wildcat::ws::MAX_FRAME_HEADER_LENGTH);
+        wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+        frameWriter.write(header, reinterpret_cast<const uint8_t *>(message.data()));
+        ASSERT_EQ(send(serverFd, buffer.data(), frameWriter.frameLength(), 0), frameWriter.frameLength());
+
+        while (received.empty())
+            client->poll(f);
+        EXPECT_EQ(received.front(), message);
+        EXPECT_GT(client->receiveBuffer().capacity(), initialCapacity);
+
+        // the idle connection returns the large buffer to the pool
+        EXPECT_TRUE(client->shrinkReceiveBuffer());
+        EXPECT_EQ(client->receiveBuffer().capacity(), initialCapacity);
+        EXPECT_FALSE(client->shrinkReceiveBuffer());
+        EXPECT_GT(pool->idleBytes(), 0);
+
+        // a frame larger than the maximum is rejected
+        header.messageLength = 1024 * 1024;
+        const auto headerLength = wildcat::ws::encodeFrameHeader(header, buffer.data());
+        ASSERT_EQ(send(serverFd, buffer.data(), headerLength, 0), headerLength);
+        EXPECT_THROW(client->poll(f), std::runtime_error);
+
+        // the buffers of a destroyed client are kept by the pool
+        const auto idleBytes = pool->idleBytes();
+        client.reset();
+        EXPECT_GT(pool->idleBytes(), idleBytes);
+        close(serverFd);
+    }
+
+
+    /// Appends an unmasked frame, as a server would send it, to the buffer
+    void appendFrame(std::vector<std::uint8_t> &buffer, wildcat::ws::OpCode opCode, bool isFinal,
+                     const std::string &payload, bool rsv1 = false) {
+        wildcat::ws::FrameHeader header;
+        header.opCode = opCode;
+        header.isFinal = isFinal;
+        header.messageLength = payload.size();
+        header.mask = false;
+        header.rsv1 = rsv1;
+
+        const auto offset = buffer.size();
+        buffer.resize(offset + wildcat::ws::frameHeaderLength(header) + payload.size());
+        const auto headerLength = wildcat::ws::encodeFrameHeader(header, buffer.data() + offset);
+        std::memcpy(buffer.data() + offset + headerLength, payload.data(), payload.size());
+    }
+
+    TEST(ClientTests, FragmentedMessage) {
+        using wildcat::ws::OpCode;
+        const std::vector<std::string> fragments{genRandomMessage(3000), genRandomMessage(10), genRandomMessage(3000),
+                                                 genRandomMessage(3000)};
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::TEXT, true, "before");
+        appendFrame(data, OpCode::TEXT, false, fragments[0]);
+        appendFrame(data, OpCode::PING, true, "ping");
+        appendFrame(data, OpCode::CONTINUATION, false, fragments[1]);
+        appendFrame(data, OpCode::CONTINUATION, false, fragments[2]);
+        appendFrame(data, OpCode::CONTINUATION, true, fragments[3]);
+        appendFrame(data, OpCode::BINARY, true, "after");
+        const std::vector<std::pair<OpCode, std::string>> expected{
+                {OpCode::TEXT,   "before"},
+                {OpCode::PING,   "ping"},
+                {OpCode::TEXT,   fragments[0] + fragments[1] + fragments[2] + fragments[3]},
+                {OpCode::BINARY, "after"}};
+
+        // the message fits in the receive buffer and is compacted in place, or it outgrows the receive buffer and is
+        // moved to a reassembly buffer
+        for (std::size_t receiveBufferSize: {64 * 1024, 4096}) {
+            for (std::size_t chunkSize: {1, 100, 4096, 65536}) {
+                const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+                wildcat::ws::Config config;
+                config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+                config.receiveBufferSize = receiveBufferSize;
+                config.handleControlFrames = false;
+                config.bufferPool = std::make_shared<wildcat::ws::BufferPool>();
+                auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                        std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+                std::vector<std::pair<OpCode, std::string>> received;
+                auto f = [&received](OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                    received.emplace_back(opCode, std::string(reinterpret_cast<const char *>(buffer), length));
+                };
+                for (std::size_t offset = 0; offset < data.size(); offset += chunkSize) {
+                    const auto n = std::min(chunkSize, data.size() - offset);
+                    ASSERT_EQ(send(serverFd, data.data() + offset, n, 0), n);
+                    client->poll(f);
+                }
+                EXPECT_EQ(received, expected) << "receive buffer size: " << receiveBufferSize << ", chunk size: "
+                                              << chunkSize;
+                close(serverFd);
+            }
+        }
+    }
+
+    TEST(ClientTests, FragmentedMessageProtocolErrors) {
+        using wildcat::ws::OpCode;
+        auto expectProtocolError = [](const std::vector<std::uint8_t> &data, std::size_t maxMessageSize) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            wildcat::ws::Config config;
+            config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+            config.maxMessageSize = maxMessageSize;
+            auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                    std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+            ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+            EXPECT_THROW(client->poll([](OpCode, const std::uint8_t *, std::size_t) {}), wildcat::ws::ProtocolError);
+            close(serverFd);
+        };
+
+        std::vector<std::uint8_t> continuationFirst;
+        appendFrame(continuationFirst, OpCode::CONTINUATION, true, "a");
+        expectProtocolError(continuationFirst, 0);
+
+        std::vector<std::uint8_t> interleaved;
+        appendFrame(interleaved, OpCode::TEXT, false, "a");
+        appendFrame(interleaved, OpCode::TEXT, true, "b");
+        expectProtocolError(interleaved, 0);
+
+        std::vector<std::uint8_t> fragmentedControl;
+        appendFrame(fragmentedControl, OpCode::PING, false, "a");
+        expectProtocolError(fragmentedControl, 0);
+
+        std::vector<std::uint8_t> tooLarge;
+        appendFrame(tooLarge, OpCode::BINARY, false, genRandomMessage(600));
+        appendFrame(tooLarge, OpCode::CONTINUATION, true, genRandomMessage(600));
+        expectProtocolError(tooLarge, 1000);
+    }
+
+
+    TEST(ClientTests, StreamLargeMessage) {
+        using wildcat::ws::OpCode;
+        const auto large = genRandomMessage(1024 * 1024);
+        const std::vector<std::string> fragments{genRandomMessage(500), genRandomMessage(5000), genRandomMessage(10)};
+
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::TEXT, true, "small");
+        {
+            // a masked frame to check the payload is unmasked at the right offset in each piece
+            wildcat::ws::FrameHeader header;
+            header.opCode = OpCode::BINARY;
+            header.isFinal = true;
+            header.messageLength = large.size();
+            header.mask = true;
+            header.maskKeys = {1, 2, 3, 4};
+            std::vector<std::uint8_t> buffer(large.size() + wildcat::ws::MAX_FRAME_HEADER_LENGTH);
+            wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+            frameWriter.write(header, reinterpret_cast<const uint8_t *>(large.data()));
+            data.insert(data.end(), buffer.begin(), buffer.begin() + frameWriter.frameLength());
+        }
+        appendFrame(data, OpCode::TEXT, false, fragments[0]);
+        appendFrame(data, OpCode::CONTINUATION, false, fragments[1]);
+        appendFrame(data, OpCode::PING, true, "ping");
+        appendFrame(data, OpCode::CONTINUATION, true, fragments[2]);
+
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.receiveBufferSize = 4096;
+        config.maxReceiveBufferSize = 64 * 1024;
+        config.handleControlFrames = false;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        std::vector<std::pair<OpCode, std::string>> received;
+        std::vector<wildcat::ws::PayloadChunk> chunks;
+        std::string streamed;
+        client->setStreamHandler([&](const wildcat::ws::PayloadChunk &chunk) {
+            EXPECT_EQ(chunk.offset, streamed.size());
+            streamed.append(reinterpret_cast<const char *>(chunk.data), chunk.length);
+            chunks.push_back(chunk);
+            if (chunk.isFinal) {
+                received.emplace_back(chunk.opCode, streamed);
+                streamed.clear();
+            }
+        }, 1000);
+
+        for (std::size_t offset = 0; offset < data.size(); offset += 777) {
+            const auto n = std::min<std::size_t>(777, data.size() - offset);
+            ASSERT_EQ(send(serverFd, data.data() + offset, n, 0), n);
+            client->poll([&](OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                received.emplace_back(opCode, std::string(reinterpret_cast<const char *>(buffer), length));
+            });
+        }
+
+        const std::vector<std::pair<OpCode, std::string>> expected{
+                {OpCode::TEXT,   "small"},
+                {OpCode::BINARY, large},
+                {OpCode::PING,   "ping"},
+                {OpCode::TEXT,   fragments[0] + fragments[1] + fragments[2]}};
+        EXPECT_EQ(received, expected);
+
+        // the large message is passed on in many pieces and the receive buffer never had to hold all of it
+        EXPECT_GT(chunks.size(), 100);
+        EXPECT_EQ(chunks[chunks.size() - 1].messageLength, 5510);
+        EXPECT_LE(client->receiveBuffer().capacity(), 64 * 1024);
+        close(serverFd);
+    }
+
+
+    /// Reads a masked frame sent by the client and returns its opcode and unmasked payload
+    std::pair<wildcat::ws::OpCode, std::string> readFrame(int fd) {
+        auto data = wildcat::ws::readBytes(fd, 2);
+        const auto payloadLength = static_cast<std::uint8_t>(data[1]) & 0x7f;
+        data += wildcat::ws::readBytes(fd, 4 + payloadLength);
+
+        wildcat::ws::FrameHeader header;
+        const auto headerLength = wildcat::ws::decodeFrameHeader(reinterpret_cast<const std::uint8_t *>(data.data()),
+                                                                 data.size(), header);
+        std::string payload = data.substr(headerLength);
+        wildcat::ws::mask(reinterpret_cast<std::uint8_t *>(payload.data()), payload.size(), header.maskKeys);
+        return {header.opCode, payload};
+    }
+
+    TEST(ClientTests, ControlFrames) {
+        using wildcat::ws::OpCode;
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        std::vector<OpCode> received;
+        auto f = [&received](OpCode opCode, const std::uint8_t *, std::size_t) {
+            received.push_back(opCode);
+        };
+        std::vector<std::pair<wildcat::ws::CloseCode, std::string>> closed;
+        client->setCloseHandler([&closed](wildcat::ws::CloseCode code, std::string_view reason) {
+            closed.emplace_back(code, reason);
+        });
+
+        // a ping is answered with a pong echoing its payload and is not dispatched
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::PING, true, "heartbeat");
+        appendFrame(data, OpCode::TEXT, true, "a");
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        client->poll(f);
+        EXPECT_EQ(received, std::vector<OpCode>{OpCode::TEXT});
+        EXPECT_EQ(readFrame(serverFd), std::make_pair(OpCode::PONG, std::string("heartbeat")));
+
+        // the client closes and the server answers
+        client->close(wildcat::ws::CloseCode::GOING_AWAY, "bye");
+        EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSING);
+        EXPECT_EQ(readFrame(serverFd), std::make_pair(OpCode::CLOSE, std::string("\x03\xe9" "bye")));
+        EXPECT_TRUE(closed.empty());
+
+        data.clear();
+        appendFrame(data, OpCode::CLOSE, true, std::string("\x03\xe9", 2));
+        appendFrame(data, OpCode::TEXT, true, "after close");
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        client->poll(f);
+        EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSED);
+        ASSERT_EQ(closed.size(), 1);
+        EXPECT_EQ(closed.front().first, wildcat::ws::CloseCode::GOING_AWAY);
+        // frames after the close frame are dropped
+        EXPECT_EQ(received.size(), 1);
+        close(serverFd);
+    }
+
+    TEST(ClientTests, ServerClose) {
+        using wildcat::ws::OpCode;
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd));
+        std::vector<std::pair<wildcat::ws::CloseCode, std::string>> closed;
+        client->setCloseHandler([&closed](wildcat::ws::CloseCode code, std::string_view reason) {
+            closed.emplace_back(code, reason);
+        });
+
+        // the client echoes the status code of the server and the connection is closed
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::CLOSE, true, std::string("\x03\xf0" "policy", 8));
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        while (closed.empty())
+            client->poll([](OpCode, const std::uint8_t *, std::size_t) {});
+        EXPECT_EQ(closed.front(), std::make_pair(wildcat::ws::CloseCode::POLICY_VIOLATION, std::string("policy")));
+        EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSED);
+        EXPECT_EQ(readFrame(serverFd), std::make_pair(OpCode::CLOSE, std::string("\x03\xf0", 2)));
+        close(serverFd);
+    }
+
+    TEST(ClientTests, NonBlockingSendLargerThanQueue) {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        int sndbuf = 4096;
+        setsockopt(clientFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        wildcat::ws::Config config;
+        config.sendQueueCapacity = 4096;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // written directly until the socket is full, the rest is queued in a queue grown to hold it
+        const auto large = genRandomMessage(256 * 1024);
+        client->send(large);
+        EXPECT_GT(client->queuedBytes(), config.sendQueueCapacity);
+
+        std::string data;
+        std::thread reader([&data, serverFd = serverFd, length = large.size()]() {
+            char buf[65536];
+            while (data.size() < length) {
+                const auto n = recv(serverFd, buf, sizeof(buf), 0);
+                if (n <= 0)
+                    break;
+                data.append(buf, n);
+            }
+        });
+        while (client->queuedBytes() > 0)
+            client->poll([](wildcat::ws::OpCode, const std::uint8_t *, std::size_t) {});
+        reader.join();
+
+        std::vector<std::string> received;
+        wildcat::ws::FrameParser parser;
+        parser.parse(reinterpret_cast<std::uint8_t *>(data.data()), data.size(),
+                     [&](wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+                         received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+                     });
+        EXPECT_EQ(received, std::vector<std::string>{large});
+
+        // data frames fill the queue up to the room kept for control frames, while the peer does not read
+        const auto message = genRandomMessage(10);
+        EXPECT_THROW({
+            for (;;)
+                client->send(message);
+        }, std::runtime_error);
+
+        // pongs answering pings are queued in the room kept for them, then dropped instead of failing the poll
+        std::vector<std::uint8_t> pings;
+        for (int i = 0; i < 8; ++i)
+            appendFrame(pings, wildcat::ws::OpCode::PING, true, genRandomMessage(125));
+        ASSERT_EQ(send(serverFd, pings.data(), pings.size(), 0), pings.size());
+        EXPECT_NO_THROW(client->poll([](wildcat::ws::OpCode, const std::uint8_t *, std::size_t) {}));
+        EXPECT_EQ(client->droppedReplies(), 4);
+        close(serverFd);
+    }
+
+    TEST(ClientTests, SendToClosedPeer) {
+        for (const auto sendQueueCapacity: {std::size_t{0}, std::size_t{4096}}) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            wildcat::ws::Config config;
+            config.sendQueueCapacity = sendQueueCapacity;
+            auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                    std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+            // the send fails rather than retrying forever
+            close(serverFd);
+            EXPECT_THROW(client->send("hello"), wildcat::net::IOError);
+        }
+    }
+
+    TEST(ClientTests, InvalidServerClose) {
+        using wildcat::ws::OpCode;
+        // sends a close frame with the payload to a new client, returns the close frame the client answers with
+        auto closeWith = [](const std::string &payload, bool isValid) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            wildcat::ws::Config config;
+            config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+            auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                    std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+            std::vector<wildcat::ws::CloseCode> closed;
+            client->setCloseHandler([&closed](wildcat::ws::CloseCode code, std::string_view) {
+                closed.push_back(code);
+            });
+
+            std::vector<std::uint8_t> data;
+            appendFrame(data, OpCode::CLOSE, true, payload);
+            EXPECT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+            auto noop = [](OpCode, const std::uint8_t *, std::size_t) {};
+            if (isValid) {
+                client->poll(noop);
+            } else {
+                EXPECT_THROW(client->poll(noop), wildcat::ws::ProtocolError);
+                EXPECT_EQ(closed, std::vector<wildcat::ws::CloseCode>{wildcat::ws::CloseCode::PROTOCOL_ERROR});
+            }
+            EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSED);
+            const auto frame = readFrame(serverFd);
+            EXPECT_EQ(frame.first, OpCode::CLOSE);
+            close(serverFd);
+            return frame.second;
+        };
+
+        // codes allowed on the wire are echoed
+        EXPECT_EQ(closeWith(std::string("\x0f\xa0", 2), true), std::string("\x0f\xa0", 2));
+        EXPECT_EQ(closeWith(std::string("\x03\xf6" "caf\xc3\xa9", 7), true), std::string("\x03\xf6", 2));
+
+        // reserved, unassigned and out of range codes, and reasons that are not UTF-8, are answered with 1002
+        const std::string protocolError("\x03\xea", 2);
+        for (const std::uint16_t code: {0, 999, 1004, 1005, 1006, 1015, 1016, 2999, 5000}) {
+            const std::string payload{static_cast<char>(code >> 8), static_cast<char>(code & 0xff)};
+            EXPECT_EQ(closeWith(payload, false), protocolError) << code;
+        }
+        EXPECT_EQ(closeWith(std::string("\x03\xe8" "\xc3\x28", 4), false), protocolError);
+        EXPECT_EQ(closeWith(std::string("\x03\xe8" "\xed\xa0\x80", 5), false), protocolError);
+        EXPECT_EQ(closeWith(std::string("\x03", 1), false), protocolError);
+    }
+
+    TEST(ClientTests, MessageTooBig) {
+        using wildcat::ws::OpCode;
+        // a message larger than the maximum message size is answered with status code 1009
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.maxMessageSize = 1000;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+        std::vector<wildcat::ws::CloseCode> closed;
+        client->setCloseHandler([&closed](wildcat::ws::CloseCode code, std::string_view) {
+            closed.push_back(code);
+        });
+        std::vector<std::uint8_t> tooLarge;
+        appendFrame(tooLarge, OpCode::BINARY, false, genRandomMessage(600));
+        appendFrame(tooLarge, OpCode::CONTINUATION, true, genRandomMessage(600));
+        ASSERT_EQ(send(serverFd, tooLarge.data(), tooLarge.size(), 0), tooLarge.size());
+        EXPECT_THROW(client->poll([](OpCode, const std::uint8_t *, std::size_t) {}), wildcat::ws::ProtocolError);
+        EXPECT_EQ(closed, std::vector<wildcat::ws::CloseCode>{wildcat::ws::CloseCode::MESSAGE_TOO_BIG});
+        const auto frame = readFrame(serverFd);
+        EXPECT_EQ(frame.first, OpCode::CLOSE);
+        EXPECT_EQ(frame.second, std::string("\x03\xf1", 2));
+        close(serverFd);
+    }
+
+    TEST(ClientTests, HeartbeatAndTimeout) {
+        using wildcat::ws::OpCode;
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.heartbeatInterval = std::chrono::milliseconds(10);
+        config.receiveTimeout = std::chrono::milliseconds(100);
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+        std::vector<wildcat::ws::CloseCode> closed;
+        client->setCloseHandler([&closed](wildcat::ws::CloseCode code, std::string_view) { closed.push_back(code); });
+        auto noop = [](OpCode, const std::uint8_t *, std::size_t) {};
+
+        // the heartbeat is sent by poll once the interval elapsed
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        client->poll(noop);
+        const auto [opCode, payload] = readFrame(serverFd);
+        EXPECT_EQ(opCode, OpCode::PING);
+
+        // the pong gives the round trip time
+        EXPECT_EQ(client->lastRtt().count(), 0);
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::PONG, true, payload);
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        client->poll(noop);
+        EXPECT_GT(client->lastRtt().count(), 0);
+
+        // the server goes silent, so the connection is considered dead after the receive timeout
+        const auto start = std::chrono::steady_clock::now();
+        while (closed.empty())
+            client->poll(noop);
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+        EXPECT_EQ(closed.front(), wildcat::ws::CloseCode::ABNORMAL);
+        EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSED);
+        close(serverFd);
+    }
+
+    TEST(ClientTests, PerMessageDeflate) {
+        using wildcat::ws::OpCode;
+        wildcat::ws::DeflateConfig deflateConfig;
+        deflateConfig.compressThreshold = 100;
+        // the server end of the connection
+        wildcat::ws::PerMessageDeflate server(wildcat::ws::DeflateParameters{}, deflateConfig, false);
+        auto compress = [&server](const std::string &message) {
+            const auto compressed = server.compress(reinterpret_cast<const std::uint8_t *>(message.data()),
+                                                    message.size());
+            return std::string(reinterpret_cast<const char *>(compressed.data()), compressed.size());
+        };
+
+        std::string repeated;
+        for (int i = 0; i < 1000; ++i)
+            repeated += "{\"price\":\"" + std::to_string(i) + "\",\"size\":\"1.5\"}";
+        const auto large = genRandomMessage(256 * 1024);
+
+        // the messages are compressed in the order they are sent, since each one refers back to the previous ones
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::TEXT, true, compress("compressed"), true);
+        appendFrame(data, OpCode::TEXT, true, "uncompressed");
+        const auto fragmented = compress(repeated);
+        appendFrame(data, OpCode::TEXT, false, fragmented.substr(0, 100), true);
+        appendFrame(data, OpCode::PING, true, "ping");
+        appendFrame(data, OpCode::CONTINUATION, true, fragmented.substr(100));
+        appendFrame(data, OpCode::BINARY, true, compress(large), true);
+        appendFrame(data, OpCode::TEXT, true, compress("compressed"), true);
+
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.handleControlFrames = false;
+        config.deflate = deflateConfig;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+        EXPECT_FALSE(client->isDeflateEnabled());
+        client->enableDeflate(wildcat::ws::DeflateParameters{});
+        EXPECT_TRUE(client->isDeflateEnabled());
+
+        // the large message is streamed and decompressed as it is received
+        std::vector<std::pair<OpCode, std::string>> received;
+        std::string streamed;
+        client->setStreamHandler([&](const wildcat::ws::PayloadChunk &chunk) {
+            EXPECT_EQ(chunk.offset, streamed.size());
+            streamed.append(reinterpret_cast<const char *>(chunk.data), chunk.length);
+            EXPECT_EQ(chunk.messageLength, streamed.size());
+            if (chunk.isFinal) {
+                received.emplace_back(chunk.opCode, streamed);
+                streamed.clear();
+            }
+        }, 64 * 1024);
+
+        for (std::size_t offset = 0; offset < data.size(); offset += 4096) {
+            const auto n = std::min<std::size_t>(4096, data.size() - offset);
+            ASSERT_EQ(send(serverFd, data.data() + offset, n, 0), n);
+            client->poll([&](OpCode opCode, const std::uint8_t *buffer, std::size_t length) {
+                received.emplace_back(opCode, std::string(reinterpret_cast<const char *>(buffer), length));
+            });
+        }
+        const std::vector<std::pair<OpCode, std::string>> expected{
+                {OpCode::TEXT,   "compressed"},
+                {OpCode::TEXT,   "uncompressed"},
+                {OpCode::PING,   "ping"},
+                {OpCode::TEXT,   repeated},
+                {OpCode::BINARY, large},
+                {OpCode::TEXT,   "compressed"}};
+        EXPECT_EQ(received, expected);
+
+        // messages sent above the threshold are compressed
+        wildcat::ws::PerMessageDeflate peer(wildcat::ws::DeflateParameters{}, deflateConfig, false);
+        for (const auto &message: {std::string(1000, 'a'), std::string("short")}) {
+            client->send(message);
+            auto frame = wildcat::ws::readBytes(serverFd, 2);
+            const auto isCompressed = (static_cast<std::uint8_t>(frame[0]) & 0x40) != 0;
+            EXPECT_EQ(isCompressed, message.size() >= 100);
+            frame += wildcat::ws::readBytes(serverFd, 4 + (static_cast<std::uint8_t>(frame[1]) & 0x7f));
+            std::array<std::uint8_t, 4> maskKeys;
+            std::memcpy(maskKeys.data(), frame.data() + 2, 4);
+            auto payload = frame.substr(6);
+            wildcat::ws::mask(reinterpret_cast<std::uint8_t *>(payload.data()), payload.size(), maskKeys);
+            if (isCompressed) {
+                const auto decompressed = peer.decompress(reinterpret_cast<const std::uint8_t *>(payload.data()),
+                                                          payload.size());
+                payload.assign(reinterpret_cast<const char *>(decompressed.data()), decompressed.size());
+            }
+            EXPECT_EQ(payload, message);
+        }
+        close(serverFd);
+    }
+
+    TEST(ClientTests, PerMessageDeflateProtocolErrors) {
+        using wildcat::ws::OpCode;
+        auto expectProtocolError = [](const std::vector<std::uint8_t> &data, bool enableDeflate) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            wildcat::ws::Config config;
+            config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+            auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                    std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+            if (enableDeflate)
+                client->enableDeflate(wildcat::ws::DeflateParameters{});
+            ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+            EXPECT_THROW(client->poll([](OpCode, const std::uint8_t *, std::size_t) {}), wildcat::ws::ProtocolError);
+            close(serverFd);
+        };
+
+        std::vector<std::uint8_t> notNegotiated;
+        appendFrame(notNegotiated, OpCode::TEXT, true, "a", true);
+        expectProtocolError(notNegotiated, false);
+
+        std::vector<std::uint8_t> compressedContinuation;
+        appendFrame(compressedContinuation, OpCode::TEXT, false, "a");
+        appendFrame(compressedContinuation, OpCode::CONTINUATION, true, "b", true);
+        expectProtocolError(compressedContinuation, true);
+
+        std::vector<std::uint8_t> compressedPing;
+        appendFrame(compressedPing, OpCode::PING, true, "a", true);
+        expectProtocolError(compressedPing, true);
+
+        std::vector<std::uint8_t> invalid;
+        appendFrame(invalid, OpCode::TEXT, true, "\xff\xff\xff\xff", true);
+        expectProtocolError(invalid, true);
+    }
+
+    TEST(ClientTests, PollBatch) {
+        using wildcat::ws::OpCode;
+        const auto fragment = genRandomMessage(1000);
+        std::vector<std::uint8_t> data;
+        for (int i = 0; i < 5; ++i)
+            appendFrame(data, OpCode::TEXT, true, "m" + std::to_string(i));
+        appendFrame(data, OpCode::PING, true, "ping");
+        appendFrame(data, OpCode::BINARY, false, fragment);
+        appendFrame(data, OpCode::CONTINUATION, true, fragment);
+        appendFrame(data, OpCode::TEXT, true, "m5");
+
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.handleControlFrames = false;
+        config.batchCapacity = 4;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // all frames arrive with a single read
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        std::vector<std::vector<std::pair<OpCode, std::string>>> batches;
+        EXPECT_EQ(client->pollBatch([&batches](std::span<const wildcat::ws::FrameDescriptor> batch) {
+            auto &received = batches.emplace_back();
+            for (const auto &frame: batch)
+                received.emplace_back(frame.opCode, std::string(reinterpret_cast<const char *>(frame.data),
+                                                                frame.length));
+        }), 1);
+
+        // the batches end when the capacity is reached and before the fragmented message is compacted in place
+        using batch_t = std::vector<std::pair<OpCode, std::string>>;
+        const std::vector<batch_t> expected{
+                {{OpCode::TEXT, "m0"}, {OpCode::TEXT, "m1"}, {OpCode::TEXT, "m2"}, {OpCode::TEXT, "m3"}},
+                {{OpCode::TEXT, "m4"}, {OpCode::PING, "ping"}},
+                {{OpCode::BINARY, fragment + fragment}, {OpCode::TEXT, "m5"}}};
+        EXPECT_EQ(batches, expected);
+
+        // a frame received in pieces makes a batch once complete
+        batches.clear();
+        data.clear();
+        appendFrame(data, OpCode::TEXT, true, fragment);
+        ASSERT_EQ(send(serverFd, data.data(), 100, 0), 100);
+        auto f = [&batches](std::span<const wildcat::ws::FrameDescriptor> batch) {
+            batches.emplace_back();
+            for (const auto &frame: batch)
+                batches.back().emplace_back(frame.opCode, std::string(reinterpret_cast<const char *>(frame.data),
+                                                                      frame.length));
+        };
+        client->pollBatch(f);
+        EXPECT_TRUE(batches.empty());
+        ASSERT_EQ(send(serverFd, data.data() + 100, data.size() - 100, 0), data.size() - 100);
+        client->pollBatch(f);
+        ASSERT_EQ(batches.size(), 1);
+        EXPECT_EQ(batches.front(), (batch_t{{OpCode::TEXT, fragment}}));
+        close(serverFd);
+    }
+
+    TEST(ClientTests, ReceiveTimestamps) {
+        using wildcat::ws::OpCode;
+        using namespace std::chrono;
+        auto now = []() { return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()); };
+
+        // the kernel reports software receive timestamps for TCP on loopback
+        const auto [clientFd, serverFd] = wildcat::ws::makeTcpLoopbackPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        config.receiveTimestamps = true;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // the kernel turns on timestamping globally from a work queue, so the first segments may not be stamped
+        std::this_thread::sleep_for(milliseconds(20));
+
+        std::vector<nanoseconds> timestamps;
+        auto handler = [&client, &timestamps](OpCode, const std::uint8_t *, std::size_t) {
+            timestamps.push_back(client->receiveTimestamp().software);
+        };
+
+        std::vector<std::uint8_t> data;
+        appendFrame(data, OpCode::TEXT, true, "first");
+        const auto beforeFirst = now();
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        std::this_thread::sleep_for(milliseconds(20));
+        EXPECT_EQ(client->poll(handler), 1);
+        const auto afterFirst = now();
+        ASSERT_EQ(timestamps.size(), 1);
+        // taken when the bytes arrived, not when they were read
+        EXPECT_GE(timestamps[0], beforeFirst);
+        EXPECT_LE(timestamps[0], afterFirst - milliseconds(10));
+
+        // a frame received in two segments carries the timestamp of the segment that completed it
+        data.clear();
+        appendFrame(data, OpCode::TEXT, true, genRandomMessage(100));
+        ASSERT_EQ(send(serverFd, data.data(), 50, 0), 50);
+        std::this_thread::sleep_for(milliseconds(20));
+        const auto beforeSecond = now();
+        ASSERT_EQ(send(serverFd, data.data() + 50, data.size() - 50, 0), data.size() - 50);
+        std::this_thread::sleep_for(milliseconds(20));
+        EXPECT_EQ(client->poll(handler), 1);
+        ASSERT_EQ(timestamps.size(), 2);
+        EXPECT_GE(timestamps[1], beforeSecond);
+        EXPECT_LE(timestamps[1], now() - milliseconds(10));
+        EXPECT_EQ(client->receiveTimestamp().hardware.count(), 0);
+
+        // the server drops the connection without a close frame
+        std::vector<wildcat::ws::CloseCode> closed;
+        client->setCloseHandler([&closed](wildcat::ws::CloseCode code, std::string_view) { closed.push_back(code); });
+        close(serverFd);
+        std::this_thread::sleep_for(milliseconds(20));
+        EXPECT_EQ(client->poll(handler), 0);
+        EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSED);
+        EXPECT_EQ(closed, std::vector<wildcat::ws::CloseCode>{wildcat::ws::CloseCode::ABNORMAL});
+    }
+
+    TEST(ClientTests, MaskKeysPerFrame) {
+        for (const auto perFrame: {true, false}) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            wildcat::ws::MockServer server(serverFd);
+            wildcat::ws::Config config;
+            config.perFrameMaskKeys = perFrame;
+            wildcat::ws::Client<wildcat::ws::LoopbackStream> client(
+                    std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+            client.send("first");
+            client.send("second");
+            client.append("third");
+            client.flush();
+            client.close(wildcat::ws::CloseCode::NORMAL, "bye");
+
+            std::vector<std::array<std::uint8_t, 4>> keys;
+            std::vector<std::string> payloads;
+            for (int i = 0; i < 4; ++i) {
+                auto [header, payload] = server.readFrame();
+                EXPECT_TRUE(header.mask);
+                keys.push_back(header.maskKeys);
+                payloads.push_back(payload);
+            }
+            EXPECT_EQ(payloads[0], "first");
+            EXPECT_EQ(payloads[1], "second");
+            EXPECT_EQ(payloads[2], "third");
+            EXPECT_EQ(payloads[3].substr(2), "bye");
+
+            for (std::size_t i = 1; i < keys.size(); ++i) {
+                if (perFrame) {
+                    EXPECT_NE(keys[i], keys[i - 1]);
+                } else {
+                    EXPECT_EQ(keys[i], keys[0]);
+                }
+            }
+        }
+    }
+
+
+    TEST(ClientTests, PreparedFrame) {
+        for (const auto perFrame: {true, false}) {
+            const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+            wildcat::ws::MockServer server(serverFd);
+            wildcat::ws::Config config;
+            config.perFrameMaskKeys = perFrame;
+            wildcat::ws::Client<wildcat::ws::LoopbackStream> client(
+                    std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+            // a payload longer than 125 bytes so the header has an extended length
+            const std::string order = R"({"side":"buy","price":"00000.00","qty":"0000",)" + std::string(100, ' ') + "}";
+            auto frame = client.prepareFrame(order);
+            EXPECT_EQ(frame.payloadLength(), order.size());
+            EXPECT_THROW(frame.patch(order.size() - 1, "ab"), std::out_of_range);
+
+            // fields at offsets of every phase of the mask keys
+            const auto price = order.find("00000.00");
+            const auto qty = order.find("0000\"");
+            std::vector<std::array<std::uint8_t, 4>> keys;
+            for (const auto &[p, q]: {std::pair{"12345.67", "0001"}, std::pair{"00100.50", "9999"},
+                                      std::pair{"00000.01", "0042"}}) {
+                frame.patch(price, p);
+                frame.patch(qty, q);
+                client.sendPrepared(frame);
+
+                auto expected = order;
+                expected.replace(price, 8, p);
+                expected.replace(qty, 4, q);
+                auto [header, payload] = server.readFrame();
+                EXPECT_EQ(header.opCode, wildcat::ws::OpCode::TEXT);
+                EXPECT_TRUE(header.isFinal);
+                EXPECT_TRUE(header.mask);
+                EXPECT_EQ(header.maskKeys, frame.maskKeys());
+                EXPECT_EQ(payload, expected);
+                keys.push_back(header.maskKeys);
+            }
+            for (std::size_t i = 1; i < keys.size(); ++i)
+                EXPECT_EQ(keys[i] != keys[i - 1], perFrame);
+
+            const std::vector<std::byte> binary{std::byte{1}, std::byte{2}, std::byte{3}};
+            auto binaryFrame = client.prepareFrame(wildcat::ws::OpCode::BINARY, binary);
+            binaryFrame.patch(1, std::vector<std::byte>{std::byte{9}, std::byte{8}});
+            client.sendPrepared(binaryFrame);
+            auto [header, payload] = server.readFrame();
+            EXPECT_EQ(header.opCode, wildcat::ws::OpCode::BINARY);
+            EXPECT_EQ(payload, std::string("\x01\x09\x08", 3));
+        }
+    }
+
+
+    TEST(ClientTests, SendWithOpCode) {
+        using wildcat::ws::OpCode;
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::MockServer server(serverFd);
+        wildcat::ws::Client<wildcat::ws::LoopbackStream> client(std::make_unique<wildcat::ws::LoopbackStream>(clientFd));
+
+        const std::array<std::byte, 3> binary{std::byte{0}, std::byte{0xff}, std::byte{7}};
+        client.send(OpCode::BINARY, binary);
+        client.append(OpCode::TEXT, std::as_bytes(std::span("abc", 3)));
+        client.flush();
+        client.ping(binary);
+        client.pong();
+        EXPECT_THROW(client.send(OpCode::PING, binary), std::runtime_error);
+        EXPECT_THROW(client.append(OpCode::CONTINUATION, binary), std::runtime_error);
+        const std::vector<std::byte> tooLong(126);
+        EXPECT_THROW(client.ping(tooLong), std::runtime_error);
+        client.close(wildcat::ws::CloseCode::NORMAL, "bye");
+
+        const std::vector<std::pair<OpCode, std::string>> expected{
+                {OpCode::BINARY, std::string("\x00\xff\x07", 3)}, {OpCode::TEXT, "abc"},
+                {OpCode::PING, std::string("\x00\xff\x07", 3)}, {OpCode::PONG, ""},
+                {OpCode::CLOSE, std::string("\x03\xe8" "bye", 5)}};
+        for (const auto &[opCode, payload]: expected) {
+            auto frame = server.readFrame();
+            EXPECT_EQ(frame.first.opCode, opCode);
+            EXPECT_TRUE(frame.first.isFinal);
+            EXPECT_TRUE(frame.first.mask);
+            EXPECT_EQ(frame.second, payload);
+        }
+    }
+
+    TEST(ClientTests, SendFragments) {
+        using wildcat::ws::OpCode;
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::MockServer server(serverFd);
+        wildcat::ws::Client<wildcat::ws::LoopbackStream> client(std::make_unique<wildcat::ws::LoopbackStream>(clientFd));
+
+        const auto bytes = [](std::string_view s) { return std::as_bytes(std::span(s.data(), s.size())); };
+        EXPECT_THROW(client.sendContinuation(bytes("x")), std::runtime_error);
+        EXPECT_THROW(client.sendFinal(bytes("x")), std::runtime_error);
+
+        const std::string large(70000, 'l');
+        client.sendFirst(OpCode::TEXT, bytes("first "));
+        EXPECT_THROW(client.sendFirst(OpCode::TEXT, bytes("again")), std::runtime_error);
+        // no other data message may be sent inside the fragmented message
+        auto prepared = client.prepareFrame("prepared");
+        EXPECT_THROW(client.send("text"), std::runtime_error);
+        EXPECT_THROW(client.send(OpCode::BINARY, bytes("binary")), std::runtime_error);
+        EXPECT_THROW(client.append("text"), std::runtime_error);
+        EXPECT_THROW(client.sendPrepared(prepared), std::runtime_error);
+        EXPECT_EQ(client.batchSize(), 0);
+        client.sendContinuation(bytes(large));
+        client.ping(bytes("in between"));
+        client.sendFinal({});
+        // a new message can be started once the previous one is finished
+        client.sendFirst(OpCode::BINARY, bytes("a"));
+        client.sendFinal(bytes("b"));
+
+        const std::vector<std::tuple<OpCode, bool, std::string>> expected{
+                {OpCode::TEXT, false, "first "}, {OpCode::CONTINUATION, false, large},
+                {OpCode::PING, true, "in between"}, {OpCode::CONTINUATION, true, ""},
+                {OpCode::BINARY, false, "a"}, {OpCode::CONTINUATION, true, "b"}};
+        for (const auto &[opCode, isFinal, payload]: expected) {
+            auto frame = server.readFrame();
+            EXPECT_EQ(frame.first.opCode, opCode);
+            EXPECT_EQ(frame.first.isFinal, isFinal);
+            EXPECT_TRUE(frame.first.mask);
+            EXPECT_EQ(frame.second, payload);
+        }
+    }
+
 }
@@ -0,0 +1,168 @@
+#include <wildcat/ws/deflate.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using wildcat::ws::DeflateConfig;
+    using wildcat::ws::DeflateParameters;
+    using wildcat::ws::PerMessageDeflate;
+
+    /// Generates a JSON message like the updates of a market data feed, which share most of their bytes
+    std::string genUpdate(int i) {
+        return R"({"type":"l2update","product_id":"BTC-USD","changes":[["buy",")" + std::to_string(30000 + i % 97) +
+               R"(.12",")" + std::to_string(i % 13) + R"(.5"]],"time":"2022-05-01T12:00:00.)" +
+               std::to_string(100000 + i) + R"(Z"})";
+    }
+
+    std::string toString(std::span<const std::uint8_t> bytes) {
+        return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    }
+
+    TEST(DeflateTests, Offer) {
+        DeflateParameters params;
+        EXPECT_EQ(wildcat::ws::getDeflateOffer(params), "permessage-deflate; client_max_window_bits");
+
+        params.clientNoContextTakeover = true;
+        params.serverMaxWindowBits = 10;
+        params.clientMaxWindowBits = 12;
+        EXPECT_EQ(wildcat::ws::getDeflateOffer(params),
+                  "permessage-deflate; client_no_context_takeover; server_max_window_bits=10; "
+                  "client_max_window_bits=12");
+    }
+
+    TEST(DeflateTests, ParseResponse) {
+        DeflateParameters offered;
+        offered.serverMaxWindowBits = 12;
+        DeflateParameters negotiated;
+
+        EXPECT_FALSE(wildcat::ws::parseDeflateResponse("", offered, negotiated));
+
+        EXPECT_TRUE(wildcat::ws::parseDeflateResponse("permessage-deflate", offered, negotiated));
+        EXPECT_EQ(negotiated.serverMaxWindowBits, 15);
+        EXPECT_EQ(negotiated.clientMaxWindowBits, 15);
+        EXPECT_FALSE(negotiated.serverNoContextTakeover);
+
+        EXPECT_TRUE(wildcat::ws::parseDeflateResponse(
+                "permessage-deflate; server_no_context_takeover; server_max_window_bits=10; client_max_window_bits=\"9\"",
+                offered, negotiated));
+        EXPECT_TRUE(negotiated.serverNoContextTakeover);
+        EXPECT_FALSE(negotiated.clientNoContextTakeover);
+        EXPECT_EQ(negotiated.serverMaxWindowBits, 10);
+        EXPECT_EQ(negotiated.clientMaxWindowBits, 9);
+
+        // parameters that were not offered or are out of range are rejected
+        EXPECT_THROW(wildcat::ws::parseDeflateResponse("permessage-deflate; server_max_window_bits=13", offered,
+                                                       negotiated), wildcat::ws::HandshakeError);
+        EXPECT_THROW(wildcat::ws::parseDeflateResponse("permessage-deflate; client_max_window_bits=8", offered,
+                                                       negotiated), wildcat::ws::HandshakeError);
+        EXPECT_THROW(wildcat::ws::parseDeflateResponse("permessage-deflate; foo", offered, negotiated),
+                     wildcat::ws::HandshakeError);
+        EXPECT_THROW(wildcat::ws::parseDeflateResponse("x-webkit-deflate-frame", offered, negotiated),
+                     wildcat::ws::HandshakeError);
+        EXPECT_THROW(wildcat::ws::parseDeflateResponse("permessage-deflate, permessage-deflate", offered, negotiated),
+                     wildcat::ws::HandshakeError);
+    }
+
+    TEST(DeflateTests, RoundTrip) {
+        for (bool noContextTakeover: {false, true}) {
+            for (int windowBits: {9, 12, 15}) {
+                DeflateParameters params;
+                params.serverNoContextTakeover = params.clientNoContextTakeover = noContextTakeover;
+                params.serverMaxWindowBits = params.clientMaxWindowBits = windowBits;
+                DeflateConfig config;
+                config.bufferSize = 256;
+                PerMessageDeflate client(params, config);
+                PerMessageDeflate server(params, config, false);
+
+                std::size_t compressedBytes = 0;
+                std::size_t messageBytes = 0;
+                for (int i = 0; i < 100; ++i) {
+                    const auto message = genUpdate(i);
+                    const auto compressed = toString(
+                            client.compress(reinterpret_cast<const std::uint8_t *>(message.data()), message.size()));
+                    const auto decompressed = server.decompress(
+                            reinterpret_cast<const std::uint8_t *>(compressed.data()), compressed.size());
+                    ASSERT_EQ(toString(decompressed), message);
+                    compressedBytes += compressed.size();
+                    messageBytes += message.size();
+                }
+                EXPECT_LT(compressedBytes, messageBytes);
+
+                // a message larger than the output buffers
+                std::string large;
+                for (int i = 0; i < 100; ++i)
+                    large += genUpdate(i);
+                const auto compressed = toString(
+                        server.compress(reinterpret_cast<const std::uint8_t *>(large.data()), large.size()));
+                const auto decompressed = client.decompress(reinterpret_cast<const std::uint8_t *>(compressed.data()),
+                                                            compressed.size());
+                EXPECT_EQ(toString(decompressed), large);
+            }
+        }
+    }
+
+    TEST(DeflateTests, ContextTakeover) {
+        const auto message = genUpdate(1);
+        DeflateConfig config;
+        DeflateParameters takeover;
+        DeflateParameters noTakeover;
+        noTakeover.clientNoContextTakeover = true;
+
+        // a repeated message is a back reference into the window when the context is kept
+        PerMessageDeflate a(takeover, config);
+        PerMessageDeflate b(noTakeover, config);
+        const auto *data = reinterpret_cast<const std::uint8_t *>(message.data());
+        const auto first = a.compress(data, message.size()).size();
+        EXPECT_EQ(b.compress(data, message.size()).size(), first);
+        EXPECT_LT(a.compress(data, message.size()).size(), first);
+        EXPECT_EQ(b.compress(data, message.size()).size(), first);
+    }
+
+    TEST(DeflateTests, StreamingDecompress) {
+        std::string large;
+        for (int i = 0; i < 1000; ++i)
+            large += genUpdate(i);
+
+        DeflateConfig config;
+        config.bufferSize = 1024;
+        PerMessageDeflate client(DeflateParameters{}, config);
+        PerMessageDeflate server(DeflateParameters{}, config, false);
+        for (int n = 0; n < 2; ++n) {
+            const auto compressed = toString(
+                    server.compress(reinterpret_cast<const std::uint8_t *>(large.data()), large.size()));
+
+            // the compressed message is received in pieces and decompressed a buffer at a time
+            std::string decompressed;
+            bool isLast = false;
+            for (std::size_t offset = 0; offset < compressed.size(); offset += 1000) {
+                const auto length = std::min<std::size_t>(1000, compressed.size() - offset);
+                client.decompress(reinterpret_cast<const std::uint8_t *>(compressed.data() + offset), length,
+                                  offset + length == compressed.size(),
+                                  [&](const std::uint8_t *data, std::size_t length, bool last) {
+                                      EXPECT_LE(length, 1024);
+                                      EXPECT_FALSE(isLast);
+                                      decompressed.append(reinterpret_cast<const char *>(data), length);
+                                      isLast = last;
+                                  });
+            }
+            EXPECT_TRUE(isLast);
+            EXPECT_EQ(decompressed, large);
+        }
+    }
+
+    TEST(DeflateTests, DecompressErrors) {
+        const std::string message(10000, 'a');
+        DeflateConfig config;
+        PerMessageDeflate client(DeflateParameters{}, config);
+        PerMessageDeflate server(DeflateParameters{}, config, false);
+        const auto compressed = toString(
+                server.compress(reinterpret_cast<const std::uint8_t *>(message.data()), message.size()));
+        EXPECT_THROW(client.decompress(reinterpret_cast<const std::uint8_t *>(compressed.data()), compressed.size(),
+                                       1000), wildcat::ws::ProtocolError);
+
+        const std::uint8_t garbage[] = {0xff, 0xff, 0xff, 0xff};
+        PerMessageDeflate other(DeflateParameters{}, config);
+        EXPECT_THROW(other.decompress(garbage, sizeof(garbage)), wildcat::ws::ProtocolError);
+    }
+
+}
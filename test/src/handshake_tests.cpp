@@ -34,6 +34,13 @@ namespace {
         EXPECT_STREQ(req.c_str(), expectedRequest.c_str());
     }
 
+    TEST(HandshakeTests, GetUpgradeRequestWithExtensions) {
+        std::string expectedRequest{
+                "GET /foo HTTP/1.1\r\nHost: bar.com\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: abc123\r\nSec-WebSocket-Extensions: permessage-deflate\r\n\r\n"};
+        const auto req = wildcat::ws::getUpgradeRequest("bar.com", "foo", "abc123", "permessage-deflate");
+        EXPECT_STREQ(req.c_str(), expectedRequest.c_str());
+    }
+
     TEST(HandshakeTests, ParseResponse) {
         const char *msg = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
         wildcat::ws::HttpResponse response;
@@ -0,0 +1,139 @@
+#include <thread>
+#include <wildcat/ws/client.hpp>
+#include <wildcat/ws/instrumentation.hpp>
+#include <wildcat/ws/loopback.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using wildcat::ws::LatencyHistogram;
+    using wildcat::ws::LatencyRecorder;
+    using wildcat::ws::LatencyStage;
+
+    TEST(InstrumentationTests, HistogramBuckets) {
+        // small values are exact
+        for (std::uint64_t value = 0; value < 2 * LatencyHistogram::SUB_BUCKET_COUNT; ++value) {
+            EXPECT_EQ(LatencyHistogram::bucketOf(value), value);
+            EXPECT_EQ(LatencyHistogram::highestValueOf(value), value);
+        }
+
+        // larger values are within a bucket of bounded relative width, and the buckets are contiguous
+        std::size_t previous = 0;
+        for (std::uint64_t value = 1; value < LatencyHistogram::MAX_VALUE; value = value * 3 / 2 + 1) {
+            const auto bucket = LatencyHistogram::bucketOf(value);
+            EXPECT_GE(bucket, previous);
+            previous = bucket;
+            const auto lowest = LatencyHistogram::lowestValueOf(bucket);
+            const auto highest = LatencyHistogram::highestValueOf(bucket);
+            EXPECT_LE(lowest, value);
+            EXPECT_GE(highest, value);
+            EXPECT_LE(highest - lowest, value / LatencyHistogram::SUB_BUCKET_COUNT);
+            EXPECT_EQ(LatencyHistogram::bucketOf(highest + 1), bucket + 1);
+        }
+        EXPECT_EQ(LatencyHistogram::bucketOf(UINT64_MAX), LatencyHistogram::BUCKET_COUNT - 1);
+    }
+
+    TEST(InstrumentationTests, HistogramPercentiles) {
+        LatencyHistogram histogram;
+        EXPECT_EQ(histogram.snapshot().count(), 0);
+        EXPECT_EQ(histogram.snapshot().percentile(50), 0);
+
+        for (std::uint64_t value = 1; value <= 10000; ++value)
+            histogram.record(value);
+
+        const auto snapshot = histogram.snapshot();
+        EXPECT_EQ(snapshot.count(), 10000);
+        EXPECT_EQ(snapshot.max(), 10000);
+        EXPECT_NEAR(snapshot.percentile(50), 5000, 5000 / LatencyHistogram::SUB_BUCKET_COUNT);
+        EXPECT_NEAR(snapshot.percentile(99), 9900, 9900 / LatencyHistogram::SUB_BUCKET_COUNT);
+        EXPECT_GE(snapshot.percentile(99), 9900);
+        EXPECT_EQ(snapshot.percentile(100), 10000);
+        EXPECT_EQ(snapshot.percentile(0), 1);
+        EXPECT_NEAR(snapshot.mean(), 5000.5, 5000 / LatencyHistogram::SUB_BUCKET_COUNT);
+
+        // the snapshot scales the values to nanoseconds
+        const auto scaled = histogram.snapshot(0.5);
+        EXPECT_EQ(scaled.max(), 5000);
+        EXPECT_EQ(scaled.percentile(100), 5000);
+    }
+
+    TEST(InstrumentationTests, SnapshotWhileRecording) {
+        LatencyHistogram histogram;
+        constexpr std::uint64_t n = 1000000;
+        std::thread recorder([&histogram]() {
+            for (std::uint64_t i = 0; i < n; ++i)
+                histogram.record(i & 0xfff);
+        });
+
+        std::uint64_t last = 0;
+        while (last < n) {
+            const auto count = histogram.snapshot().count();
+            EXPECT_GE(count, last);
+            last = count;
+            std::this_thread::yield();
+        }
+        recorder.join();
+        EXPECT_EQ(histogram.snapshot().count(), n);
+    }
+
+    template<class Recorder_T>
+    void recordStages() {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        wildcat::ws::Client<wildcat::ws::LoopbackStream, Recorder_T> client(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // three messages, the last one in two fragments
+        const std::string data = std::string("\x81\x01" "a" "\x82\x02" "bc" "\x01\x01" "d" "\x80\x01" "e", 13);
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        int messages = 0;
+        client.poll([&messages](wildcat::ws::OpCode, const std::uint8_t *, std::size_t) {
+            ++messages;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+        ASSERT_EQ(messages, 3);
+
+        auto &recorder = client.instrumentation();
+        EXPECT_EQ(recorder.snapshot(LatencyStage::RECEIVE).count(), 1);
+        EXPECT_EQ(recorder.snapshot(LatencyStage::PARSE).count(), 4);
+        EXPECT_EQ(recorder.snapshot(LatencyStage::DISPATCH).count(), 3);
+        EXPECT_EQ(recorder.snapshot(LatencyStage::HANDLER).count(), 3);
+        EXPECT_EQ(recorder.snapshot(LatencyStage::WAKE_TO_HANDLER).count(), 3);
+        EXPECT_EQ(recorder.snapshot(LatencyStage::BATCH_HANDLER).count(), 0);
+
+        // the handler sleeps, the time is attributed to the handler and not to parsing
+        const auto handler = recorder.snapshot(LatencyStage::HANDLER);
+        EXPECT_GE(handler.percentile(0), 900000);
+        EXPECT_LT(handler.percentile(0), 100000000);
+        EXPECT_LT(recorder.snapshot(LatencyStage::PARSE).max(), 900000);
+        EXPECT_GE(recorder.snapshot(LatencyStage::WAKE_TO_HANDLER).max(), 1800000);
+
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        client.pollBatch([&messages](std::span<const wildcat::ws::FrameDescriptor> batch) {
+            messages += static_cast<int>(batch.size());
+        });
+        EXPECT_EQ(messages, 6);
+        EXPECT_EQ(recorder.snapshot(LatencyStage::RECEIVE).count(), 2);
+        // the batch is flushed before the fragmented message is reassembled in place
+        EXPECT_EQ(recorder.snapshot(LatencyStage::BATCH_HANDLER).count(), 2);
+        close(serverFd);
+    }
+
+    TEST(InstrumentationTests, RecordStages) {
+        recordStages<LatencyRecorder<wildcat::ws::MonotonicClock>>();
+        recordStages<LatencyRecorder<wildcat::ws::TscClock>>();
+    }
+
+    TEST(InstrumentationTests, NoInstrumentation) {
+        // takes no room in the client
+        static_assert(std::is_empty_v<wildcat::ws::NoInstrumentation>);
+        struct Holder {
+            int value;
+            [[no_unique_address]] wildcat::ws::NoInstrumentation instrumentation;
+        };
+        static_assert(sizeof(Holder) == sizeof(int));
+        EXPECT_GT(wildcat::ws::TscClock::nanosPerTick(), 0.0);
+    }
+
+}
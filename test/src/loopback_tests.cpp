@@ -0,0 +1,230 @@
+#include <thread>
+#include <wildcat/ws/client.hpp>
+#include <wildcat/ws/loopback.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using wildcat::ws::LoopbackStream;
+    using wildcat::ws::MockServer;
+    using wildcat::ws::OpCode;
+    using client_t = wildcat::ws::Client<LoopbackStream>;
+
+    struct Connection {
+        std::unique_ptr<MockServer> server;
+        std::unique_ptr<client_t> client;
+    };
+
+    /// Connects a client to a mock server over a socket pair
+    Connection connect(const wildcat::ws::Config &config = {}, const std::string &extensions = "") {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        Connection connection{std::make_unique<MockServer>(serverFd),
+                              std::make_unique<client_t>(std::make_unique<LoopbackStream>(clientFd), config)};
+        std::thread handshake([&connection, &extensions]() { connection.server->acceptHandshake(extensions); });
+        EXPECT_TRUE(connection.client->connect("localhost", 80));
+        handshake.join();
+        return connection;
+    }
+
+    /// Polls until `count` messages are received or the deadline passes
+    std::vector<std::pair<OpCode, std::string>> receive(client_t &client, std::size_t count) {
+        std::vector<std::pair<OpCode, std::string>> messages;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (messages.size() < count && std::chrono::steady_clock::now() < deadline) {
+            if (client.poll([&messages](OpCode opCode, const std::uint8_t *payload, std::size_t length) {
+                messages.emplace_back(opCode, std::string(reinterpret_cast<const char *>(payload), length));
+            }) == 0)
+                std::this_thread::yield();
+        }
+        return messages;
+    }
+
+    std::vector<wildcat::ws::ScriptedMessage> makeScript() {
+        std::vector<wildcat::ws::ScriptedMessage> script;
+        for (std::size_t i = 0; i < 20; ++i) {
+            const auto opCode = i % 2 ? OpCode::BINARY : OpCode::TEXT;
+            script.push_back({opCode, std::string(i * 37 + 1, static_cast<char>('a' + i))});
+        }
+        script.push_back({OpCode::BINARY, std::string(100000, 'z')});
+        return script;
+    }
+
+    TEST(LoopbackTests, ConnectAndSend) {
+        auto [server, client] = connect();
+
+        client->send("hello");
+        const auto [header, payload] = server->readFrame();
+        EXPECT_EQ(header.opCode, OpCode::TEXT);
+        EXPECT_TRUE(header.isFinal);
+        EXPECT_TRUE(header.mask);
+        EXPECT_EQ(payload, "hello");
+
+        const std::string large(200000, 'x');
+        client->send(large);
+        EXPECT_EQ(server->readFrame().second, large);
+
+        server->sendMessage(OpCode::TEXT, "world");
+        const auto messages = receive(*client, 1);
+        ASSERT_EQ(messages.size(), 1);
+        EXPECT_EQ(messages[0].second, "world");
+    }
+
+    TEST(LoopbackTests, RecvErrorsAndDisconnect) {
+        auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        LoopbackStream stream(clientFd);
+        char buffer[16];
+
+        // no data, then data, then the peer closes
+        EXPECT_EQ(stream.recvBytes(buffer, sizeof(buffer)), -1);
+        EXPECT_EQ(errno, EAGAIN);
+        ASSERT_EQ(send(serverFd, "abc", 3, 0), 3);
+        EXPECT_EQ(stream.recvBytes(buffer, sizeof(buffer)), 3);
+        close(serverFd);
+        EXPECT_EQ(stream.recvBytes(buffer, sizeof(buffer)), 0);
+
+        stream.disconnect();
+        EXPECT_EQ(stream.recvBytes(buffer, sizeof(buffer)), -1);
+        EXPECT_EQ(errno, EBADF);
+    }
+
+    TEST(LoopbackTests, ServerGoesAway) {
+        for (const auto mode: {wildcat::ws::ReceiveMode::POLL, wildcat::ws::ReceiveMode::RECV_FIRST}) {
+            wildcat::ws::Config config;
+            config.receiveMode = mode;
+            auto [server, client] = connect(config);
+            std::vector<wildcat::ws::CloseCode> codes;
+            client->setCloseHandler([&codes](wildcat::ws::CloseCode code, std::string_view) {
+                codes.push_back(code);
+            });
+
+            // the frames sent before the server went away are still delivered
+            server->sendMessage(OpCode::TEXT, "last");
+            server.reset();
+            std::vector<std::string> messages;
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (client->state() != wildcat::ws::ConnectionState::CLOSED &&
+                   std::chrono::steady_clock::now() < deadline) {
+                client->poll([&messages](OpCode, const std::uint8_t *payload, std::size_t length) {
+                    messages.emplace_back(reinterpret_cast<const char *>(payload), length);
+                });
+            }
+            ASSERT_EQ(messages.size(), 1);
+            EXPECT_EQ(messages[0], "last");
+
+            EXPECT_EQ(client->state(), wildcat::ws::ConnectionState::CLOSED);
+            ASSERT_EQ(codes.size(), 1);
+            EXPECT_EQ(codes[0], wildcat::ws::CloseCode::ABNORMAL);
+            EXPECT_EQ(client->poll([](OpCode, const std::uint8_t *, std::size_t) {}), 0);
+            EXPECT_EQ(codes.size(), 1);
+        }
+    }
+
+    TEST(LoopbackTests, ConnectWithDeflate) {
+        wildcat::ws::Config config;
+        config.deflate.enabled = true;
+        auto [server, client] = connect(config, "permessage-deflate");
+        EXPECT_TRUE(client->isDeflateEnabled());
+
+        // a message sent uncompressed is still received
+        server->sendMessage(OpCode::TEXT, "plain");
+        const auto messages = receive(*client, 1);
+        ASSERT_EQ(messages.size(), 1);
+        EXPECT_EQ(messages[0].second, "plain");
+    }
+
+    TEST(LoopbackTests, Encode) {
+        std::string frames;
+        MockServer::encode(frames, OpCode::BINARY, "abcdefgh", 3);
+        EXPECT_EQ(frames, std::string("\x02\x03" "abc" "\x00\x03" "def" "\x80\x02" "gh", 14));
+
+        frames.clear();
+        MockServer::encode(frames, OpCode::TEXT, "", 3);
+        EXPECT_EQ(frames, std::string("\x81\x00", 2));
+    }
+
+    TEST(LoopbackTests, ReplayFragmentsAndChunks) {
+        auto script = makeScript();
+        for (const std::size_t chunkSize: {std::size_t(0), std::size_t(1448), std::size_t(7), std::size_t(1)}) {
+            // one byte sends of the large message take too long
+            if (chunkSize == 1)
+                script.pop_back();
+            for (const std::size_t fragmentSize: {std::size_t(0), std::size_t(100), std::size_t(1)}) {
+                auto [server, client] = connect();
+                wildcat::ws::ReplayConfig replay;
+                replay.burstSize = 4;
+                replay.fragmentSize = fragmentSize;
+                replay.chunkSize = chunkSize;
+                replay.repeat = 2;
+                server->replay(script, replay);
+
+                const auto messages = receive(*client, 2 * script.size());
+                server->join();
+                ASSERT_EQ(messages.size(), 2 * script.size()) << fragmentSize << " " << chunkSize;
+                EXPECT_EQ(server->messagesSent(), 2 * script.size());
+                for (std::size_t i = 0; i < messages.size(); ++i) {
+                    EXPECT_EQ(messages[i].first, script[i % script.size()].opCode);
+                    EXPECT_EQ(messages[i].second, script[i % script.size()].payload);
+                }
+            }
+        }
+    }
+
+    TEST(LoopbackTests, ReplayRate) {
+        auto [server, client] = connect();
+
+        // 5 bursts of 10 messages, one every 10ms
+        wildcat::ws::ReplayConfig replay;
+        replay.messageRate = 1000;
+        replay.burstSize = 10;
+        replay.repeat = 50;
+        const auto start = std::chrono::steady_clock::now();
+        server->replay({{OpCode::TEXT, "tick"}}, replay);
+        const auto messages = receive(*client, 50);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        server->join();
+        EXPECT_EQ(messages.size(), 50);
+        EXPECT_GE(elapsed, std::chrono::milliseconds(40));
+    }
+
+    TEST(LoopbackTests, StampSendTime) {
+        auto [server, client] = connect();
+
+        wildcat::ws::ReplayConfig replay;
+        replay.stampSendTime = true;
+        replay.fragmentSize = 5;
+        const auto before = std::chrono::steady_clock::now();
+        server->replay({{OpCode::BINARY, std::string(16, 'x')}, {OpCode::TEXT, "short"}}, replay);
+        const auto messages = receive(*client, 2);
+        ASSERT_EQ(messages.size(), 2);
+
+        const auto *payload = reinterpret_cast<const std::uint8_t *>(messages[0].second.data());
+        const auto sendTime = MockServer::sendTimeOf(payload);
+        EXPECT_GE(sendTime, before);
+        EXPECT_LE(sendTime, std::chrono::steady_clock::now());
+        EXPECT_EQ(messages[0].second.substr(8), std::string(8, 'x'));
+        // too short to be stamped
+        EXPECT_EQ(messages[1].second, "short");
+    }
+
+    TEST(LoopbackTests, StopReplay) {
+        auto [server, client] = connect();
+
+        wildcat::ws::ReplayConfig replay;
+        replay.messageRate = 100;
+        replay.repeat = SIZE_MAX;
+        server->replay({{OpCode::TEXT, "tick"}}, replay);
+        EXPECT_EQ(receive(*client, 2).size(), 2);
+        server->stop();
+        const auto sent = server->messagesSent();
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        EXPECT_EQ(server->messagesSent(), sent);
+
+        // the client closing its end ends a replay blocked on a full socket
+        replay.messageRate = 0;
+        server->replay({{OpCode::BINARY, std::string(4096, 'x')}}, replay);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        client.reset();
+        server->join();
+    }
+
+}
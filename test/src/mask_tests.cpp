@@ -0,0 +1,140 @@
+
+#include <vector>
+#include <wildcat/ws/mask.hpp>
+#include <wildcat/ws/mask_key.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    std::vector<std::uint8_t> genRandomBytes(std::size_t n) {
+        std::vector<std::uint8_t> out(n);
+        for (auto &b: out)
+            b = static_cast<std::uint8_t>(rand());
+        return out;
+    }
+
+    std::vector<wildcat::ws::detail::mask_fn_t> supportedImpls() {
+        std::vector<wildcat::ws::detail::mask_fn_t> impls{&wildcat::ws::detail::maskWord};
+#ifdef WILDCAT_WS_MASK_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+            impls.push_back(&wildcat::ws::detail::maskSse2);
+        if (__builtin_cpu_supports("avx2"))
+            impls.push_back(&wildcat::ws::detail::maskAvx2);
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+            impls.push_back(&wildcat::ws::detail::maskAvx512);
+#endif
+        return impls;
+    }
+
+    TEST(MaskTests, RoundTrip) {
+        const std::array<std::uint8_t, 4> maskKeys{1, 2, 3, 4};
+        const auto payload = genRandomBytes(1000);
+
+        auto buffer = payload;
+        wildcat::ws::mask(buffer.data(), buffer.size(), maskKeys);
+        for (std::size_t i = 0; i < buffer.size(); ++i) {
+            EXPECT_EQ(buffer[i], payload[i] ^ maskKeys[i % 4]);
+        }
+
+        wildcat::ws::mask(buffer.data(), buffer.size(), maskKeys);
+        EXPECT_EQ(buffer, payload);
+    }
+
+    TEST(MaskTests, KernelsMatchScalar) {
+        const std::array<std::uint8_t, 4> maskKeys{0x12, 0x34, 0x56, 0x78};
+        const auto key = wildcat::ws::detail::loadMaskKey(maskKeys);
+        const auto payload = genRandomBytes(600);
+
+        for (auto impl: supportedImpls()) {
+            // vary the alignment of the source and destination as well as the length to hit the head and tail paths
+            for (std::size_t srcOffset = 0; srcOffset < 8; ++srcOffset) {
+                for (std::size_t dstOffset = 0; dstOffset < 8; dstOffset += 3) {
+                    for (std::size_t length = 0; length < 300; ++length) {
+                        std::vector<std::uint8_t> expected(length + 8);
+                        std::vector<std::uint8_t> actual(length + 8);
+                        wildcat::ws::detail::maskScalar(payload.data() + srcOffset, expected.data() + dstOffset, length,
+                                                        key);
+                        impl(payload.data() + srcOffset, actual.data() + dstOffset, length, key);
+                        ASSERT_EQ(actual, expected) << "length: " << length << ", src offset: " << srcOffset
+                                                    << ", dst offset: " << dstOffset;
+                    }
+                }
+            }
+        }
+    }
+
+    TEST(MaskTests, KernelsInPlace) {
+        const std::array<std::uint8_t, 4> maskKeys{0xde, 0xad, 0xbe, 0xef};
+        const auto key = wildcat::ws::detail::loadMaskKey(maskKeys);
+        const auto payload = genRandomBytes(1024 + 13);
+
+        auto expected = payload;
+        wildcat::ws::detail::maskScalar(expected.data() + 1, expected.data() + 1, expected.size() - 1, key);
+
+        for (auto impl: supportedImpls()) {
+            auto actual = payload;
+            impl(actual.data() + 1, actual.data() + 1, actual.size() - 1, key);
+            EXPECT_EQ(actual, expected);
+        }
+    }
+
+    TEST(MaskTests, AdvanceMaskKey) {
+        const std::array<std::uint8_t, 4> maskKeys{1, 2, 3, 4};
+        const auto key = wildcat::ws::detail::loadMaskKey(maskKeys);
+        for (std::size_t n = 0; n < 8; ++n) {
+            const auto advanced = wildcat::ws::detail::advanceMaskKey(key, n);
+            std::uint8_t b[4];
+            std::memcpy(b, &advanced, sizeof(b));
+            for (std::size_t i = 0; i < 4; ++i) {
+                EXPECT_EQ(b[i], maskKeys[(n + i) & 0x3]);
+            }
+        }
+    }
+
+    TEST(MaskTests, Offset) {
+        const std::array<std::uint8_t, 4> maskKeys{1, 2, 3, 4};
+        const auto payload = genRandomBytes(257);
+
+        auto expected = payload;
+        wildcat::ws::mask(expected.data(), expected.size(), maskKeys);
+
+        // mask the payload in uneven pieces
+        auto actual = payload;
+        std::size_t offset = 0;
+        for (std::size_t n: {3, 1, 50, 17, 100, 86}) {
+            wildcat::ws::mask(actual.data() + offset, n, maskKeys, offset);
+            offset += n;
+        }
+        EXPECT_EQ(offset, payload.size());
+        EXPECT_EQ(actual, expected);
+    }
+
+    TEST(MaskTests, MaskKeyGenerator) {
+        wildcat::ws::MaskKeyGenerator generator;
+        wildcat::ws::MaskKeyGenerator other;
+
+        // keys over several blocks of the keystream: every byte value about as often, no two keys in a row alike,
+        // and a different stream for each generator
+        std::array<std::size_t, 256> counts{};
+        auto previous = generator.next();
+        std::size_t matches = 0;
+        constexpr std::size_t n = 16 * wildcat::ws::MaskKeyGenerator::KEYS_PER_BLOCK;
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto key = generator.next();
+            EXPECT_NE(key, previous);
+            previous = key;
+            if (key == other.next())
+                ++matches;
+            for (auto b: key)
+                ++counts[b];
+        }
+        EXPECT_EQ(matches, 0);
+        const auto expected = 4 * n / counts.size();
+        for (auto count: counts) {
+            EXPECT_GT(count, expected / 2);
+            EXPECT_LT(count, expected * 2);
+        }
+    }
+
+}
@@ -0,0 +1,109 @@
+
+#include <string>
+#include <unistd.h>
+#include <wildcat/ws/mirrored_buffer.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    TEST(MirroredBufferTests, Capacity) {
+        const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+        wildcat::ws::MirroredBuffer buffer(1);
+        EXPECT_EQ(buffer.capacity(), pageSize);
+        EXPECT_EQ(buffer.size(), 0);
+        EXPECT_EQ(buffer.available(), pageSize);
+        EXPECT_TRUE(buffer.empty());
+
+        wildcat::ws::MirroredBuffer buffer2(pageSize + 1);
+        EXPECT_EQ(buffer2.capacity(), pageSize * 2);
+    }
+
+    TEST(MirroredBufferTests, Mirror) {
+        wildcat::ws::MirroredBuffer buffer(1);
+        const auto capacity = buffer.capacity();
+
+        // writes to the first mapping are visible in the second mapping and vice versa
+        buffer.readBegin()[0] = 'a';
+        EXPECT_EQ(buffer.readBegin()[capacity], 'a');
+        buffer.readBegin()[capacity + 1] = 'b';
+        EXPECT_EQ(buffer.readBegin()[1], 'b');
+    }
+
+    TEST(MirroredBufferTests, CommitConsume) {
+        wildcat::ws::MirroredBuffer buffer(1);
+        const auto capacity = buffer.capacity();
+
+        const std::string message = "hello";
+        std::memcpy(buffer.writeBegin(), message.data(), message.size());
+        buffer.commit(message.size());
+        EXPECT_EQ(buffer.size(), message.size());
+        EXPECT_EQ(buffer.available(), capacity - message.size());
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(buffer.readBegin()), buffer.size()), message);
+
+        buffer.consume(2);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(buffer.readBegin()), buffer.size()), "llo");
+
+        // consuming all readable bytes starts over at the beginning of the mapping
+        const auto *begin = buffer.readBegin() - 2;
+        buffer.consume(3);
+        EXPECT_TRUE(buffer.empty());
+        EXPECT_EQ(buffer.readBegin(), begin);
+    }
+
+    TEST(MirroredBufferTests, Wrap) {
+        wildcat::ws::MirroredBuffer buffer(1);
+        const auto capacity = buffer.capacity();
+
+        // fill all but 3 bytes, then release all but the last byte so the readable region is at the end of the ring
+        buffer.commit(capacity - 3);
+        buffer.consume(capacity - 4);
+        EXPECT_EQ(buffer.size(), 1);
+
+        // write a message that wraps around the end of the ring
+        const std::string message = "hello world";
+        std::memcpy(buffer.writeBegin(), message.data(), message.size());
+        buffer.commit(message.size());
+        EXPECT_EQ(buffer.size(), message.size() + 1);
+
+        buffer.consume(1);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(buffer.readBegin()), buffer.size()), message);
+
+        // the wrapped bytes are at the beginning of the first mapping
+        const auto *first = buffer.readBegin() - (capacity - 3);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(first), message.size() - 3), "lo world");
+
+        // consume part of the message to move the head past the end of the first mapping
+        buffer.consume(4);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(buffer.readBegin()), buffer.size()), "o world");
+        EXPECT_EQ(buffer.readBegin(), first + 1);
+    }
+
+    TEST(MirroredBufferTests, Move) {
+        wildcat::ws::MirroredBuffer buffer(1);
+        buffer.readBegin()[0] = 'a';
+        buffer.commit(1);
+
+        wildcat::ws::MirroredBuffer other(std::move(buffer));
+        EXPECT_EQ(buffer.capacity(), 0);
+        EXPECT_EQ(other.size(), 1);
+        EXPECT_EQ(other.readBegin()[0], 'a');
+    }
+
+
+    TEST(MirroredBufferTests, HugePages) {
+        // falls back to regular pages when no huge pages are reserved on the system
+        wildcat::ws::MirroredBuffer buffer(1, true);
+        const auto capacity = buffer.capacity();
+        if (buffer.hasHugePages()) {
+            EXPECT_EQ(capacity, wildcat::ws::MirroredBuffer::HUGE_PAGE_SIZE);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(buffer.mappingBegin()) % capacity, 0);
+        } else {
+            EXPECT_EQ(capacity, static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+        }
+
+        buffer.readBegin()[capacity - 1] = 'a';
+        EXPECT_EQ(buffer.readBegin()[capacity * 2 - 1], 'a');
+    }
+
+}
@@ -0,0 +1,183 @@
+#include <thread>
+#include <wildcat/ws/handoff.hpp>
+#include <wildcat/ws/loopback.hpp>
+#include <wildcat/ws/queue.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using wildcat::ws::FutexWait;
+    using wildcat::ws::MpmcQueue;
+    using wildcat::ws::SpscQueue;
+    using wildcat::ws::YieldWait;
+
+    template<class Queue_T>
+    void pushPop() {
+        Queue_T queue(3);
+        EXPECT_EQ(queue.capacity(), 4);
+        EXPECT_EQ(queue.size(), 0);
+
+        int item = 0;
+        EXPECT_FALSE(queue.tryPop(item));
+        for (int i = 0; i < 4; ++i)
+            EXPECT_TRUE(queue.tryPush(i));
+        EXPECT_FALSE(queue.tryPush(4));
+        EXPECT_EQ(queue.size(), 4);
+
+        EXPECT_TRUE(queue.tryPop(item));
+        EXPECT_EQ(item, 0);
+
+        // a batch is pushed as far as there is room
+        const int items[] = {10, 11, 12};
+        EXPECT_EQ(queue.tryPushBatch(items, 3), 1);
+
+        std::vector<int> consumed;
+        EXPECT_EQ(queue.consume([&consumed](int &i) { consumed.push_back(i); }, 2), 2);
+        EXPECT_EQ(consumed, (std::vector<int>{1, 2}));
+
+        // wraps around the end of the ring
+        EXPECT_EQ(queue.tryPushBatch(items + 1, 2), 2);
+        EXPECT_EQ(queue.consume([&consumed](int &i) { consumed.push_back(i); }), 4);
+        EXPECT_EQ(consumed, (std::vector<int>{1, 2, 3, 10, 11, 12}));
+        EXPECT_EQ(queue.size(), 0);
+    }
+
+    TEST(QueueTests, SpscPushPop) {
+        pushPop<SpscQueue<int>>();
+    }
+
+    TEST(QueueTests, MpmcPushPop) {
+        pushPop<MpmcQueue<int>>();
+    }
+
+    /// Pushes `n` sequence numbers from each producer thread in batches and checks each consumer sees the numbers of
+    /// each producer in order, and all numbers are consumed once
+    template<class Queue_T>
+    void transfer(int producers, int consumers) {
+        constexpr std::uint64_t n = 100000;
+        Queue_T queue(64);
+        std::atomic<std::uint64_t> consumed(0);
+        std::atomic<std::uint64_t> sum(0);
+        std::atomic<int> done(0);
+
+        std::vector<std::thread> threads;
+        for (int c = 0; c < consumers; ++c) {
+            threads.emplace_back([&]() {
+                std::vector<std::uint64_t> last(producers, 0);
+                std::uint64_t localSum = 0;
+                bool isDone = false;
+                while (!isDone) {
+                    consumed += queue.waitConsume([&](std::uint64_t &item) {
+                        // a consumer stops at a 0
+                        if (item == 0) {
+                            isDone = true;
+                            return;
+                        }
+                        const auto producer = item >> 32;
+                        const auto value = item & 0xffffffff;
+                        EXPECT_GT(value, last[producer]);
+                        last[producer] = value;
+                        localSum += value;
+                    }, 16);
+                }
+                sum += localSum;
+                ++done;
+            });
+        }
+
+        std::vector<std::thread> producerThreads;
+        for (int p = 0; p < producers; ++p) {
+            producerThreads.emplace_back([&queue, p]() {
+                for (std::uint64_t i = 1; i <= n; i += 8) {
+                    queue.pushBatch(std::min<std::uint64_t>(8, n + 1 - i), [&](std::uint64_t &slot, std::size_t j) {
+                        slot = static_cast<std::uint64_t>(p) << 32 | (i + j);
+                    });
+                }
+            });
+        }
+        for (auto &thread: producerThreads)
+            thread.join();
+        // one 0 at a time, so each consumer gets one
+        for (int c = 0; c < consumers; ++c) {
+            queue.push(0);
+            while (done.load() == c)
+                std::this_thread::yield();
+        }
+        for (auto &thread: threads)
+            thread.join();
+        EXPECT_EQ(consumed.load(), n * producers + consumers);
+        EXPECT_EQ(sum.load(), producers * n * (n + 1) / 2);
+    }
+
+    TEST(QueueTests, SpscTransfer) {
+        transfer<SpscQueue<std::uint64_t, YieldWait>>(1, 1);
+        transfer<SpscQueue<std::uint64_t, FutexWait>>(1, 1);
+    }
+
+    TEST(QueueTests, MpmcTransfer) {
+        transfer<MpmcQueue<std::uint64_t, YieldWait>>(1, 3);
+        transfer<MpmcQueue<std::uint64_t, FutexWait>>(3, 1);
+        transfer<MpmcQueue<std::uint64_t, FutexWait>>(2, 2);
+    }
+
+    TEST(QueueTests, FutexWaitWakesConsumer) {
+        SpscQueue<int, FutexWait> queue(4);
+        std::atomic<int> received(0);
+        std::thread consumer([&]() {
+            // the consumer goes to sleep on the futex until the producer publishes
+            queue.waitConsume([&received](int &item) { received = item; });
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_EQ(received.load(), 0);
+        queue.push(42);
+        consumer.join();
+        EXPECT_EQ(received.load(), 42);
+    }
+
+    TEST(QueueTests, HandOff) {
+        using wildcat::ws::OpCode;
+        using slot_t = wildcat::ws::MessageSlot<16>;
+        SpscQueue<slot_t, FutexWait> queue(4);
+        wildcat::ws::HandOff handOff(queue);
+
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveMode = wildcat::ws::ReceiveMode::RECV_FIRST;
+        auto client = std::make_unique<wildcat::ws::Client<wildcat::ws::LoopbackStream>>(
+                std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // more messages than the queue holds, so the polling thread waits for the consumer
+        std::vector<std::string> messages;
+        std::string data;
+        for (int i = 0; i < 10; ++i) {
+            messages.push_back(i == 5 ? std::string(100, 'x') : "message " + std::to_string(i));
+            data += static_cast<char>(0x81);
+            data += static_cast<char>(messages.back().size());
+            data += messages.back();
+        }
+
+        std::vector<std::string> received;
+        std::thread consumer([&]() {
+            while (received.size() < messages.size()) {
+                queue.waitConsume([&received, &messages](slot_t &slot) {
+                    EXPECT_EQ(slot.opCode, OpCode::TEXT);
+                    // the oversized message is flagged, with the length of the message it was cut from
+                    EXPECT_EQ(slot.isTruncated(), received.size() == 5);
+                    EXPECT_EQ(slot.messageLength, messages[received.size()].size());
+                    received.emplace_back(reinterpret_cast<const char *>(slot.data.data()), slot.length);
+                });
+            }
+        });
+
+        ASSERT_EQ(send(serverFd, data.data(), data.size(), 0), data.size());
+        client->pollBatch(handOff);
+        consumer.join();
+
+        ASSERT_EQ(received.size(), messages.size());
+        for (std::size_t i = 0; i < messages.size(); ++i)
+            EXPECT_EQ(received[i], messages[i].substr(0, 16));
+        EXPECT_EQ(handOff.truncated(), 1);
+        close(serverFd);
+    }
+
+}
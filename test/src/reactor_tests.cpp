@@ -0,0 +1,155 @@
+
+#include <map>
+#include <wildcat/ws/loopback.hpp>
+#include <wildcat/ws/reactor.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using client_t = wildcat::ws::Client<wildcat::ws::LoopbackStream>;
+
+    /// Writes an unmasked text frame, as a server would, to the file descriptor
+    void writeFrame(int fd, const std::string &message) {
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::TEXT;
+        header.isFinal = true;
+        header.messageLength = message.size();
+        header.mask = false;
+
+        std::vector<std::uint8_t> buffer(message.size() + wildcat::ws::MAX_FRAME_HEADER_LENGTH);
+        wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+        frameWriter.write(header, reinterpret_cast<const uint8_t *>(message.data()));
+        ASSERT_EQ(send(fd, buffer.data(), frameWriter.frameLength(), 0), frameWriter.frameLength());
+    }
+
+    struct Connection {
+        std::unique_ptr<client_t> client;
+        int serverFd;
+    };
+
+    Connection makeConnection() {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        return {std::make_unique<client_t>(std::move(stream)), serverFd};
+    }
+
+    TEST(ReactorTests, DispatchReadyClients) {
+        wildcat::ws::Reactor<wildcat::ws::LoopbackStream> reactor(wildcat::ws::WaitMode::BLOCKING);
+
+        std::vector<Connection> connections;
+        for (int i = 0; i < 3; ++i) {
+            connections.push_back(makeConnection());
+            reactor.add(connections.back().client.get());
+        }
+        EXPECT_EQ(reactor.size(), 3);
+
+        std::map<client_t *, std::vector<std::string>> received;
+        auto f = [&received](client_t &client, wildcat::ws::OpCode opCode, const std::uint8_t *buffer,
+                             std::size_t length) {
+            EXPECT_EQ(opCode, wildcat::ws::OpCode::TEXT);
+            received[&client].emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+
+        // the clients are writable right after registration, drain those notifications first
+        while (reactor.poll(f, 0) > 0) {}
+        EXPECT_TRUE(received.empty());
+
+        // several frames for the first and last client, nothing for the middle one
+        writeFrame(connections[0].serverFd, "a1");
+        writeFrame(connections[0].serverFd, "a2");
+        writeFrame(connections[0].serverFd, "a3");
+        writeFrame(connections[2].serverFd, "c1");
+
+        const auto n = reactor.poll(f, 1000);
+        EXPECT_EQ(n, 2);
+        // edge-triggered, so every frame already in the socket is dispatched by the one call
+        const std::vector<std::string> expected0{"a1", "a2", "a3"};
+        const std::vector<std::string> expected2{"c1"};
+        EXPECT_EQ(received[connections[0].client.get()], expected0);
+        EXPECT_EQ(received[connections[2].client.get()], expected2);
+        EXPECT_EQ(received.count(connections[1].client.get()), 0);
+
+        // no new data, nothing ready
+        EXPECT_EQ(reactor.poll(f, 0), 0);
+
+        reactor.remove(connections[0].client.get());
+        EXPECT_EQ(reactor.size(), 2);
+        writeFrame(connections[0].serverFd, "a4");
+        EXPECT_EQ(reactor.poll(f, 0), 0);
+        EXPECT_EQ(received[connections[0].client.get()].size(), 3);
+
+        for (auto &connection: connections)
+            close(connection.serverFd);
+    }
+
+    TEST(ReactorTests, HandlerThrowsAndServerGoesAway) {
+        wildcat::ws::Reactor<wildcat::ws::LoopbackStream> reactor(wildcat::ws::WaitMode::BLOCKING);
+        std::vector<Connection> connections;
+        for (int i = 0; i < 3; ++i) {
+            connections.push_back(makeConnection());
+            reactor.add(connections.back().client.get());
+        }
+
+        std::map<client_t *, std::vector<std::string>> received;
+        auto f = [&received](client_t &client, wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+            received[&client].emplace_back(reinterpret_cast<const char *>(buffer), length);
+            if (received[&client].back() == "bad")
+                throw std::runtime_error("bad message");
+        };
+        while (reactor.poll(f, 0) > 0) {}
+
+        // the client whose connection is dropped is closed and removed by its close handler, while it is polled
+        auto *dropped = connections[2].client.get();
+        std::vector<wildcat::ws::CloseCode> codes;
+        dropped->setCloseHandler([&](wildcat::ws::CloseCode code, std::string_view) {
+            codes.push_back(code);
+            reactor.remove(dropped);
+        });
+
+        writeFrame(connections[0].serverFd, "bad");
+        writeFrame(connections[1].serverFd, "b1");
+        close(connections[2].serverFd);
+
+        // the exception of one client does not lose the readiness of the others
+        int errors = 0;
+        for (int i = 0; i < 10 && (received[connections[1].client.get()].empty() || codes.empty()); ++i) {
+            try {
+                reactor.poll(f, 100);
+            } catch (const std::runtime_error &) {
+                ++errors;
+            }
+        }
+        EXPECT_EQ(errors, 1);
+        EXPECT_EQ(received[connections[1].client.get()], std::vector<std::string>{"b1"});
+        EXPECT_EQ(dropped->state(), wildcat::ws::ConnectionState::CLOSED);
+        ASSERT_EQ(codes.size(), 1);
+        EXPECT_EQ(codes[0], wildcat::ws::CloseCode::ABNORMAL);
+        EXPECT_EQ(reactor.size(), 2);
+
+        close(connections[0].serverFd);
+        close(connections[1].serverFd);
+    }
+
+    TEST(ReactorTests, BusyPoll) {
+        wildcat::ws::Reactor<wildcat::ws::LoopbackStream> reactor(wildcat::ws::WaitMode::BUSY_POLL);
+        auto connection = makeConnection();
+        reactor.add(connection.client.get());
+
+        std::vector<std::string> received;
+        auto f = [&received](client_t &, wildcat::ws::OpCode, const std::uint8_t *buffer,
+                             std::size_t length) {
+            received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+        while (reactor.poll(f) > 0) {}
+
+        // busy poll ignores the timeout and returns immediately
+        EXPECT_EQ(reactor.poll(f, -1), 0);
+
+        writeFrame(connection.serverFd, "hello");
+        while (received.empty())
+            reactor.poll(f);
+        EXPECT_EQ(received.front(), "hello");
+        close(connection.serverFd);
+    }
+
+}
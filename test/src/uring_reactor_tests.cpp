@@ -0,0 +1,203 @@
+
+#include <map>
+#include <wildcat/ws/loopback.hpp>
+#include <wildcat/ws/uring_reactor.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+    using client_t = wildcat::ws::Client<wildcat::ws::LoopbackStream>;
+    using reactor_t = wildcat::ws::UringReactor<wildcat::ws::LoopbackStream>;
+
+    std::string genRandomMessage(int n) {
+        static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        std::string out;
+        out.reserve(n);
+        for (int i = 0; i < n; ++i)
+            out += alphanum[rand() % (sizeof(alphanum) - 1)];
+
+        return out;
+    }
+
+    /// Writes an unmasked text frame, as a server would, to the file descriptor
+    void writeFrame(int fd, const std::string &message) {
+        wildcat::ws::FrameHeader header;
+        header.opCode = wildcat::ws::OpCode::TEXT;
+        header.isFinal = true;
+        header.messageLength = message.size();
+        header.mask = false;
+
+        std::vector<std::uint8_t> buffer(message.size() + wildcat::ws::MAX_FRAME_HEADER_LENGTH);
+        wildcat::ws::FrameWriter frameWriter(buffer.data(), buffer.size());
+        frameWriter.write(header, reinterpret_cast<const uint8_t *>(message.data()));
+        ASSERT_EQ(send(fd, buffer.data(), frameWriter.frameLength(), 0), frameWriter.frameLength());
+    }
+
+    struct Connection {
+        std::unique_ptr<client_t> client;
+        int serverFd;
+    };
+
+    Connection makeConnection() {
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        auto stream = std::make_unique<wildcat::ws::LoopbackStream>(clientFd);
+        return {std::make_unique<client_t>(std::move(stream)), serverFd};
+    }
+
+    void dispatchReadyClients(reactor_t &reactor) {
+        std::vector<Connection> connections;
+        for (int i = 0; i < 3; ++i) {
+            connections.push_back(makeConnection());
+            reactor.add(connections.back().client.get());
+        }
+        EXPECT_EQ(reactor.size(), 3);
+
+        std::map<client_t *, std::vector<std::string>> received;
+        auto f = [&received](client_t &client, wildcat::ws::OpCode opCode, const std::uint8_t *buffer,
+                             std::size_t length) {
+            EXPECT_EQ(opCode, wildcat::ws::OpCode::TEXT);
+            received[&client].emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+        while (reactor.poll(f, 0) > 0) {}
+
+        writeFrame(connections[0].serverFd, "a1");
+        writeFrame(connections[0].serverFd, "a2");
+        writeFrame(connections[2].serverFd, genRandomMessage(100000));
+
+        // frames may arrive over several completions, poll until all of them are dispatched
+        while (received[connections[0].client.get()].size() < 2 || received[connections[2].client.get()].empty())
+            reactor.poll(f, 1000);
+
+        const std::vector<std::string> expected0{"a1", "a2"};
+        EXPECT_EQ(received[connections[0].client.get()], expected0);
+        EXPECT_EQ(received[connections[2].client.get()].front().size(), 100000);
+        EXPECT_TRUE(received[connections[1].client.get()].empty());
+
+        // a removed client is no longer read
+        reactor.remove(connections[0].client.get());
+        EXPECT_EQ(reactor.size(), 2);
+        writeFrame(connections[0].serverFd, "a3");
+        writeFrame(connections[1].serverFd, "b1");
+        while (received[connections[1].client.get()].empty())
+            reactor.poll(f, 1000);
+        EXPECT_EQ(received[connections[0].client.get()].size(), 2);
+
+        for (auto &connection: connections) {
+            if (connection.client.get() != connections[0].client.get())
+                reactor.remove(connection.client.get());
+            close(connection.serverFd);
+        }
+        EXPECT_EQ(reactor.size(), 0);
+    }
+
+    TEST(UringReactorTests, DispatchReadyClients) {
+        reactor_t reactor(wildcat::ws::WaitMode::BLOCKING, 16);
+        if (!wildcat::ws::IoUring::isSupported()) {
+            // the reactor falls back to epoll
+            EXPECT_FALSE(reactor.isUringEnabled());
+        } else {
+            EXPECT_TRUE(reactor.isUringEnabled());
+        }
+        dispatchReadyClients(reactor);
+    }
+
+    TEST(UringReactorTests, DispatchDeferredRead) {
+        reactor_t reactor(wildcat::ws::WaitMode::BLOCKING, 16);
+        auto removed = makeConnection();
+        const auto [clientFd, serverFd] = wildcat::ws::makeSocketPair();
+        wildcat::ws::Config config;
+        config.receiveBufferSize = 4096;
+        client_t client(std::make_unique<wildcat::ws::LoopbackStream>(clientFd), config);
+
+        // the first read of the client fills its buffer and completes while the other client is removed, so its
+        // frames are dispatched by the next poll, which then reads the rest
+        std::vector<std::string> messages;
+        for (int i = 0; i < 20; ++i) {
+            messages.push_back(genRandomMessage(1000));
+            writeFrame(serverFd, messages.back());
+        }
+        reactor.add(removed.client.get());
+        reactor.add(&client);
+        reactor.remove(removed.client.get());
+
+        std::vector<std::string> received;
+        auto f = [&received](client_t &, wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+            received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+        for (int i = 0; i < 100 && received.size() < messages.size(); ++i)
+            reactor.poll(f, 100);
+        EXPECT_EQ(received, messages);
+
+        reactor.remove(&client);
+        close(removed.serverFd);
+        close(serverFd);
+    }
+
+    TEST(UringReactorTests, DispatchThrows) {
+        reactor_t reactor(wildcat::ws::WaitMode::BLOCKING, 16);
+        auto connection = makeConnection();
+        reactor.add(connection.client.get());
+
+        std::vector<std::string> received;
+        auto f = [&received](client_t &, wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+            received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+
+        // a frame followed by one with a reserved bit set, which throws while the read is dispatched
+        writeFrame(connection.serverFd, "a1");
+        const std::uint8_t invalid[] = {0xa1, 0x00};
+        ASSERT_EQ(send(connection.serverFd, invalid, sizeof(invalid), 0), sizeof(invalid));
+        EXPECT_THROW({
+                         for (int i = 0; i < 100; ++i)
+                             reactor.poll(f, 100);
+                     }, wildcat::ws::ProtocolError);
+        EXPECT_EQ(received, std::vector<std::string>{"a1"});
+
+        // the completion that threw is not handed out again
+        EXPECT_NO_THROW(reactor.poll(f, 0));
+        EXPECT_EQ(received, std::vector<std::string>{"a1"});
+
+        reactor.remove(connection.client.get());
+        close(connection.serverFd);
+    }
+
+    void serverGoesAway(reactor_t &reactor) {
+        auto connection = makeConnection();
+        reactor.add(connection.client.get());
+        std::vector<wildcat::ws::CloseCode> codes;
+        connection.client->setCloseHandler([&codes](wildcat::ws::CloseCode code, std::string_view) {
+            codes.push_back(code);
+        });
+
+        std::vector<std::string> received;
+        auto f = [&received](client_t &, wildcat::ws::OpCode, const std::uint8_t *buffer, std::size_t length) {
+            received.emplace_back(reinterpret_cast<const char *>(buffer), length);
+        };
+        writeFrame(connection.serverFd, "last");
+        close(connection.serverFd);
+        for (int i = 0; i < 100 && codes.empty(); ++i)
+            reactor.poll(f, 100);
+
+        EXPECT_EQ(received, std::vector<std::string>{"last"});
+        EXPECT_EQ(connection.client->state(), wildcat::ws::ConnectionState::CLOSED);
+        ASSERT_EQ(codes.size(), 1);
+        EXPECT_EQ(codes[0], wildcat::ws::CloseCode::ABNORMAL);
+        reactor.remove(connection.client.get());
+        EXPECT_EQ(reactor.size(), 0);
+    }
+
+    TEST(UringReactorTests, ServerGoesAway) {
+        reactor_t reactor(wildcat::ws::WaitMode::BLOCKING, 16);
+        serverGoesAway(reactor);
+        reactor_t fallback(wildcat::ws::WaitMode::BLOCKING, 16, false);
+        serverGoesAway(fallback);
+    }
+
+    TEST(UringReactorTests, Fallback) {
+        reactor_t reactor(wildcat::ws::WaitMode::BLOCKING, 16, false);
+        EXPECT_FALSE(reactor.isUringEnabled());
+        EXPECT_FALSE(reactor.hasFixedBuffers());
+        dispatchReadyClients(reactor);
+    }
+
+}